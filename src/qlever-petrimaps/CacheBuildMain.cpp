@@ -0,0 +1,183 @@
+// Copyright 2026, agent <agent@local>
+
+#include <curl/curl.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <string>
+
+#include "qlever-petrimaps/GeomCache.h"
+#include "util/Misc.h"
+#include "util/log/Log.h"
+
+using petrimaps::GeomCache;
+
+// _____________________________________________________________________________
+void printHelp(int argc, char** argv) {
+  UNUSED(argc);
+  std::cout << "Usage: " << argv[0]
+            << " -b <backend> [-g <tsv dump> -i <id dump> [-x <hash>]]"
+            << " [-c <cachedir> | -o <file>] [-s <i>/<n>] [-m <maxmemory>] [-q]"
+            << " [--help] [-h]"
+            << "\n";
+  std::cout
+      << "\nBuilds the geometry cache file of a backend for petrimaps -c, "
+         "either by filling it from the backend or from local dumps of the "
+         "fill query's results.\n"
+      << "\nAllowed arguments:\n    -b <url>     QLever backend (default: "
+         "none)"
+      << "\n    -g <file>    TSV result of the fill query"
+      << "\n    -i <file>    binary (application/octet-stream) result of the "
+         "fill query"
+      << "\n    -x <hash>    index hash of the dumps (default: requested "
+         "from the backend)"
+      << "\n    -c <dir>     cache dir, the file is named as petrimaps -c "
+         "expects it"
+      << "\n    -o <file>    output file, instead of -c"
+      << "\n    -s <i>/<n>   only build shard i of n, for petrimaps -s"
+      << "\n    -m <memory>  Max memory in GB (default: 90% of system RAM)"
+      << "\n    -q           print the fill query of the backend and exit\n";
+}
+
+// _____________________________________________________________________________
+int main(int argc, char** argv) {
+  // disable output buffering for standard output
+  setbuf(stdout, NULL);
+
+  // init CURL
+  curl_global_init(CURL_GLOBAL_DEFAULT);
+
+  double maxMemoryGB =
+      (sysconf(_SC_PHYS_PAGES) * sysconf(_SC_PAGE_SIZE) * 0.9) / 1000000000;
+  std::string backend;
+  std::string tsvDump;
+  std::string idDump;
+  std::string indexHash;
+  std::string cacheDir;
+  std::string outFile;
+  size_t shard = 0;
+  size_t numShards = 1;
+  bool printQuery = false;
+
+  for (int i = 1; i < argc; i++) {
+    std::string cur = argv[i];
+    if (cur == "-h" || cur == "--help") {
+      printHelp(argc, argv);
+      exit(0);
+    } else if (cur == "-b") {
+      if (++i >= argc) {
+        LOG(ERROR) << "Missing argument for backend (-b).";
+        exit(1);
+      }
+      backend = argv[i];
+    } else if (cur == "-g") {
+      if (++i >= argc) {
+        LOG(ERROR) << "Missing argument for TSV dump (-g).";
+        exit(1);
+      }
+      tsvDump = argv[i];
+    } else if (cur == "-i") {
+      if (++i >= argc) {
+        LOG(ERROR) << "Missing argument for id dump (-i).";
+        exit(1);
+      }
+      idDump = argv[i];
+    } else if (cur == "-x") {
+      if (++i >= argc) {
+        LOG(ERROR) << "Missing argument for index hash (-x).";
+        exit(1);
+      }
+      indexHash = argv[i];
+    } else if (cur == "-c") {
+      if (++i >= argc) {
+        LOG(ERROR) << "Missing argument for cache dir (-c).";
+        exit(1);
+      }
+      cacheDir = argv[i];
+    } else if (cur == "-o") {
+      if (++i >= argc) {
+        LOG(ERROR) << "Missing argument for output file (-o).";
+        exit(1);
+      }
+      outFile = argv[i];
+    } else if (cur == "-s") {
+      if (++i >= argc) {
+        LOG(ERROR) << "Missing argument for shard (-s).";
+        exit(1);
+      }
+      auto parts = util::split(argv[i], '/');
+      if (parts.size() != 2 || atoi(parts[1].c_str()) < 1 ||
+          atoi(parts[0].c_str()) < 0 ||
+          atoi(parts[0].c_str()) >= atoi(parts[1].c_str())) {
+        LOG(ERROR) << "Invalid shard (-s), expected <i>/<n> with i < n.";
+        exit(1);
+      }
+      shard = atoi(parts[0].c_str());
+      numShards = atoi(parts[1].c_str());
+    } else if (cur == "-m") {
+      if (++i >= argc) {
+        LOG(ERROR) << "Missing argument for max memory (-m).";
+        exit(1);
+      }
+      maxMemoryGB = atof(argv[i]);
+    } else if (cur == "-q") {
+      printQuery = true;
+    }
+  }
+
+  if (backend.empty()) {
+    LOG(ERROR) << "No backend (-b) specified.";
+    exit(1);
+  }
+
+  GeomCache cache(backend, maxMemoryGB * 1000000000, false);
+  cache.setShard(shard, numShards);
+
+  if (printQuery) {
+    std::cout << cache.getFillQuery() << std::endl;
+    exit(0);
+  }
+
+  if (tsvDump.empty() != idDump.empty()) {
+    LOG(ERROR) << "Dumps need both a TSV dump (-g) and an id dump (-i).";
+    exit(1);
+  }
+
+  if (cacheDir.empty() == outFile.empty()) {
+    LOG(ERROR) << "Specify either a cache dir (-c) or an output file (-o).";
+    exit(1);
+  }
+
+  if (tsvDump.size() && indexHash.empty()) {
+    indexHash = util::trim(GeomCache::requestIndexHash(backend));
+    if (indexHash.empty()) {
+      LOG(ERROR) << "Could not request the index hash of " << backend
+                 << ", specify it with -x.";
+      exit(1);
+    }
+  }
+
+  try {
+    if (tsvDump.size()) {
+      LOG(INFO) << "Building cache from " << tsvDump << " and " << idDump
+                << "...";
+      cache.requestFromDumps(tsvDump, idDump, indexHash);
+    } else {
+      LOG(INFO) << "Building cache from " << backend << "...";
+      cache.load("", util::trim(GeomCache::requestIndexHash(backend)));
+    }
+
+    if (outFile.empty()) {
+      outFile =
+          GeomCache::cacheFilePath(cacheDir, backend, cache.getIndexHash()) +
+          cache.shardName();
+    }
+
+    LOG(INFO) << "Serializing to cache file " << outFile << "...";
+    cache.serializeToDisk(outFile);
+    LOG(INFO) << "done ...";
+  } catch (const std::exception& e) {
+    LOG(ERROR) << e.what();
+    exit(1);
+  }
+}
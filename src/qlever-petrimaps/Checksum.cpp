@@ -0,0 +1,64 @@
+// Copyright 2026, agent <agent@local>
+
+#include <string.h>
+
+#include <cstdio>
+
+#include "qlever-petrimaps/Checksum.h"
+
+using petrimaps::Checksum;
+
+// _____________________________________________________________________________
+uint64_t Checksum::mix(uint64_t h, uint64_t w) {
+  // FNV-1a on words, the shift spreads high bits back to the low ones
+  h = (h ^ w) * 1099511628211ull;
+  return h ^ (h >> 32);
+}
+
+// _____________________________________________________________________________
+void Checksum::update(const char* data, size_t size) {
+  _len += size;
+
+  // complete a word left over from the last call
+  while (_bufSize > 0 && _bufSize < 8 && size > 0) {
+    _buf[_bufSize++] = *data++;
+    size--;
+  }
+
+  if (_bufSize == 8) {
+    uint64_t w;
+    memcpy(&w, _buf, 8);
+    _h = mix(_h, w);
+    _bufSize = 0;
+  }
+
+  for (; size >= 8; data += 8, size -= 8) {
+    uint64_t w;
+    memcpy(&w, data, 8);
+    _h = mix(_h, w);
+  }
+
+  memcpy(_buf, data, size);
+  _bufSize += size;
+}
+
+// _____________________________________________________________________________
+uint64_t Checksum::get() const {
+  uint64_t h = _h;
+
+  if (_bufSize > 0) {
+    uint64_t w = 0;
+    memcpy(&w, _buf, _bufSize);
+    h = mix(h, w);
+  }
+
+  // distinguishes inputs which only differ in trailing zero bytes
+  return mix(h, _len);
+}
+
+// _____________________________________________________________________________
+std::string Checksum::hex() const {
+  char buf[17];
+  snprintf(buf, sizeof(buf), "%016llx", static_cast<unsigned long long>(get()));
+  return buf;
+}
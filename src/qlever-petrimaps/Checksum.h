@@ -0,0 +1,37 @@
+// Copyright 2026, agent <agent@local>
+
+#ifndef PETRIMAPS_CHECKSUM_H_
+#define PETRIMAPS_CHECKSUM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+namespace petrimaps {
+
+// Streaming 64 bit checksum of a byte sequence, to detect corrupted or
+// truncated cache file transfers. Works on 8 byte words, so it runs at
+// memory speed. Not a cryptographic hash.
+class Checksum {
+ public:
+  void update(const char* data, size_t size);
+
+  // the checksum of all bytes passed to update() so far
+  uint64_t get() const;
+
+  // get() as 16 hex digits
+  std::string hex() const;
+
+ private:
+  uint64_t _h = 14695981039346656037ull;
+  uint64_t _len = 0;
+  char _buf[8];
+  size_t _bufSize = 0;
+
+  static uint64_t mix(uint64_t h, uint64_t w);
+};
+
+}  // namespace petrimaps
+
+#endif  // PETRIMAPS_CHECKSUM_H_
@@ -0,0 +1,76 @@
+# Embed a static web asset into a C++ header.
+#
+# Usage:
+#   cmake -DIN=<file> -DOUT=<header> -DNAME=<identifier>
+#         [-DGZIP=<gzip binary>] [-DBROTLI=<brotli binary>]
+#         [-DVERSIONED=<ref>=<file>,<ref>=<file>,...]
+#         -P EmbedAsset.cmake
+#
+# The header defines
+#
+#   <NAME>[], <NAME>_len         the raw content
+#   <NAME>_gz[], <NAME>_gz_len   gzip variant, length 0 if GZIP is not given
+#   <NAME>_br[], <NAME>_br_len   brotli variant, length 0 if BROTLI is not given
+#   <NAME>_hash                  hex content hash of the raw content
+#
+# Every reference <ref> in the content listed in VERSIONED is replaced by
+# <ref>?v=<hash of file>, so that the referenced assets can be cached forever.
+
+cmake_minimum_required(VERSION 3.5)
+
+function(to_c_array name path)
+  file(READ "${path}" hex HEX)
+  string(LENGTH "${hex}" hexlen)
+  math(EXPR len "${hexlen} / 2")
+  if (len EQUAL 0)
+    set(bytes "0x00")
+  else()
+    string(REGEX REPLACE "(................................)" "\\1\n" hex
+      "${hex}")
+    string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," bytes "${hex}")
+  endif()
+  file(APPEND "${OUT}" "static const unsigned char ${name}[] = {\n${bytes}\n};\n")
+  file(APPEND "${OUT}" "static const unsigned int ${name}_len = ${len};\n\n")
+endfunction()
+
+function(compress name path binary args)
+  if (binary AND EXISTS "${binary}")
+    execute_process(COMMAND "${binary}" ${args} "${path}"
+      OUTPUT_FILE "${OUT}.${name}" RESULT_VARIABLE res)
+    if (NOT res EQUAL 0)
+      message(FATAL_ERROR "Could not compress ${path} with ${binary}")
+    endif()
+  else()
+    file(WRITE "${OUT}.${name}" "")
+  endif()
+endfunction()
+
+file(READ "${IN}" content)
+
+if (VERSIONED)
+  string(REPLACE "," ";" VERSIONED "${VERSIONED}")
+  foreach(v ${VERSIONED})
+    string(REGEX MATCH "^([^=]+)=(.+)$" m "${v}")
+    file(SHA256 "${CMAKE_MATCH_2}" refhash)
+    string(SUBSTRING "${refhash}" 0 16 refhash)
+    string(REPLACE "${CMAKE_MATCH_1}" "${CMAKE_MATCH_1}?v=${refhash}" content
+      "${content}")
+  endforeach()
+endif()
+
+set(src "${OUT}.src")
+file(WRITE "${src}" "${content}")
+
+compress(gz "${src}" "${GZIP}" "-9;-n;-c")
+compress(br "${src}" "${BROTLI}" "-q;11;-c")
+
+file(SHA256 "${src}" hash)
+string(SUBSTRING "${hash}" 0 16 hash)
+
+file(WRITE "${OUT}" "// generated from ${IN}, do not edit\n\n")
+to_c_array(${NAME} "${src}")
+to_c_array(${NAME}_gz "${OUT}.gz")
+to_c_array(${NAME}_br "${OUT}.br")
+file(APPEND "${OUT}" "static const char ${NAME}_hash[] = \"${hash}\";\n")
+
+file(REMOVE "${src}" "${OUT}.gz" "${OUT}.br")
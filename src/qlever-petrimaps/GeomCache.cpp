@@ -8,13 +8,20 @@
 #include <algorithm>
 #include <atomic>
 #include <cassert>
+#include <chrono>
+#include <cmath>
 #include <cstring>
 #include <fstream>
 #include <iostream>
+#include <limits>
 #include <sstream>
+#include <thread>
 
+#include "qlever-petrimaps/Checksum.h"
 #include "qlever-petrimaps/GeomCache.h"
 #include "qlever-petrimaps/Misc.h"
+#include "qlever-petrimaps/Projection.h"
+#include "qlever-petrimaps/TaskPool.h"
 #include "qlever-petrimaps/server/Requestor.h"
 #include "util/Misc.h"
 #include "util/geo/Geo.h"
@@ -22,6 +29,7 @@
 #include "util/log/Log.h"
 
 using petrimaps::GeomCache;
+using petrimaps::TaskPool;
 using util::geo::DPoint;
 using util::geo::FPoint;
 using util::geo::latLngToWebMerc;
@@ -54,6 +62,43 @@ const static std::string QUERY_WDTP625_SERVICE =
     "  }"
     "}";
 
+// the direct qid index is only built if the qid range is at most this many
+// times larger than the number of geometries
+const static size_t QID_INDEX_MAX_SPARSITY = 4;
+
+// number of ids processed per task when joining ids via the qid index
+const static size_t REL_OBJECTS_GRAIN = 1 << 16;
+
+// the geometry fill is checkpointed every this many rows
+const static size_t FILL_CHECKPOINT_ROWS = 1000000;
+
+// max number of consecutive failed fill attempts without progress
+const static size_t FILL_MAX_RETRIES = 8;
+
+// max backoff between two fill attempts, in seconds
+const static size_t FILL_MAX_BACKOFF = 120;
+
+// memory usage is checked every this many rows during the fill
+const static size_t FILL_MEM_CHECK_ROWS = 100000;
+
+// fill buffers are spilled to disk if the anonymous memory usage, which
+// checkMem() compares against the max memory, exceeds this fraction of it
+const static double FILL_SPILL_THRESHOLD = 0.8;
+
+// local dumps are read in blocks of this size
+const static size_t DUMP_BLOCK_SIZE = 1 << 24;
+
+// number of parts per worker the TSV dump is split into, for load balancing
+const static size_t DUMP_PARTS_PER_SLOT = 4;
+
+// peers which do not accept the connection within this many seconds, or
+// which send less than PEER_LOW_SPEED_LIMIT bytes per second for
+// PEER_LOW_SPEED_TIME seconds, are given up on. Cache files can be several
+// GB large, so there is no limit on the total transfer time
+const static long PEER_CONNECT_TIMEOUT = 10;
+const static long PEER_LOW_SPEED_LIMIT = 1024;
+const static long PEER_LOW_SPEED_TIME = 60;
+
 // _____________________________________________________________________________
 const std::string &GeomCache::getQuery(const std::string &backendUrl) const {
   // Helper lambda that returns true if the backend name (the part after the
@@ -114,11 +159,15 @@ size_t GeomCache::writeCb(void *contents, size_t size, size_t nmemb,
 size_t GeomCache::writeCbIds(void *contents, size_t size, size_t nmemb,
                              void *userp) {
   size_t realsize = size * nmemb;
+  auto cache = static_cast<GeomCache *>(userp);
+
+  // abort the transfer if the geometry fill failed
+  if (cache->_cancelIds) return 0;
+
   try {
-    static_cast<GeomCache *>(userp)->parseIds(
-        static_cast<const char *>(contents), realsize);
+    cache->parseIds(static_cast<const char *>(contents), realsize);
   } catch (...) {
-    static_cast<GeomCache *>(userp)->_exceptionPtr = std::current_exception();
+    cache->_idsExceptionPtr = std::current_exception();
     return CURLE_WRITE_ERROR;
   }
   return realsize;
@@ -169,28 +218,20 @@ void GeomCache::parse(const char *c, size_t size) {
           if (isGeom && _prev == _dangling && _lastQidToId.qid == 0) {
             IdMapping idm{0, _lastQidToId.id};
             _lastQidToId = idm;
-            _qidToIdF.write(reinterpret_cast<const char *>(&idm),
-                            sizeof(IdMapping));
-            _qidToIdFSize++;
+            _qidToIdFill.push_back(idm);
           } else if (isGeom && p != std::string::npos) {
             _curUniqueGeom++;
             p += 7;
             auto point = parsePoint(_dangling, p);
             if (pointValid(point)) {
-              _pointsF.write(reinterpret_cast<const char *>(&point),
-                             sizeof(util::geo::FPoint));
-              _pointsFSize++;
-              IdMapping idm{0, _pointsFSize - 1};
+              _pointsFill.push_back(point);
+              IdMapping idm{0, _pointsFill.size() - 1};
               _lastQidToId = idm;
-              _qidToIdF.write(reinterpret_cast<const char *>(&idm),
-                              sizeof(IdMapping));
-              _qidToIdFSize++;
+              _qidToIdFill.push_back(idm);
             } else {
               IdMapping idm{0, std::numeric_limits<ID_TYPE>::max()};
               _lastQidToId = idm;
-              _qidToIdF.write(reinterpret_cast<const char *>(&idm),
-                              sizeof(IdMapping));
-              _qidToIdFSize++;
+              _qidToIdFill.push_back(idm);
             }
           } else if (isGeom && (p = _dangling.rfind("\"LINESTRING(", 0)) !=
                                    std::string::npos) {
@@ -200,20 +241,14 @@ void GeomCache::parse(const char *c, size_t size) {
             if (line.size() == 0) {
               IdMapping idm{0, std::numeric_limits<ID_TYPE>::max()};
               _lastQidToId = idm;
-              _qidToIdF.write(reinterpret_cast<const char *>(&idm),
-                              sizeof(IdMapping));
-              _qidToIdFSize++;
+              _qidToIdFill.push_back(idm);
             } else {
-              _linesF.write(reinterpret_cast<const char *>(&_linePointsFSize),
-                            sizeof(size_t));
-              _linesFSize++;
+              _linesFill.push_back(_linePointsFill.size());
               insertLine(line, false);
 
-              IdMapping idm{0, I_OFFSET + _linesFSize - 1};
+              IdMapping idm{0, I_OFFSET + _linesFill.size() - 1};
               _lastQidToId = idm;
-              _qidToIdF.write(reinterpret_cast<const char *>(&idm),
-                              sizeof(IdMapping));
-              _qidToIdFSize++;
+              _qidToIdFill.push_back(idm);
             }
           } else if (isGeom && (p = _dangling.rfind("\"MULTILINESTRING(", 0)) !=
                                    std::string::npos) {
@@ -226,30 +261,22 @@ void GeomCache::parse(const char *c, size_t size) {
                 if (i == 0) {
                   IdMapping idm{0, std::numeric_limits<ID_TYPE>::max()};
                   _lastQidToId = idm;
-                  _qidToIdF.write(reinterpret_cast<const char *>(&idm),
-                                  sizeof(IdMapping));
-                  _qidToIdFSize++;
+                  _qidToIdFill.push_back(idm);
                 }
               } else {
-                _linesF.write(reinterpret_cast<const char *>(&_linePointsFSize),
-                              sizeof(size_t));
-                _linesFSize++;
+                _linesFill.push_back(_linePointsFill.size());
                 insertLine(line, false);
 
-                IdMapping idm{i == 0 ? 0 : 1, I_OFFSET + _linesFSize - 1};
+                IdMapping idm{i == 0 ? 0 : 1, I_OFFSET + _linesFill.size() - 1};
                 _lastQidToId = idm;
-                _qidToIdF.write(reinterpret_cast<const char *>(&idm),
-                                sizeof(IdMapping));
-                _qidToIdFSize++;
+                _qidToIdFill.push_back(idm);
               }
               i++;
             }
             if (i == 0) {
               IdMapping idm{0, std::numeric_limits<ID_TYPE>::max()};
               _lastQidToId = idm;
-              _qidToIdF.write(reinterpret_cast<const char *>(&idm),
-                              sizeof(IdMapping));
-              _qidToIdFSize++;
+              _qidToIdFill.push_back(idm);
             }
           } else if (isGeom && (p = _dangling.rfind("\"POLYGON(", 0)) !=
                                    std::string::npos) {
@@ -262,30 +289,22 @@ void GeomCache::parse(const char *c, size_t size) {
                 if (i == 0) {
                   IdMapping idm{0, std::numeric_limits<ID_TYPE>::max()};
                   _lastQidToId = idm;
-                  _qidToIdF.write(reinterpret_cast<const char *>(&idm),
-                                  sizeof(IdMapping));
-                  _qidToIdFSize++;
+                  _qidToIdFill.push_back(idm);
                 }
               } else {
-                _linesF.write(reinterpret_cast<const char *>(&_linePointsFSize),
-                              sizeof(size_t));
-                _linesFSize++;
+                _linesFill.push_back(_linePointsFill.size());
                 insertLine(line, true);
 
-                IdMapping idm{i == 0 ? 0 : 1, I_OFFSET + _linesFSize - 1};
+                IdMapping idm{i == 0 ? 0 : 1, I_OFFSET + _linesFill.size() - 1};
                 _lastQidToId = idm;
-                _qidToIdF.write(reinterpret_cast<const char *>(&idm),
-                                sizeof(IdMapping));
-                _qidToIdFSize++;
+                _qidToIdFill.push_back(idm);
               }
               i++;
             }
             if (i == 0) {
               IdMapping idm{0, std::numeric_limits<ID_TYPE>::max()};
               _lastQidToId = idm;
-              _qidToIdF.write(reinterpret_cast<const char *>(&idm),
-                              sizeof(IdMapping));
-              _qidToIdFSize++;
+              _qidToIdFill.push_back(idm);
             }
           } else if (isGeom && (p = _dangling.rfind("\"MULTIPOLYGON(", 0)) !=
                                    std::string::npos) {
@@ -299,37 +318,27 @@ void GeomCache::parse(const char *c, size_t size) {
                 if (i == 0) {
                   IdMapping idm{0, std::numeric_limits<ID_TYPE>::max()};
                   _lastQidToId = idm;
-                  _qidToIdF.write(reinterpret_cast<const char *>(&idm),
-                                  sizeof(IdMapping));
-                  _qidToIdFSize++;
+                  _qidToIdFill.push_back(idm);
                 }
               } else {
-                _linesF.write(reinterpret_cast<const char *>(&_linePointsFSize),
-                              sizeof(size_t));
-                _linesFSize++;
+                _linesFill.push_back(_linePointsFill.size());
                 insertLine(line, true);
 
-                IdMapping idm{i == 0 ? 0 : 1, I_OFFSET + _linesFSize - 1};
+                IdMapping idm{i == 0 ? 0 : 1, I_OFFSET + _linesFill.size() - 1};
                 _lastQidToId = idm;
-                _qidToIdF.write(reinterpret_cast<const char *>(&idm),
-                                sizeof(IdMapping));
-                _qidToIdFSize++;
+                _qidToIdFill.push_back(idm);
               }
               i++;
             }
             if (i == 0) {
               IdMapping idm{0, std::numeric_limits<ID_TYPE>::max()};
               _lastQidToId = idm;
-              _qidToIdF.write(reinterpret_cast<const char *>(&idm),
-                              sizeof(IdMapping));
-              _qidToIdFSize++;
+              _qidToIdFill.push_back(idm);
             }
           } else {
             IdMapping idm{0, std::numeric_limits<ID_TYPE>::max()};
             _lastQidToId = idm;
-            _qidToIdF.write(reinterpret_cast<const char *>(&idm),
-                            sizeof(IdMapping));
-            _qidToIdFSize++;
+            _qidToIdFill.push_back(idm);
           }
 
           if (*c == '\n') {
@@ -338,13 +347,16 @@ void GeomCache::parse(const char *c, size_t size) {
               LOG(INFO) << "[GEOMCACHE] "
                         << "@ row " << _curRow << " (" << std::fixed
                         << std::setprecision(2) << getLoadStatusPercent()
-                        << "%, " << _pointsFSize << " points, " << _linesFSize
-                        << " (open) polygons (with " << _linePointsFSize
+                        << "%, " << _pointsFill.size() << " points, "
+                        << _linesFill.size() << " (open) polygons (with "
+                        << _linePointsFill.size()
                         << " points), " << _geometryDuplicates
                         << " duplicates)";
             }
             _prev = _dangling;
             _dangling.clear();
+            if (_curRow % FILL_MEM_CHECK_ROWS == 0) spillIfNeeded();
+            if (_curRow % FILL_CHECKPOINT_ROWS == 0) checkpoint();
             c++;
             continue;
           } else {
@@ -368,9 +380,10 @@ void GeomCache::parse(const char *c, size_t size) {
 // _____________________________________________________________________________
 double GeomCache::getLoadStatusPercent(bool total) {
   /*
-  There are 2 loading stages: Parse, afterwards ParseIds.
-  Because ParseIds is usually pretty short, we merge the progress of both stages
-  to one total progress. Progress is calculated by _curRow / _totalSize, which
+  There are 2 loading stages: Parse, afterwards ParseIds. The binary ids are
+  transferred concurrently to Parse, ParseIds only aligns them with the parsed
+  geometries. Because ParseIds is pretty short, we merge the progress of both
+  stages to one total progress. Progress is calculated by _curRow / _totalSize, which
   are handled by each stage individually.
   */
   if (_totalSize == 0) {
@@ -397,6 +410,7 @@ double GeomCache::getLoadStatusPercent(bool total) {
       break;
 
     case _LoadStatusStages::FromFile:
+    case _LoadStatusStages::FromPeer:
       totalPercent = _curRow / static_cast<double>(_totalSize) * 100.0;
       break;
   }
@@ -415,60 +429,94 @@ size_t GeomCache::getCurrentProgress() { return _curRow; }
 
 // _____________________________________________________________________________
 void GeomCache::parseIds(const char *c, size_t size) {
-  _loadStatusStage = _LoadStatusStages::ParseIds;
-
-  size_t lastQid = -1;
   for (size_t i = 0; i < size; i++) {
-    if (_raw.size() < 10000) _raw.push_back(c[i]);
+    if (_rawIds.size() < 10000) _rawIds.push_back(c[i]);
     _curId.bytes[_curByte] = c[i];
     _curByte = (_curByte + 1) % 8;
 
     if (_curByte == 0) {
-      if (_curRow % 1000000 == 0) {
+      _rowQidsFill.push_back(_curId.val);
+
+      if (_rowQidsFill.size() % 1000000 == 0) {
         LOG(INFO) << "[GEOMCACHE] "
-                  << "@ row " << _curRow << " (" << std::fixed
-                  << std::setprecision(2) << getLoadStatusPercent() << "%, "
-                  << _pointsFSize << " points, " << _linesFSize
-                  << " (open) polygons)";
+                  << "@ id row " << _rowQidsFill.size();
       }
 
-      if (_curRow < _qidToId.size() && _qidToId[_curRow].qid == 0) {
-        // if we have two consecutive and equivalent QLever ids, the geometry
-        // was returned multiple times in the fill query. This can happen if the
-        // same WKT string is used in multiple distinct objects, but then stored
-        // in qlever using the same internal qlever ID. To avoid a false multi-
-        // plication of results (all geoms of matching qlever ID are joined), we
-        // set such repeated qlever IDs to an unnsed dummy value.
-        if (lastQid == _curId.val) {
-          LOG(DEBUG) << "Found duplicate internal qlever ID " << _curId.val
-                     << " for row " << _curRow
-                     << ", ignoring this geometry duplicate!";
-          _qidToId[_curRow].qid = -1;
-          _geometryDuplicates++;
-        } else {
-          _qidToId[_curRow].qid = _curId.val;
-        }
-        lastQid = _curId.val;
-        if (_curId.val > _maxQid) _maxQid = _curId.val;
-      } else {
-        LOG(WARN) << "The results for the binary IDs are out of sync.";
-        LOG(WARN) << "_curRow: " << _curRow
-                  << " _qleverIdInt.size: " << _qidToId.size()
-                  << " cur val: " << _qidToId[_curRow].qid;
+      if (_rowQidsFill.size() % FILL_MEM_CHECK_ROWS == 0 &&
+          getAnonRSS() >= _maxMemory * FILL_SPILL_THRESHOLD) {
+        _rowQidsFill.spill();
       }
+    }
+  }
+}
 
-      // if a qlever entity contained multiple geometries (MULTILINESTRING,
-      // MULTIPOLYGON, MULTIPOINT), they appear consecutively in
-      // _qidToId; continuation geometries are marked by a
-      // preliminary qlever ID of 1, while the first geometry always has a
-      // preliminary id of 0
-      while (_curRow < _qidToId.size() - 1 && _qidToId[_curRow + 1].qid == 1) {
-        _qidToId[++_curRow].qid = _curId.val;
-      }
+// _____________________________________________________________________________
+void GeomCache::alignIds() {
+  _loadStatusStage = _LoadStatusStages::ParseIds;
+
+  std::vector<uint64_t> rowQids;
+  _rowQidsFill.moveTo(&rowQids);
+
+  LOG(INFO) << "[GEOMCACHE] Aligning " << rowQids.size() << " ids with "
+            << _qidToId.size() << " geometries...";
+
+  // every row yields exactly one geometry with preliminary id 0, if the
+  // numbers differ, one of the passes was truncated
+  size_t rows = std::count_if(
+      _qidToId.begin(), _qidToId.end(),
+      [](const IdMapping &idm) { return idm.qid == 0; });
+
+  if (rows != rowQids.size()) {
+    std::stringstream ss;
+    ss << "The results for the binary IDs are out of sync: received "
+       << rowQids.size() << " ids for " << rows << " geometry rows";
+    throw std::runtime_error(ss.str());
+  }
 
-      _curRow++;
+  _curRow = 0;
+  _maxQid = 0;
+
+  size_t lastQid = -1;
+  size_t j = 0;
+  for (size_t row = 0; row < rowQids.size(); row++) {
+    uint64_t qid = rowQids[row];
+
+    if (row % 1000000 == 0) _curRow = row;
+
+    // if we have two consecutive and equivalent QLever ids, the geometry
+    // was returned multiple times in the fill query. This can happen if the
+    // same WKT string is used in multiple distinct objects, but then stored
+    // in qlever using the same internal qlever ID. To avoid a false multi-
+    // plication of results (all geoms of matching qlever ID are joined), we
+    // set such repeated qlever IDs to an unnsed dummy value.
+    if (lastQid == qid) {
+      LOG(DEBUG) << "Found duplicate internal qlever ID " << qid
+                 << " for row " << row
+                 << ", ignoring this geometry duplicate!";
+      _qidToId[j].qid = -1;
+      _geometryDuplicates++;
+    } else {
+      _qidToId[j].qid = qid;
     }
+    lastQid = qid;
+    if (qid > _maxQid) _maxQid = qid;
+
+    // if a qlever entity contained multiple geometries (MULTILINESTRING,
+    // MULTIPOLYGON, MULTIPOINT), they appear consecutively in
+    // _qidToId; continuation geometries are marked by a
+    // preliminary qlever ID of 1, while the first geometry always has a
+    // preliminary id of 0
+    while (j + 1 < _qidToId.size() && _qidToId[j + 1].qid == 1) {
+      _qidToId[++j].qid = qid;
+    }
+
+    j++;
   }
+
+  _curRow = rowQids.size();
+
+  LOG(INFO) << "[GEOMCACHE] Max QLever id was " << _maxQid;
+  LOG(INFO) << "[GEOMCACHE] ... done";
 }
 
 // _____________________________________________________________________________
@@ -551,7 +599,7 @@ size_t GeomCache::requestSize() {
 }
 
 // _____________________________________________________________________________
-void GeomCache::requestPart(size_t offset) {
+bool GeomCache::requestPart(size_t offset) {
   _state = IN_HEADER;
   _dangling.clear();
   _dangling.reserve(10000);
@@ -562,7 +610,8 @@ void GeomCache::requestPart(size_t offset) {
   char errbuf[CURL_ERROR_SIZE];
 
   if (_curl) {
-    auto qUrl = queryUrl(getQuery(_backendUrl), offset, 1000000);
+    size_t limit = _numShards > 1 ? _totalSize - offset : MAXROWS;
+    auto qUrl = queryUrl(getQuery(_backendUrl), _rowBegin + offset, limit);
     curl_easy_setopt(_curl, CURLOPT_URL, qUrl.c_str());
     curl_easy_setopt(_curl, CURLOPT_WRITEFUNCTION, GeomCache::writeCb);
     curl_easy_setopt(_curl, CURLOPT_WRITEDATA, this);
@@ -585,6 +634,15 @@ void GeomCache::requestPart(size_t offset) {
 
     curl_slist_free_all(headers);
 
+    if (_exceptionPtr) std::rethrow_exception(_exceptionPtr);
+
+    // no response or server error, the backend may be restarting
+    if (httpCode == 0 || httpCode >= 500) {
+      LOG(ERROR) << "[GEOMCACHE] QLever backend returned status code "
+                 << httpCode << " during query (offset=" << offset << ")";
+      return false;
+    }
+
     if (httpCode != 200) {
       std::stringstream ss;
       ss << "QLever backend returned status code " << httpCode
@@ -593,11 +651,9 @@ void GeomCache::requestPart(size_t offset) {
       ss << _raw;
       throw std::runtime_error(ss.str());
     }
-
-    if (_exceptionPtr) std::rethrow_exception(_exceptionPtr);
   } else {
     LOG(ERROR) << "[GEOMCACHE] Failed to perform curl request.";
-    return;
+    return true;
   }
 
   // check if there was an error
@@ -608,170 +664,544 @@ void GeomCache::requestPart(size_t offset) {
     } else {
       LOG(ERROR) << "[GEOMCACHE] " << curl_easy_strerror(res);
     }
+    return false;
   }
+
+  return true;
+}
+
+// _____________________________________________________________________________
+void GeomCache::checkpoint() {
+  _checkpoint.row = _curRow;
+  _checkpoint.numPoints = _pointsFill.size();
+  _checkpoint.numLinePoints = _linePointsFill.size();
+  _checkpoint.numLines = _linesFill.size();
+  _checkpoint.numQidToId = _qidToIdFill.size();
+  _checkpoint.curUniqueGeom = _curUniqueGeom;
+  _checkpoint.geometryDuplicates = _geometryDuplicates;
+  _checkpoint.lastQidToId = _lastQidToId;
+  _checkpoint.prev = _prev;
+}
+
+// _____________________________________________________________________________
+void GeomCache::restoreCheckpoint() {
+  _curRow = _checkpoint.row;
+  _curUniqueGeom = _checkpoint.curUniqueGeom;
+  _geometryDuplicates = _checkpoint.geometryDuplicates;
+  _lastQidToId = _checkpoint.lastQidToId;
+  _prev = _checkpoint.prev;
+
+  _pointsFill.truncate(_checkpoint.numPoints);
+  _linePointsFill.truncate(_checkpoint.numLinePoints);
+  _linesFill.truncate(_checkpoint.numLines);
+  _qidToIdFill.truncate(_checkpoint.numQidToId);
+}
+
+// _____________________________________________________________________________
+void GeomCache::spillIfNeeded() {
+  if (getAnonRSS() < _maxMemory * FILL_SPILL_THRESHOLD) return;
+
+  size_t mem = _pointsFill.memUsage() + _linePointsFill.memUsage() +
+               _linesFill.memUsage() + _qidToIdFill.memUsage();
+
+  LOG(INFO) << "[GEOMCACHE] Memory pressure, spilling " << mem
+            << " bytes of fill buffers to disk...";
+
+  _pointsFill.spill();
+  _linePointsFill.spill();
+  _linesFill.spill();
+  _qidToIdFill.spill();
 }
 
 // _____________________________________________________________________________
 void GeomCache::request() {
-  _totalSize = requestSize();
-  _geometryDuplicates = 0;
+  _exceptionPtr = 0;
+  size_t total = requestSize();
 
-  if (_totalSize == 0) {
+  if (total == 0) {
     throw std::runtime_error(
         "Could not determine number of rows, or number of rows was 0");
   }
 
+  // a shard only holds its range of rows
+  _rowBegin = total * _shard / _numShards;
+  _totalSize = total * (_shard + 1) / _numShards - _rowBegin;
+
+  resetFill();
+
+  LOG(INFO) << "[GEOMCACHE] Total request size: " << total;
+  if (_numShards > 1) {
+    LOG(INFO) << "[GEOMCACHE] Shard " << _shard << " of " << _numShards
+              << " holds rows " << _rowBegin << " to "
+              << _rowBegin + _totalSize;
+  }
+  LOG(INFO) << "[GEOMCACHE] Query is:\n" << getQuery(_backendUrl);
+
+  // the binary ids are requested concurrently, both results have the same
+  // order, and are aligned row by row afterwards
+  _cancelIds = false;
+  std::exception_ptr idsEx;
+  std::thread idsThread([this, &idsEx]() {
+    try {
+      requestIds();
+    } catch (...) {
+      idsEx = std::current_exception();
+    }
+  });
+
+  try {
+    requestGeoms();
+  } catch (...) {
+    _cancelIds = true;
+    idsThread.join();
+    throw;
+  }
+
+  idsThread.join();
+  if (idsEx) std::rethrow_exception(idsEx);
+
+  finishFill();
+}
+
+// _____________________________________________________________________________
+void GeomCache::resetFill() {
   _state = IN_HEADER;
+  _geometryDuplicates = 0;
   _points.clear();
   _lines.clear();
   _linePoints.clear();
+  _packedLines = PackedLineStore();
   _qidToId.clear();
+  _qidIndex.clear();
 
   _lastQidToId = {-1, -1};
 
   _raw.clear();
   _raw.reserve(100000);
 
-  char *pointsFName = strdup("pointsXXXXXX");
-  int i = mkstemp(pointsFName);
-  if (i == -1) throw std::runtime_error("Could not create temporary file");
-  _pointsF.open(pointsFName, std::ios::out | std::ios::in | std::ios::binary);
-
-  char *linePointsFName = strdup("linepointsXXXXXX");
-  i = mkstemp(linePointsFName);
-  if (i == -1) throw std::runtime_error("Could not create temporary file");
-  _linePointsF.open(linePointsFName,
-                    std::ios::out | std::ios::in | std::ios::binary);
-
-  char *linesFName = strdup("linesXXXXXX");
-  i = mkstemp(linesFName);
-  if (i == -1) throw std::runtime_error("Could not create temporary file");
-  _linesF.open(linesFName, std::ios::out | std::ios::in | std::ios::binary);
-
-  char *qidToIdFName = strdup("qidtoidXXXXXX");
-  i = mkstemp(qidToIdFName);
-  if (i == -1) throw std::runtime_error("Could not create temporary file");
-  _qidToIdF.open(qidToIdFName, std::ios::out | std::ios::in | std::ios::binary);
-
-  // immediately unlink
-  unlink(pointsFName);
-  unlink(linePointsFName);
-  unlink(linesFName);
-  unlink(qidToIdFName);
-
-  free(pointsFName);
-  free(linePointsFName);
-  free(linesFName);
-  free(qidToIdFName);
-
-  _pointsFSize = 0;
-  _linePointsFSize = 0;
-  _linesFSize = 0;
-  _qidToIdFSize = 0;
+  _pointsFill.clear();
+  _linePointsFill.clear();
+  _linesFill.clear();
+  _qidToIdFill.clear();
 
   _curRow = 0;
   _curUniqueGeom = 0;
 
-  size_t lastNum = -1;
-
-  LOG(INFO) << "[GEOMCACHE] Total request size: " << _totalSize;
-  LOG(INFO) << "[GEOMCACHE] Query is:\n" << getQuery(_backendUrl);
-
-  while (lastNum != 0) {
-    size_t offset = _curRow;
-    requestPart(offset);
-    lastNum = _curRow - offset;
-  }
+  _prev.clear();
+  checkpoint();
 
-  if (i == -1) throw std::runtime_error("Could not create temporary file");
+  _rowQidsFill.clear();
+  _curByte = 0;
+}
 
+// _____________________________________________________________________________
+void GeomCache::finishFill() {
   LOG(INFO) << "[GEOMCACHE] Building vectors...";
 
-  _points.resize(_pointsFSize);
-  _pointsF.seekg(0);
-  _pointsF.read(reinterpret_cast<char *>(&_points[0]),
-                sizeof(util::geo::FPoint) * _pointsFSize);
-  _pointsF.close();
-
-  _linePoints.resize(_linePointsFSize);
-  _linePointsF.seekg(0);
-  _linePointsF.read(reinterpret_cast<char *>(&_linePoints[0]),
-                    sizeof(util::geo::Point<int16_t>) * _linePointsFSize);
-  _linePointsF.close();
-
-  _lines.resize(_linesFSize);
-  _linesF.seekg(0);
-  _linesF.read(reinterpret_cast<char *>(&_lines[0]),
-               sizeof(size_t) * _linesFSize);
-  _linesF.close();
-
-  _qidToId.resize(_qidToIdFSize);
-  _qidToIdF.seekg(0);
-  _qidToIdF.read(reinterpret_cast<char *>(&_qidToId[0]),
-                 sizeof(IdMapping) * _qidToIdFSize);
-  _qidToIdF.close();
+  _pointsFill.moveTo(&_points);
+  _linePointsFill.moveTo(&_linePoints);
+  _linesFill.moveTo(&_lines);
+  _qidToIdFill.moveTo(&_qidToId);
 
   LOG(INFO) << "[GEOMCACHE] Done";
   LOG(INFO) << "[GEOMCACHE] Received " << _curUniqueGeom << " unique geoms ("
             << _geometryDuplicates << " geometry duplicates transferred)";
   LOG(INFO) << "[GEOMCACHE] Received " << _points.size() << " points and "
             << _lines.size() << " lines";
+
+  alignIds();
+
+  // sorting by qlever id
+  LOG(INFO) << "[GEOMCACHE] Sorting results by qlever ID...";
+  std::stable_sort(_qidToId.begin(), _qidToId.end());
+  LOG(INFO) << "[GEOMCACHE] ... done";
+
+  buildQidIndex();
+}
+
+// _____________________________________________________________________________
+namespace {
+// offset of the row n rows after the row starting at pos in the TSV dump f,
+// or end
+size_t skipRows(std::ifstream &f, size_t pos, size_t end, size_t n) {
+  f.clear();
+  f.seekg(pos);
+  std::vector<char> buf(DUMP_BLOCK_SIZE);
+  while (n > 0 && pos < end) {
+    size_t len = std::min(buf.size(), end - pos);
+    if (!f.read(buf.data(), len)) {
+      throw std::runtime_error("Could not read TSV dump");
+    }
+    for (size_t i = 0; i < len; i++) {
+      if (buf[i] == '\n' && --n == 0) return pos + i + 1;
+    }
+    pos += len;
+  }
+  return n == 0 ? pos : end;
+}
+
+// _____________________________________________________________________________
+// start of the first row after the row containing pos in the TSV dump f
+// which does not repeat the row before it, or end. Repeated rows re-use the
+// geometry of the previous row, so they must be parsed in the same part
+size_t partBegin(std::ifstream &f, size_t pos, size_t end) {
+  auto same = [](const std::string &a, const std::string &b) {
+    return a.size() == b.size() &&
+           std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+             return toupper(x) == toupper(y);
+           });
+  };
+
+  f.clear();
+  f.seekg(pos);
+  std::string prev, row;
+  if (!std::getline(f, row)) return end;
+  pos += row.size() + 1;
+  if (pos >= end || !std::getline(f, prev)) return end;
+  pos += prev.size() + 1;
+
+  while (pos < end && std::getline(f, row)) {
+    if (!same(row, prev)) return pos;
+    pos += row.size() + 1;
+    std::swap(row, prev);
+  }
+  return end;
+}
+}  // namespace
+
+// _____________________________________________________________________________
+void GeomCache::requestFromDumps(const std::string &tsvFile,
+                                 const std::string &idsFile,
+                                 const std::string &indexHash) {
+  std::lock_guard<std::mutex> guard(_m);
+
+  std::ifstream tsv(tsvFile, std::ios::binary | std::ios::ate);
+  if (!tsv.good()) throw std::runtime_error("Could not open " + tsvFile);
+  size_t size = tsv.tellg();
+
+  std::ifstream ids(idsFile, std::ios::binary | std::ios::ate);
+  if (!ids.good()) throw std::runtime_error("Could not open " + idsFile);
+  size_t numRows = static_cast<size_t>(ids.tellg()) / 8;
+
+  if (static_cast<size_t>(ids.tellg()) % 8 != 0) {
+    throw std::runtime_error(idsFile + " is not a binary id dump");
+  }
+
+  _exceptionPtr = 0;
+  _totalSize = 0;
+  _ready = false;
+  _indexHash = indexHash;
+  resetFill();
+
+  // the rows start after the header, a shard only holds its range of rows
+  size_t rowBegin = numRows * _shard / _numShards;
+  size_t rowEnd = numRows * (_shard + 1) / _numShards;
+  size_t begin = skipRows(tsv, 0, size, 1 + rowBegin);
+  size_t end = skipRows(tsv, begin, size, rowEnd - rowBegin);
+
+  if (_numShards > 1) {
+    LOG(INFO) << "[GEOMCACHE] Shard " << _shard << " of " << _numShards
+              << " holds rows " << rowBegin << " to " << rowEnd;
+  }
+
+  auto &pool = TaskPool::global();
+  size_t numParts = pool.numSlots() * DUMP_PARTS_PER_SLOT;
+
+  // split the dump into parts of whole rows
+  std::vector<size_t> bounds(numParts + 1, end);
+  bounds[0] = begin;
+  for (size_t i = 1; i < numParts; i++) {
+    size_t pos = std::max(bounds[i - 1], begin + (end - begin) / numParts * i);
+    bounds[i] = partBegin(tsv, pos, end);
+  }
+
+  LOG(INFO) << "[GEOMCACHE] Parsing " << end - begin << " bytes of "
+            << tsvFile << " in " << numParts << " parts...";
+
+  // every part is parsed by a cache of its own, the parts are concatenated
+  // afterwards. As no part starts with a repeated row, the result is the
+  // same as that of a fill from the backend
+  std::vector<std::unique_ptr<GeomCache>> parts(numParts);
+
+  pool.parallelFor(numParts, 1, [&](size_t b, size_t e, size_t t) {
+    UNUSED(t);
+    for (size_t i = b; i < e; i++) {
+      parts[i].reset(new GeomCache("", _maxMemory, false));
+      auto &part = *parts[i];
+      part.resetFill();
+      part._state = IN_ROW;
+
+      std::ifstream f(tsvFile, std::ios::binary);
+      f.seekg(bounds[i]);
+      std::vector<char> buf(
+          std::min(DUMP_BLOCK_SIZE, bounds[i + 1] - bounds[i]));
+
+      size_t pos = bounds[i];
+      char last = '\n';
+      while (pos < bounds[i + 1]) {
+        size_t n = std::min(buf.size(), bounds[i + 1] - pos);
+        if (!f.read(buf.data(), n)) {
+          throw std::runtime_error("Could not read " + tsvFile);
+        }
+        part.parse(buf.data(), n);
+        last = buf[n - 1];
+        pos += n;
+      }
+
+      // terminate a last row without line break
+      if (last != '\n') part.parse("\n", 1);
+    }
+  });
+
+  for (auto &part : parts) {
+    size_t pointOffset = _pointsFill.size();
+    size_t lineOffset = _linesFill.size();
+    size_t linePointOffset = _linePointsFill.size();
+
+    std::vector<util::geo::FPoint> points;
+    part->_pointsFill.moveTo(&points);
+    for (const auto &p : points) _pointsFill.push_back(p);
+
+    std::vector<util::geo::Point<int16_t>> linePoints;
+    part->_linePointsFill.moveTo(&linePoints);
+    for (const auto &p : linePoints) _linePointsFill.push_back(p);
+
+    std::vector<size_t> lines;
+    part->_linesFill.moveTo(&lines);
+    for (auto l : lines) _linesFill.push_back(linePointOffset + l);
+
+    std::vector<IdMapping> qidToId;
+    part->_qidToIdFill.moveTo(&qidToId);
+    for (auto idm : qidToId) {
+      if (idm.id != std::numeric_limits<ID_TYPE>::max()) {
+        idm.id += idm.id >= I_OFFSET ? lineOffset : pointOffset;
+      }
+      _qidToIdFill.push_back(idm);
+    }
+
+    _curRow += part->_curRow;
+    _curUniqueGeom += part->_curUniqueGeom;
+    _geometryDuplicates += part->_geometryDuplicates;
+
+    part.reset();
+  }
+
+  LOG(INFO) << "[GEOMCACHE] Reading ids from " << idsFile << "...";
+
+  ids.seekg(rowBegin * 8);
+  std::vector<char> buf(DUMP_BLOCK_SIZE);
+  for (size_t pos = rowBegin * 8; pos < rowEnd * 8;) {
+    size_t n = std::min(buf.size(), rowEnd * 8 - pos);
+    if (!ids.read(buf.data(), n)) {
+      throw std::runtime_error("Could not read " + idsFile);
+    }
+    parseIds(buf.data(), n);
+    pos += n;
+  }
+
+  finishFill();
+
+  if (_packLines) packLines();
+
+  _ready = true;
+}
+
+// _____________________________________________________________________________
+void GeomCache::requestGeoms() {
+  // stream the entire result in a single request. If the transfer fails, or
+  // ends prematurely, resume from the last checkpoint
+  size_t tries = 0;
+  while (true) {
+    size_t offset = _curRow;
+    bool ok = requestPart(offset);
+
+    if (ok) {
+      if (_curRow >= _totalSize || _curRow == offset) break;
+
+      // the backend ended the transfer early, continue after the last row
+      checkpoint();
+      tries = 0;
+      continue;
+    }
+
+    size_t lastCheckpoint = _checkpoint.row;
+    restoreCheckpoint();
+
+    if (lastCheckpoint > offset) tries = 0;
+    if (++tries > FILL_MAX_RETRIES) {
+      std::stringstream ss;
+      ss << "Geometry fill failed " << FILL_MAX_RETRIES
+         << " times at row " << _curRow << ", giving up";
+      throw std::runtime_error(ss.str());
+    }
+
+    size_t backoff = std::min(FILL_MAX_BACKOFF, size_t(1) << tries);
+    LOG(WARN) << "[GEOMCACHE] Geometry fill interrupted at row " << offset
+              << ", resuming from row " << _curRow << " in " << backoff
+              << "s (attempt " << tries << " of " << FILL_MAX_RETRIES << ")";
+    std::this_thread::sleep_for(std::chrono::seconds(backoff));
+  }
 }
 
 // _____________________________________________________________________________
 void GeomCache::requestIds() {
+  _idsExceptionPtr = 0;
+  _rawIds.clear();
+  _rawIds.reserve(10000);
+
+  // like the geometry pass, the ids are streamed in a single request. If the
+  // transfer fails, or ends prematurely, resume after the last complete id
+  size_t tries = 0;
+  while (!_cancelIds) {
+    size_t offset = _rowQidsFill.size();
+    bool ok = requestIdsPart(offset);
+
+    if (_cancelIds) return;
+
+    if (ok) {
+      size_t rows = _rowQidsFill.size();
+      if (rows >= _totalSize || rows == offset) break;
+
+      // the backend ended the transfer early, continue after the last id
+      tries = 0;
+      continue;
+    }
+
+    if (_rowQidsFill.size() > offset) tries = 0;
+    if (++tries > FILL_MAX_RETRIES) {
+      std::stringstream ss;
+      ss << "Binary id fill failed " << FILL_MAX_RETRIES << " times at row "
+         << _rowQidsFill.size() << ", giving up";
+      throw std::runtime_error(ss.str());
+    }
+
+    size_t backoff = std::min(FILL_MAX_BACKOFF, size_t(1) << tries);
+    LOG(WARN) << "[GEOMCACHE] Binary id fill interrupted at row " << offset
+              << ", resuming from row " << _rowQidsFill.size() << " in "
+              << backoff << "s (attempt " << tries << " of "
+              << FILL_MAX_RETRIES << ")";
+
+    // the geometry pass may fail in the meantime
+    for (size_t i = 0; i < backoff && !_cancelIds; i++) {
+      std::this_thread::sleep_for(std::chrono::seconds(1));
+    }
+  }
+
+  LOG(INFO) << "[GEOMCACHE] Received " << _rowQidsFill.size() << " id rows";
+}
+
+// _____________________________________________________________________________
+bool GeomCache::requestIdsPart(size_t offset) {
+  // drop the bytes of an id cut off by a previous transfer
   _curByte = 0;
-  _curRow = 0;
-  _curUniqueGeom = 0;
-  _maxQid = 0;
-  _exceptionPtr = 0;
 
-  LOG(INFO) << "[GEOMCACHE] Query is " << getQuery(_backendUrl);
+  CURLcode res;
+  char errbuf[CURL_ERROR_SIZE];
+  errbuf[0] = 0;
 
-  if (_curl) {
-    auto qUrl = queryUrl(getQuery(_backendUrl), 0, MAXROWS);
+  // the geometry fill uses _curl concurrently
+  CURL *curl = curl_easy_init();
+
+  if (curl) {
+    size_t limit = _numShards > 1 ? _totalSize - offset : MAXROWS;
+    auto qUrl = queryUrl(getQuery(_backendUrl), _rowBegin + offset, limit);
     LOG(INFO) << "[GEOMCACHE] Binary ID query URL is " << qUrl;
-    curl_easy_setopt(_curl, CURLOPT_URL, qUrl.c_str());
-    curl_easy_setopt(_curl, CURLOPT_WRITEFUNCTION, GeomCache::writeCbIds);
-    curl_easy_setopt(_curl, CURLOPT_WRITEDATA, this);
-    curl_easy_setopt(_curl, CURLOPT_SSL_VERIFYPEER, false);
-    curl_easy_setopt(_curl, CURLOPT_SSL_VERIFYHOST, false);
-    curl_easy_setopt(_curl, CURLOPT_HTTPHEADER, 0);
+    curl_easy_setopt(curl, CURLOPT_URL, qUrl.c_str());
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, GeomCache::writeCbIds);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, this);
+    curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, errbuf);
+    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, false);
+    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, false);
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, 0);
 
     // set headers
     struct curl_slist *headers = 0;
     headers = curl_slist_append(headers, "Accept: application/octet-stream");
-    curl_easy_setopt(_curl, CURLOPT_HTTPHEADER, headers);
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
 
     // accept any compression supported
-    curl_easy_setopt(_curl, CURLOPT_ACCEPT_ENCODING, "");
-    curl_easy_perform(_curl);
+    curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");
+    res = curl_easy_perform(curl);
 
     long httpCode = 0;
-    curl_easy_getinfo(_curl, CURLINFO_RESPONSE_CODE, &httpCode);
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &httpCode);
 
     curl_slist_free_all(headers);
+    curl_easy_cleanup(curl);
+
+    if (_cancelIds) return false;
+
+    if (_idsExceptionPtr) std::rethrow_exception(_idsExceptionPtr);
+
+    // no response or server error, the backend may be restarting
+    if (httpCode == 0 || httpCode >= 500) {
+      LOG(ERROR) << "[GEOMCACHE] QLever backend returned status code "
+                 << httpCode << " during id query (offset=" << offset << ")";
+      return false;
+    }
 
     if (httpCode != 200) {
       std::stringstream ss;
-      ss << "QLever backend returned status code " << httpCode;
+      ss << "QLever backend returned status code " << httpCode
+         << " during id query (offset=" << offset << ")";
       ss << "\n";
-      ss << _raw;
+      ss << _rawIds;
       throw std::runtime_error(ss.str());
     }
-
-    if (_exceptionPtr) std::rethrow_exception(_exceptionPtr);
   } else {
-    LOG(ERROR) << "[GEOMCACHE] Failed to perform curl request.";
+    throw std::runtime_error("Failed to perform curl request.");
   }
 
-  LOG(INFO) << "[GEOMCACHE] Received " << _curRow << " rows";
-  LOG(INFO) << "[GEOMCACHE] Max QLever id was " << _maxQid;
-  LOG(INFO) << "[GEOMCACHE] Done";
+  // check if there was an error, e.g. a transfer cut off mid-stream
+  if (res != CURLE_OK) {
+    size_t len = strlen(errbuf);
+    if (len > 0) {
+      LOG(ERROR) << "[GEOMCACHE] " << errbuf;
+    } else {
+      LOG(ERROR) << "[GEOMCACHE] " << curl_easy_strerror(res);
+    }
+    return false;
+  }
+
+  return true;
+}
+
+// _____________________________________________________________________________
+void GeomCache::buildQidIndex() {
+  _qidIndex.clear();
+  _qidIndexMin = 0;
+
+  // _qidToId is sorted, the dummy ids of geometry duplicates are at the end
+  size_t n = _qidToId.size();
+  while (n > 0 &&
+         _qidToId[n - 1].qid == std::numeric_limits<QLEVER_ID_TYPE>::max())
+    n--;
+
+  if (n == 0 || n >= std::numeric_limits<ID_TYPE>::max()) return;
+
+  size_t minQid = _qidToId[0].qid;
+  size_t maxQid = _qidToId[n - 1].qid;
+  size_t range = maxQid - minQid + 1;
+
+  if (range > QID_INDEX_MAX_SPARSITY * n) {
+    LOG(INFO) << "[GEOMCACHE] QLever ids too sparse (range " << range
+              << " for " << n << " geometries), using sorted qid join";
+    return;
+  }
+
+  LOG(INFO) << "[GEOMCACHE] Building direct qid index over " << range
+            << " ids...";
+
+  _qidIndexMin = minQid;
+  _qidIndex.resize(range + 1);
+
+  size_t j = 0;
+  for (size_t q = 0; q < range; q++) {
+    while (j < n && _qidToId[j].qid < minQid + q) j++;
+    _qidIndex[q] = j;
+  }
+  _qidIndex[range] = n;
 
-  // sorting by qlever id
-  LOG(INFO) << "[GEOMCACHE] Sorting results by qlever ID...";
-  std::stable_sort(_qidToId.begin(), _qidToId.end());
   LOG(INFO) << "[GEOMCACHE] ... done";
 }
 
@@ -819,8 +1249,11 @@ bool GeomCache::pointValid(const DPoint &p) {
 
 // _____________________________________________________________________________
 util::geo::DLine GeomCache::parseLineString(const std::string &a, size_t p) {
-  util::geo::DLine line;
-  line.reserve(2);
+  // coordinates are collected first and then projected in one batch
+  thread_local std::vector<double> lngs, lats;
+  lngs.clear();
+  lats.clear();
+
   auto end = memchr(a.c_str() + p, ')', a.size() - p);
   assert(end);
 
@@ -834,19 +1267,22 @@ util::geo::DLine GeomCache::parseLineString(const std::string &a, size_t p) {
 
     if (!next) break;
 
-    auto point = latLngToWebMerc(
-        DPoint(util::atof(a.c_str() + p, 10), util::atof(next, 10)));
-
-    if (pointValid(point)) line.push_back(point);
+    lngs.push_back(util::atof(a.c_str() + p, 10));
+    lats.push_back(util::atof(next, 10));
 
     auto n = memchr(a.c_str() + p, ',', a.size() - p);
     if (!n || n > end) break;
     p = static_cast<const char *>(n) - a.c_str() + 1;
   }
 
-  // the 200 is the THRESHOLD from Server.cpp
-  // return util::geo::densify(util::geo::simplify(line, 3), 200 * 3);
-  return util::geo::densify(line, 200 * 3);
+  util::geo::DLine line;
+  line.reserve(lngs.size());
+
+  // only the original vertices are stored, the line point grid samples long
+  // segments itself (see Requestor::request())
+  projectLine(lngs.data(), lats.data(), lngs.size(), &line);
+
+  return line;
 }
 
 // _____________________________________________________________________________
@@ -869,6 +1305,64 @@ util::geo::FPoint GeomCache::parsePoint(const std::string &a, size_t p) const {
 // _____________________________________________________________________________
 std::pair<std::vector<std::pair<ID_TYPE, ID_TYPE>>, size_t>
 GeomCache::getRelObjects(const std::vector<IdMapping> &ids) const {
+  if (hasQidIndex()) return getRelObjectsDirect(ids);
+  return getRelObjectsSorted(ids);
+}
+
+// _____________________________________________________________________________
+std::pair<std::vector<std::pair<ID_TYPE, ID_TYPE>>, size_t>
+GeomCache::getRelObjectsDirect(const std::vector<IdMapping> &ids) const {
+  auto& pool = TaskPool::global();
+
+  // chunk boundaries only depend on the grain size, so both passes below
+  // see the same chunks
+  size_t grain = REL_OBJECTS_GRAIN;
+  size_t numChunks = (ids.size() + grain - 1) / grain;
+
+  // first pass: count the matches of each chunk, the output keeps the order
+  // of ids, so each chunk can be written independently afterwards
+  std::vector<size_t> offsets(numChunks + 1, 0);
+  std::vector<size_t> numObjects(numChunks, 0);
+
+  pool.parallelFor(ids.size(), grain, [&](size_t b, size_t e, size_t) {
+    size_t c = b / grain;
+    for (size_t i = b; i < e; i++) {
+      size_t q = static_cast<size_t>(ids[i].qid) - _qidIndexMin;
+      if (q >= _qidIndex.size() - 1) continue;
+
+      size_t num = _qidIndex[q + 1] - _qidIndex[q];
+      offsets[c + 1] += num;
+      if (num) numObjects[c]++;
+    }
+  });
+
+  size_t totNumObjects = 0;
+  for (size_t c = 0; c < numChunks; c++) {
+    offsets[c + 1] += offsets[c];
+    totNumObjects += numObjects[c];
+  }
+
+  // (geom id, result row)
+  std::vector<std::pair<ID_TYPE, ID_TYPE>> ret(offsets.back());
+
+  pool.parallelFor(ids.size(), grain, [&](size_t b, size_t e, size_t) {
+    size_t pos = offsets[b / grain];
+    for (size_t i = b; i < e; i++) {
+      size_t q = static_cast<size_t>(ids[i].qid) - _qidIndexMin;
+      if (q >= _qidIndex.size() - 1) continue;
+
+      for (size_t j = _qidIndex[q]; j < _qidIndex[q + 1]; j++) {
+        ret[pos++] = {_qidToId[j].id, ids[i].id};
+      }
+    }
+  });
+
+  return {ret, totNumObjects};
+}
+
+// _____________________________________________________________________________
+std::pair<std::vector<std::pair<ID_TYPE, ID_TYPE>>, size_t>
+GeomCache::getRelObjectsSorted(const std::vector<IdMapping> &ids) const {
   // (geom id, result row)
   std::vector<std::pair<ID_TYPE, ID_TYPE>> ret;
 
@@ -932,9 +1426,7 @@ void GeomCache::insertLine(const util::geo::DLine &l, bool isArea) {
 
   if (mainX != 0 || mainY != 0) {
     util::geo::Point<int16_t> p{mCoord(mainX), mCoord(mainY)};
-    _linePointsF.write(reinterpret_cast<const char *>(&p),
-                       sizeof(util::geo::Point<int16_t>));
-    _linePointsFSize++;
+    _linePointsFill.push_back(p);
   }
 
   // add bounding box lower left
@@ -944,9 +1436,7 @@ void GeomCache::insertLine(const util::geo::DLine &l, bool isArea) {
       (bbox.getLowerLeft().getY() * 10.0) - mainY * M_COORD_GRANULARITY;
 
   util::geo::Point<int16_t> p{minorXLoc, minorYLoc};
-  _linePointsF.write(reinterpret_cast<const char *>(&p),
-                     sizeof(util::geo::Point<int16_t>));
-  _linePointsFSize++;
+  _linePointsFill.push_back(p);
 
   // add bounding box upper left
   int16_t mainXLoc = (bbox.getUpperRight().getX() * 10.0) / M_COORD_GRANULARITY;
@@ -960,14 +1450,10 @@ void GeomCache::insertLine(const util::geo::DLine &l, bool isArea) {
     mainY = mainYLoc;
 
     util::geo::Point<int16_t> p{mCoord(mainX), mCoord(mainY)};
-    _linePointsF.write(reinterpret_cast<const char *>(&p),
-                       sizeof(util::geo::Point<int16_t>));
-    _linePointsFSize++;
+    _linePointsFill.push_back(p);
   }
   p = util::geo::Point<int16_t>{minorXLoc, minorYLoc};
-  _linePointsF.write(reinterpret_cast<const char *>(&p),
-                     sizeof(util::geo::Point<int16_t>));
-  _linePointsFSize++;
+  _linePointsFill.push_back(p);
 
   // add line points
   for (const auto &p : l) {
@@ -979,32 +1465,28 @@ void GeomCache::insertLine(const util::geo::DLine &l, bool isArea) {
       mainY = mainYLoc;
 
       util::geo::Point<int16_t> p{mCoord(mainX), mCoord(mainY)};
-      _linePointsF.write(reinterpret_cast<const char *>(&p),
-                         sizeof(util::geo::Point<int16_t>));
-      _linePointsFSize++;
+      _linePointsFill.push_back(p);
     }
 
     int16_t minorXLoc = (p.getX() * 10.0) - mainXLoc * M_COORD_GRANULARITY;
     int16_t minorYLoc = (p.getY() * 10.0) - mainYLoc * M_COORD_GRANULARITY;
 
     util::geo::Point<int16_t> pp{minorXLoc, minorYLoc};
-    _linePointsF.write(reinterpret_cast<const char *>(&pp),
-                       sizeof(util::geo::Point<int16_t>));
-    _linePointsFSize++;
+    _linePointsFill.push_back(pp);
   }
 
   // if we have an area, we end in a major coord (which is not possible for
   // other types)
   if (isArea) {
     util::geo::Point<int16_t> p{mCoord(0), mCoord(0)};
-    _linePointsF.write(reinterpret_cast<const char *>(&p),
-                       sizeof(util::geo::Point<int16_t>));
-    _linePointsFSize++;
+    _linePointsFill.push_back(p);
   }
 }
 
 // _____________________________________________________________________________
 util::geo::DBox GeomCache::getLineBBox(size_t lid) const {
+  if (hasPackedLines()) return _packedLines.getBBox(lid);
+
   util::geo::DBox ret;
   size_t start = getLine(lid);
 
@@ -1037,6 +1519,64 @@ util::geo::DBox GeomCache::getLineBBox(size_t lid) const {
   return ret;
 }
 
+// _____________________________________________________________________________
+bool GeomCache::isLineArea(size_t lid) const {
+  if (hasPackedLines()) return _packedLines.isArea(lid);
+
+  // areas end with a major coordinate
+  return isMCoord(_linePoints[getLineEnd(lid) - 1].getX());
+}
+
+// _____________________________________________________________________________
+void GeomCache::packLines() {
+  LOG(INFO) << "[GEOMCACHE] Packing " << _lines.size() << " lines...";
+
+  size_t before = _linePoints.size() * sizeof(util::geo::Point<int16_t>) +
+                  _lines.size() * sizeof(size_t);
+
+  _packedLines = PackedLineStore();
+
+  std::vector<util::geo::Point<int32_t>> pts;
+
+  for (size_t lid = 0; lid < _lines.size(); lid++) {
+    pts.clear();
+
+    // areas end with a major coordinate
+    bool isArea = isMCoord(_linePoints[getLineEnd(lid) - 1].getX());
+
+    int32_t mainX = 0;
+    int32_t mainY = 0;
+
+    for (size_t i = getLine(lid); i < getLineEnd(lid); i++) {
+      const auto &cur = _linePoints[i];
+
+      if (isMCoord(cur.getX())) {
+        mainX = rmCoord(cur.getX());
+        mainY = rmCoord(cur.getY());
+        continue;
+      }
+
+      pts.push_back({mainX * M_COORD_GRANULARITY + cur.getX(),
+                     mainY * M_COORD_GRANULARITY + cur.getY()});
+    }
+
+    // the first two points are the bounding box
+    util::geo::Point<int32_t> ll = pts[0];
+    util::geo::Point<int32_t> ur = pts[1];
+    pts.erase(pts.begin(), pts.begin() + 2);
+
+    _packedLines.add(ll, ur, pts, isArea);
+  }
+
+  _packedLines.shrinkToFit();
+
+  std::vector<util::geo::Point<int16_t>>().swap(_linePoints);
+  std::vector<size_t>().swap(_lines);
+
+  LOG(INFO) << "[GEOMCACHE] ... done, " << before << " bytes -> "
+            << _packedLines.memUsage() << " bytes";
+}
+
 // _____________________________________________________________________________
 std::string GeomCache::indexHashFromDisk(const std::string &fname) {
   std::ifstream f(fname, std::ios::binary);
@@ -1053,6 +1593,8 @@ void GeomCache::fromDisk(const std::string &fname) {
   _points.clear();
   _linePoints.clear();
   _lines.clear();
+  _packedLines = PackedLineStore();
+  _qidIndex.clear();
 
   std::ifstream f(fname, std::ios::binary);
 
@@ -1095,7 +1637,23 @@ void GeomCache::fromDisk(const std::string &fname) {
   posQidToId = f.tellg();
   f.seekg(sizeof(IdMapping) * numQidToId, f.cur);
 
-  _totalSize = numPoints + numLinePoints + numLines + numQidToId;
+  // qidIndex, missing in cache files written by older versions
+  size_t numQidIndex = 0;
+  std::streampos posQidIndex;
+  bool hasQidIndexSection =
+      static_cast<bool>(f.read(reinterpret_cast<char *>(&numQidIndex),
+                               sizeof(size_t)));
+  if (hasQidIndexSection) {
+    f.read(reinterpret_cast<char *>(&_qidIndexMin), sizeof(QLEVER_ID_TYPE));
+    _qidIndex.resize(numQidIndex);
+    posQidIndex = f.tellg();
+  } else {
+    numQidIndex = 0;
+    f.clear();
+  }
+
+  _totalSize =
+      numPoints + numLinePoints + numLines + numQidToId + numQidIndex;
   _curRow = 0;
 
   // read data from file
@@ -1128,13 +1686,26 @@ void GeomCache::fromDisk(const std::string &fname) {
     _curRow += 1;
   }
 
+  // qidIndex
+  if (numQidIndex) f.seekg(posQidIndex);
+  for (size_t i = 0; i < numQidIndex; i++) {
+    f.read(reinterpret_cast<char *>(&_qidIndex[i]), sizeof(ID_TYPE));
+    _curRow += 1;
+  }
+
   f.close();
+
+  if (!hasQidIndexSection) buildQidIndex();
 }
 
 // _____________________________________________________________________________
 void GeomCache::serializeToDisk(const std::string &fname) const {
+  // write to a temporary file which replaces fname once complete, so readers
+  // never see a partially written cache
+  std::string tmpName = fname + ".tmp" + std::to_string(getpid());
+
   std::ofstream f;
-  f.open(fname);
+  f.open(tmpName, std::ios::binary);
 
   std::string h = _indexHash;
   h.insert(h.end(), 99 - h.size(), ' ');
@@ -1162,28 +1733,51 @@ void GeomCache::serializeToDisk(const std::string &fname) const {
   f.write(reinterpret_cast<const char *>(&_qidToId[0]),
           sizeof(IdMapping) * num);
 
+  num = _qidIndex.size();
+  f.write(reinterpret_cast<const char *>(&num), sizeof(size_t));
+  f.write(reinterpret_cast<const char *>(&_qidIndexMin),
+          sizeof(QLEVER_ID_TYPE));
+  if (num) {
+    f.write(reinterpret_cast<const char *>(&_qidIndex[0]),
+            sizeof(ID_TYPE) * num);
+  }
+
   f.close();
+
+  if (!f.good() || rename(tmpName.c_str(), fname.c_str()) != 0) {
+    std::remove(tmpName.c_str());
+    throw std::runtime_error("Could not write cache file " + fname);
+  }
+}
+
+// _____________________________________________________________________________
+std::string GeomCache::requestIndexHash(const std::string &backendUrl) {
+  CURL *curl = curl_easy_init();
+  std::string ret = requestIndexHash(curl, backendUrl);
+  if (curl) curl_easy_cleanup(curl);
+  return ret;
 }
 
 // _____________________________________________________________________________
-std::string GeomCache::requestIndexHash() {
+std::string GeomCache::requestIndexHash(CURL *curl,
+                                        const std::string &backendUrl) {
   CURLcode res;
   char errbuf[CURL_ERROR_SIZE];
   std::string response;
 
-  if (_curl) {
-    std::string url = _backendUrl + "/?cmd=get-index-id";
-    curl_easy_setopt(_curl, CURLOPT_URL, url.c_str());
-    curl_easy_setopt(_curl, CURLOPT_WRITEFUNCTION, GeomCache::writeCbString);
-    curl_easy_setopt(_curl, CURLOPT_WRITEDATA, &response);
-    curl_easy_setopt(_curl, CURLOPT_ERRORBUFFER, errbuf);
-    curl_easy_setopt(_curl, CURLOPT_SSL_VERIFYPEER, false);
-    curl_easy_setopt(_curl, CURLOPT_SSL_VERIFYHOST, false);
-    curl_easy_setopt(_curl, CURLOPT_HTTPHEADER, 0);
+  if (curl) {
+    std::string url = backendUrl + "/?cmd=get-index-id";
+    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, GeomCache::writeCbString);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
+    curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, errbuf);
+    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, false);
+    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, false);
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, 0);
 
     // accept any compression supported
-    curl_easy_setopt(_curl, CURLOPT_ACCEPT_ENCODING, "");
-    res = curl_easy_perform(_curl);
+    curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");
+    res = curl_easy_perform(curl);
 
     if (res != CURLE_OK) {
       size_t len = strlen(errbuf);
@@ -1197,7 +1791,7 @@ std::string GeomCache::requestIndexHash() {
     }
 
     long httpCode = 0;
-    curl_easy_getinfo(_curl, CURLINFO_RESPONSE_CODE, &httpCode);
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &httpCode);
 
     if (httpCode != 200) {
       LOG(WARN) << "QLever backend returned status code " << httpCode
@@ -1213,26 +1807,183 @@ std::string GeomCache::requestIndexHash() {
 }
 
 // _____________________________________________________________________________
-std::string GeomCache::load(const std::string &cacheDir) {
+std::string GeomCache::cacheFilePath(const std::string &cacheDir,
+                                     const std::string &backendUrl,
+                                     const std::string &indexHash) {
+  std::string name = util::trim(indexHash);
+
+  if (name.empty()) {
+    name = backendUrl;
+    util::replaceAll(name, "/", "_");
+    return cacheDir + "/" + name;
+  }
+
+  // the cache file is shared by all backends serving the same index
+  for (auto &c : name) {
+    if (!std::isalnum(static_cast<unsigned char>(c)) && c != '-' && c != '.') {
+      c = '_';
+    }
+  }
+  return cacheDir + "/index-" + name;
+}
+
+// _____________________________________________________________________________
+std::string GeomCache::shardName(size_t shard, size_t numShards) {
+  if (numShards < 2) return "";
+  return ".shard-" + std::to_string(shard) + "-of-" + std::to_string(numShards);
+}
+
+// _____________________________________________________________________________
+namespace {
+struct PeerTransfer {
+  std::ofstream f;
+  petrimaps::Checksum sum;
+  std::string expectedSum;
+  std::atomic<size_t> *received;
+  size_t *total;
+};
+
+// _____________________________________________________________________________
+size_t writeCbPeer(void *contents, size_t size, size_t nmemb, void *userp) {
+  auto t = static_cast<PeerTransfer *>(userp);
+  t->f.write(static_cast<const char *>(contents), size * nmemb);
+  t->sum.update(static_cast<const char *>(contents), size * nmemb);
+  *t->received += size * nmemb;
+  return t->f.good() ? size * nmemb : 0;
+}
+
+// _____________________________________________________________________________
+size_t headerCbPeer(char *buffer, size_t size, size_t nitems, void *userp) {
+  auto t = static_cast<PeerTransfer *>(userp);
+  std::string line(buffer, size * nitems);
+  size_t sep = line.find(':');
+  if (sep != std::string::npos) {
+    std::string key = util::toLower(line.substr(0, sep));
+    std::string val = util::trim(line.substr(sep + 1));
+    if (key == "x-petrimaps-checksum") t->expectedSum = val;
+    if (key == "content-length") *t->total = strtoull(val.c_str(), 0, 10);
+  }
+  return size * nitems;
+}
+}  // namespace
+
+// _____________________________________________________________________________
+bool GeomCache::fetchFromPeer(const std::string &peer,
+                              const std::string &indexHash,
+                              const std::string &fname) {
+  CURL *curl = curl_easy_init();
+  if (!curl) return false;
+
+  char *esc = curl_easy_escape(curl, indexHash.c_str(), indexHash.size());
+  std::string url = peer + "/cachefile?hash=" + esc;
+  curl_free(esc);
+  if (_numShards > 1) {
+    url += "&shard=" + std::to_string(_shard) +
+           "&numshards=" + std::to_string(_numShards);
+  }
+
+  LOG(INFO) << "[GEOMCACHE] Fetching cache file from peer " << url;
+
+  // like serializeToDisk(), only a complete and verified transfer replaces
+  // fname
+  std::string tmpName = fname + ".tmp" + std::to_string(getpid());
+
+  _loadStatusStage = _LoadStatusStages::FromPeer;
+  _curRow = 0;
+  _totalSize = 0;
+
+  PeerTransfer t;
+  t.f.open(tmpName, std::ios::binary);
+  t.received = &_curRow;
+  t.total = &_totalSize;
+
+  char errbuf[CURL_ERROR_SIZE];
+  errbuf[0] = 0;
+
+  curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeCbPeer);
+  curl_easy_setopt(curl, CURLOPT_WRITEDATA, &t);
+  curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, headerCbPeer);
+  curl_easy_setopt(curl, CURLOPT_HEADERDATA, &t);
+  curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, errbuf);
+  curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+  curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
+
+  // load() holds _m during the transfer, a stalled peer must not block it
+  curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, PEER_CONNECT_TIMEOUT);
+  curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, PEER_LOW_SPEED_LIMIT);
+  curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, PEER_LOW_SPEED_TIME);
+
+  CURLcode res = curl_easy_perform(curl);
+  curl_easy_cleanup(curl);
+  t.f.close();
+
+  std::string err;
+  if (res != CURLE_OK) {
+    err = strlen(errbuf) ? errbuf : curl_easy_strerror(res);
+  } else if (!t.f.good()) {
+    err = "could not write " + tmpName;
+  } else if (t.expectedSum.empty()) {
+    err = "no checksum sent";
+  } else if (t.expectedSum != t.sum.hex()) {
+    err = "checksum mismatch";
+  } else if (rename(tmpName.c_str(), fname.c_str()) != 0) {
+    err = "could not write " + fname;
+  }
+
+  if (err.size()) {
+    std::remove(tmpName.c_str());
+    LOG(WARN) << "[GEOMCACHE] Could not fetch cache file from " << peer
+              << ": " << err;
+    return false;
+  }
+
+  LOG(INFO) << "[GEOMCACHE] Fetched " << _curRow << " bytes from " << peer;
+  return true;
+}
+
+// _____________________________________________________________________________
+std::string GeomCache::load(const std::string &cacheDir,
+                            const std::string &indexHash) {
   std::lock_guard<std::mutex> guard(_m);
 
   if (_ready) {
-    auto indexHash = requestIndexHash();
     if (_indexHash == indexHash) return _indexHash;
     LOG(INFO) << "Loaded index hash (" << _indexHash
-              << ") and remote index hash (" << indexHash << ") dont match.";
+              << ") and current index hash (" << indexHash << ") dont match.";
     _ready = false;
   }
 
   if (cacheDir.size()) {
-    std::string backend = getBackendURL();
-    util::replaceAll(backend, "/", "_");
-    std::string cacheFile = cacheDir + "/" + backend;
-    auto indexHash = requestIndexHash();
-    if (access(cacheFile.c_str(), F_OK) != -1 &&
-        indexHash == indexHashFromDisk(cacheFile)) {
-      LOG(INFO) << "Reading from cache file " << cacheFile << "...";
-      fromDisk(cacheFile);
+    std::string cacheFile =
+        cacheFilePath(cacheDir, _backendUrl, indexHash) + shardName();
+
+    // caches of older versions are named after the backend URL
+    std::string legacyFile = cacheFile;
+    if (_numShards == 1) legacyFile = cacheFilePath(cacheDir, _backendUrl, "");
+
+    auto valid = [&indexHash, this](const std::string &fname) {
+      return access(fname.c_str(), F_OK) != -1 &&
+             indexHash == indexHashFromDisk(fname);
+    };
+
+    std::string readFile;
+    if (valid(cacheFile)) {
+      readFile = cacheFile;
+    } else if (valid(legacyFile)) {
+      readFile = legacyFile;
+    } else if (indexHash.size()) {
+      for (const auto &peer : _peers) {
+        if (fetchFromPeer(peer, indexHash, cacheFile) && valid(cacheFile)) {
+          readFile = cacheFile;
+          break;
+        }
+      }
+    }
+
+    if (readFile.size()) {
+      LOG(INFO) << "Reading from cache file " << readFile << "...";
+      fromDisk(readFile);
       LOG(INFO) << "done ...";
     } else {
       if (access(cacheDir.c_str(), W_OK) != 0) {
@@ -1240,21 +1991,21 @@ std::string GeomCache::load(const std::string &cacheDir) {
         ss << "No write access to cache dir " << cacheDir;
         throw std::runtime_error(ss.str());
       }
-      _indexHash = requestIndexHash();
+      _indexHash = indexHash;
       LOG(INFO) << "Index hash is '" << _indexHash << "'";
       request();
-      requestIds();
       LOG(INFO) << "Serializing to cache file " << cacheFile << "...";
       serializeToDisk(cacheFile);
       LOG(INFO) << "done ...";
     }
   } else {
-    _indexHash = requestIndexHash();
+    _indexHash = indexHash;
     LOG(INFO) << "Index hash is '" << _indexHash << "'";
     request();
-    requestIds();
   }
 
+  if (_packLines) packLines();
+
   _ready = true;
   return _indexHash;
 }
@@ -16,18 +16,25 @@
 #include <vector>
 
 #include "qlever-petrimaps/Misc.h"
+#include "qlever-petrimaps/PackedLines.h"
+#include "qlever-petrimaps/SpillVector.h"
 #include "util/geo/Geo.h"
 
 namespace petrimaps {
 
 class GeomCache {
  public:
-  GeomCache() : _backendUrl(""), _curl(0) {}
-  explicit GeomCache(const std::string& backendUrl)
-      : _backendUrl(backendUrl), _curl(curl_easy_init()) {}
+  GeomCache() : _backendUrl(""), _curl(0), _maxMemory(-1), _packLines(false) {}
+  GeomCache(const std::string& backendUrl, size_t maxMemory, bool packLines)
+      : _backendUrl(backendUrl),
+        _curl(curl_easy_init()),
+        _maxMemory(maxMemory),
+        _packLines(packLines) {}
 
   GeomCache& operator=(GeomCache&& o) {
     _backendUrl = o._backendUrl;
+    _maxMemory = o._maxMemory;
+    _packLines = o._packLines;
     _curl = curl_easy_init();
     _lines = std::move(o._lines);
     _linePoints = std::move(o._linePoints);
@@ -48,21 +55,62 @@ class GeomCache {
     return ready;
   }
 
-  std::string load(const std::string& cacheFile);
+  // load the cache of the index with hash indexHash, from the cache dir if
+  // possible. Returns immediately if the cache already holds this index
+  std::string load(const std::string& cacheDir, const std::string& indexHash);
+
+  // only valid once the cache is ready
+  const std::string& getIndexHash() const { return _indexHash; }
+
+  // the index hash reported by the backend at backendUrl, empty on failure
+  static std::string requestIndexHash(const std::string& backendUrl);
 
   void request();
   size_t requestSize();
-  void requestPart(size_t offset);
 
-  void requestIds();
+  // fill the cache from local dumps of the fill query's results: tsvFile
+  // holds the TSV result, idsFile the binary (application/octet-stream)
+  // result. The TSV dump is parsed in parallel.
+  void requestFromDumps(const std::string& tsvFile, const std::string& idsFile,
+                        const std::string& indexHash);
+
+  // only fill the rows [shard * n / numShards, (shard + 1) * n / numShards)
+  // of the n rows of the fill query
+  void setShard(size_t shard, size_t numShards) {
+    _shard = shard;
+    _numShards = numShards;
+  }
+
+  // suffix of the cache file name of this shard, empty if not sharded
+  std::string shardName() const { return shardName(_shard, _numShards); }
+  static std::string shardName(size_t shard, size_t numShards);
+
+  // petrimaps instances to fetch missing cache files from before filling
+  // the cache from the backend
+  void setPeers(const std::vector<std::string>& peers) { _peers = peers; }
+
+  // the query used to fill the cache
+  const std::string& getFillQuery() const { return getQuery(_backendUrl); }
+
+  // path of the cache file for indexHash in cacheDir. Caches of backends
+  // without an index hash are named after the backend URL
+  static std::string cacheFilePath(const std::string& cacheDir,
+                                   const std::string& backendUrl,
+                                   const std::string& indexHash);
+  bool requestPart(size_t offset);
 
   void parse(const char*, size_t size);
   void parseIds(const char*, size_t size);
   void parseCount(const char*, size_t size);
 
+  // join the (qid, row) pairs in ids with the cached geometries, returns
+  // (geom id, row) pairs and the number of joined rows. If hasQidIndex()
+  // is false, ids must be sorted by qid.
   std::pair<std::vector<std::pair<ID_TYPE, ID_TYPE>>, size_t> getRelObjects(
       const std::vector<IdMapping>& id) const;
 
+  bool hasQidIndex() const { return !_qidIndex.empty(); }
+
   const std::string& getBackendURL() const { return _backendUrl; }
 
   const std::vector<util::geo::FPoint>& getPoints() const { return _points; }
@@ -77,6 +125,11 @@ class GeomCache {
     return util::geo::getBoundingBox(_points[id]);
   }
   util::geo::DBox getLineBBox(size_t id) const;
+  bool isLineArea(size_t id) const;
+
+  // true if the lines are held in the packed line store
+  bool hasPackedLines() const { return _packedLines.size() > 0; }
+  const PackedLineStore& getPackedLines() const { return _packedLines; }
 
   void serializeToDisk(const std::string& fname) const;
 
@@ -97,15 +150,26 @@ class GeomCache {
  private:
   std::string _backendUrl;
   CURL* _curl;
+  size_t _maxMemory;
+  bool _packLines;
 
   uint8_t _curByte;
   ID _curId;
   QLEVER_ID_TYPE _maxQid;
   size_t _totalSize = 0;
+
+  size_t _shard = 0;
+  size_t _numShards = 1;
+
+  std::vector<std::string> _peers;
+
+  // first row of the fill query held by this shard
+  size_t _rowBegin = 0;
   std::atomic<size_t> _curRow;
   size_t _curUniqueGeom;
 
-  enum _LoadStatusStages { Parse = 1, ParseIds, FromFile };
+  // stage 4 is reported by the server while it builds a session
+  enum _LoadStatusStages { Parse = 1, ParseIds, FromFile, FromPeer = 5 };
   _LoadStatusStages _loadStatusStage = Parse;
 
   static size_t writeCb(void* contents, size_t size, size_t nmemb, void* userp);
@@ -120,7 +184,8 @@ class GeomCache {
   const std::string& getQuery(const std::string& backendUrl) const;
   std::string getCountQuery(const std::string& backendUrl) const;
 
-  std::string requestIndexHash();
+  static std::string requestIndexHash(CURL* curl,
+                                      const std::string& backendUrl);
 
   std::string queryUrl(std::string query, size_t offset, size_t limit) const;
 
@@ -133,28 +198,91 @@ class GeomCache {
 
   void insertLine(const util::geo::DLine& l, bool isArea);
 
+  // move the lines into the packed line store
+  void packLines();
+
   std::string indexHashFromDisk(const std::string& fname);
 
+  // fetch the cache file fname for indexHash from the petrimaps instance at
+  // peer, returns false if the peer does not have it or the transfer failed
+  bool fetchFromPeer(const std::string& peer, const std::string& indexHash,
+                     const std::string& fname);
+
+  // the WKT geometry pass
+  void requestGeoms();
+
+  // reset the fill state and buffers
+  void resetFill();
+
+  // move the fill buffers into the cache and build the qid mapping
+  void finishFill();
+
+  // the binary id pass, run concurrently to requestGeoms()
+  void requestIds();
+  bool requestIdsPart(size_t offset);
+
+  // assign the ids of the binary id pass to the geometries
+  void alignIds();
+
+  // save / restore the state of the geometry fill
+  void checkpoint();
+  void restoreCheckpoint();
+
+  // spill the fill buffers to disk if memory gets scarce
+  void spillIfNeeded();
+
+  void buildQidIndex();
+
+  std::pair<std::vector<std::pair<ID_TYPE, ID_TYPE>>, size_t>
+  getRelObjectsSorted(const std::vector<IdMapping>& id) const;
+  std::pair<std::vector<std::pair<ID_TYPE, ID_TYPE>>, size_t>
+  getRelObjectsDirect(const std::vector<IdMapping>& id) const;
+
   std::vector<util::geo::FPoint> _points;
   std::vector<util::geo::Point<int16_t>> _linePoints;
   std::vector<size_t> _lines;
 
-  size_t _pointsFSize;
-  size_t _linePointsFSize;
-  size_t _linesFSize;
-  size_t _qidToIdFSize;
+  PackedLineStore _packedLines;
 
-  std::fstream _pointsF;
-  std::fstream _linePointsF;
-  std::fstream _linesF;
-  std::fstream _qidToIdF;
+  // buffers for the geometry fill, moved into the vectors above afterwards
+  SpillVector<util::geo::FPoint> _pointsFill{"points"};
+  SpillVector<util::geo::Point<int16_t>> _linePointsFill{"linepoints"};
+  SpillVector<size_t> _linesFill{"lines"};
+  SpillVector<IdMapping> _qidToIdFill{"qidtoid"};
 
   size_t _geometryDuplicates = 0;
 
+  // state of the geometry fill after the last fully parsed row block
+  struct FillCheckpoint {
+    size_t row;
+    size_t numPoints;
+    size_t numLinePoints;
+    size_t numLines;
+    size_t numQidToId;
+    size_t curUniqueGeom;
+    size_t geometryDuplicates;
+    IdMapping lastQidToId;
+    std::string prev;
+  };
+
+  FillCheckpoint _checkpoint;
+
   IdMapping _lastQidToId;
 
+  // the qids of the binary id pass, one per result row
+  SpillVector<uint64_t> _rowQidsFill{"rowqids"};
+  std::atomic<bool> _cancelIds;
+  std::string _rawIds;
+  std::exception_ptr _idsExceptionPtr;
+
   std::vector<IdMapping> _qidToId;
 
+  // direct-address index into _qidToId: the entries for qid q are at
+  // [_qidIndex[q - _qidIndexMin], _qidIndex[q - _qidIndexMin + 1]). Empty
+  // if the qids are too sparse.
+  QLEVER_ID_TYPE _qidIndexMin = 0;
+  std::vector<ID_TYPE> _qidIndex;
+
   std::string _dangling, _prev, _raw;
   ParseState _state;
 
@@ -165,6 +293,55 @@ class GeomCache {
 
   std::string _indexHash;
 };
+
+// Streaming decoder for the vertices of a line of a GeomCache, independent of
+// how the lines are stored
+class LineReader {
+ public:
+  LineReader(const GeomCache& cache, size_t lid)
+      : _packed(cache.hasPackedLines()), _mainX(0), _mainY(0), _gi(0) {
+    if (_packed) {
+      _dec = PackedLineStore::Decoder(cache.getPackedLines(), lid);
+    } else {
+      _cur = &cache.getLinePoints()[0] + cache.getLine(lid);
+      _end = &cache.getLinePoints()[0] + cache.getLineEnd(lid);
+    }
+  }
+
+  // write the next vertex to p, returns false if there is none
+  bool next(util::geo::DPoint* p) {
+    if (_packed) return _dec.next(p);
+
+    while (_cur < _end) {
+      const auto& cur = *_cur++;
+
+      if (isMCoord(cur.getX())) {
+        _mainX = rmCoord(cur.getX());
+        _mainY = rmCoord(cur.getY());
+        continue;
+      }
+
+      // skip bounding box at beginning
+      if (++_gi < 3) continue;
+
+      p->setX((_mainX * M_COORD_GRANULARITY + cur.getX()) / 10.0);
+      p->setY((_mainY * M_COORD_GRANULARITY + cur.getY()) / 10.0);
+      return true;
+    }
+
+    return false;
+  }
+
+ private:
+  bool _packed;
+
+  PackedLineStore::Decoder _dec;
+
+  const util::geo::Point<int16_t>* _cur;
+  const util::geo::Point<int16_t>* _end;
+  double _mainX, _mainY;
+  size_t _gi;
+};
 }  // namespace petrimaps
 
 #endif  // PETRIMAPS_GEOMCACHE_H_
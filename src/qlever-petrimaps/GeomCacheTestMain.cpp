@@ -0,0 +1,285 @@
+// Copyright 2026, agent <agent@local>
+
+#include <arpa/inet.h>
+#include <curl/curl.h>
+#include <netinet/in.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "qlever-petrimaps/GeomCache.h"
+#include "qlever-petrimaps/TestUtil.h"
+
+using petrimaps::GeomCache;
+using petrimaps::test::check;
+using petrimaps::test::result;
+
+const static std::string WKT_TYPE =
+    "^^<http://www.opengis.net/ont/geosparql#wktLiteral>";
+
+// Stand-in QLever backend which answers the fill queries of a GeomCache
+// with the rows of a TSV dump and the ids of a binary id dump, respecting
+// LIMIT and OFFSET.
+class DumpBackend {
+ public:
+  DumpBackend(const std::vector<std::string>& rows,
+              const std::vector<uint64_t>& ids)
+      : _rows(rows), _ids(ids), _stop(false) {
+    _sock = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    socklen_t len = sizeof(addr);
+    if (_sock < 0 || bind(_sock, (sockaddr*)&addr, sizeof(addr)) != 0 ||
+        listen(_sock, 16) != 0 ||
+        getsockname(_sock, (sockaddr*)&addr, &len) != 0) {
+      throw std::runtime_error("Could not start the stand-in backend");
+    }
+    _port = ntohs(addr.sin_port);
+    _thread = std::thread(&DumpBackend::serve, this);
+  }
+
+  ~DumpBackend() {
+    _stop = true;
+    shutdown(_sock, SHUT_RDWR);
+    close(_sock);
+    _thread.join();
+  }
+
+  std::string url() const {
+    return "http://127.0.0.1:" + std::to_string(_port) + "/test";
+  }
+
+ private:
+  std::vector<std::string> _rows;
+  std::vector<uint64_t> _ids;
+  int _sock;
+  int _port;
+  std::atomic<bool> _stop;
+  std::thread _thread;
+
+  void serve() {
+    while (!_stop) {
+      int conn = accept(_sock, 0, 0);
+      if (conn < 0) continue;
+      std::thread([this, conn]() {
+        answer(conn);
+        close(conn);
+      }).detach();
+    }
+  }
+
+  void answer(int conn) const {
+    std::string req;
+    char buf[4096];
+    while (req.find("\r\n\r\n") == std::string::npos) {
+      ssize_t n = recv(conn, buf, sizeof(buf), 0);
+      if (n <= 0) return;
+      req.append(buf, n);
+    }
+
+    std::string query = urlDecode(param(req, "query="));
+    size_t limit = number(query, " LIMIT ");
+    size_t offset = number(query, " OFFSET ");
+
+    std::string body;
+    if (query.find("COUNT(") != std::string::npos) {
+      body = "?count\n" + std::to_string(_rows.size()) + "\n";
+    } else if (req.find("application/octet-stream") != std::string::npos) {
+      for (size_t i = offset; i < _ids.size() && i - offset < limit; i++) {
+        body.append(reinterpret_cast<const char*>(&_ids[i]), 8);
+      }
+    } else {
+      body = "?geometry\n";
+      for (size_t i = offset; i < _rows.size() && i - offset < limit; i++) {
+        body += _rows[i] + "\n";
+      }
+    }
+
+    std::string answer = "HTTP/1.1 200 OK\r\nContent-Length: " +
+                         std::to_string(body.size()) +
+                         "\r\nConnection: close\r\n\r\n" + body;
+    for (size_t sent = 0; sent < answer.size();) {
+      ssize_t n = send(conn, answer.data() + sent, answer.size() - sent,
+                       MSG_NOSIGNAL);
+      if (n <= 0) return;
+      sent += n;
+    }
+  }
+
+  static std::string param(const std::string& req, const std::string& key) {
+    size_t pos = req.find(key);
+    if (pos == std::string::npos) return "";
+    pos += key.size();
+    return req.substr(pos, req.find_first_of("& \r\n", pos) - pos);
+  }
+
+  static size_t number(const std::string& query, const std::string& key) {
+    size_t pos = query.rfind(key);
+    if (pos == std::string::npos) return 0;
+    return strtoull(query.c_str() + pos + key.size(), 0, 10);
+  }
+
+  static std::string urlDecode(const std::string& s) {
+    std::string ret;
+    for (size_t i = 0; i < s.size(); i++) {
+      if (s[i] == '%' && i + 2 < s.size()) {
+        ret += static_cast<char>(strtol(s.substr(i + 1, 2).c_str(), 0, 16));
+        i += 2;
+      } else {
+        ret += s[i] == '+' ? ' ' : s[i];
+      }
+    }
+    return ret;
+  }
+};
+
+// _____________________________________________________________________________
+std::string randomGeom(std::mt19937* rng) {
+  std::uniform_real_distribution<double> lng(-180, 180), lat(-80, 80);
+  std::uniform_int_distribution<int> type(0, 9), num(2, 6);
+
+  auto coords = [&](size_t n, bool closed) {
+    std::stringstream ss;
+    ss.precision(9);
+    double x0 = lng(*rng), y0 = lat(*rng);
+    ss << x0 << " " << y0;
+    for (size_t i = 1; i < n; i++) {
+      ss << "," << x0 + lng(*rng) / 100 << " " << y0 + lat(*rng) / 100;
+    }
+    if (closed) ss << "," << x0 << " " << y0;
+    return ss.str();
+  };
+
+  switch (type(*rng)) {
+    case 0:
+    case 1:
+    case 2:
+      return "\"POINT(" + coords(1, false) + ")\"" + WKT_TYPE;
+    case 3:
+      // the geometry type is matched case-insensitively
+      return "\"point(" + coords(1, false) + ")\"" + WKT_TYPE;
+    case 4:
+      return "\"LINESTRING(" + coords(num(*rng), false) + ")\"" + WKT_TYPE;
+    case 5:
+      return "\"MULTILINESTRING((" + coords(num(*rng), false) + "),(" +
+             coords(num(*rng), false) + "))\"" + WKT_TYPE;
+    case 6:
+      return "\"POLYGON((" + coords(num(*rng), true) + "))\"" + WKT_TYPE;
+    case 7:
+      return "\"MULTIPOLYGON(((" + coords(num(*rng), true) + ")),((" +
+             coords(num(*rng), true) + ")))\"" + WKT_TYPE;
+    case 8:
+      return "\"LINESTRING()\"" + WKT_TYPE;
+    default:
+      return "\"no geometry\"";
+  }
+}
+
+// _____________________________________________________________________________
+std::string readFile(const std::string& fname) {
+  std::ifstream f(fname, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(f),
+                     std::istreambuf_iterator<char>());
+}
+
+// _____________________________________________________________________________
+void testDumpsMatchBackend(const std::string& dir) {
+  // a small dump with runs of repeated geometries, which re-use the
+  // geometry of the previous row, and with repeated ids
+  std::mt19937 rng(11);
+  std::uniform_int_distribution<int> run(1, 40), step(0, 3);
+
+  std::vector<std::string> rows;
+  std::vector<uint64_t> ids;
+  uint64_t qid = 1000;
+  while (rows.size() < 20000) {
+    std::string geom = randomGeom(&rng);
+    for (size_t n = run(rng); n > 0; n--) {
+      rows.push_back(geom);
+      qid += step(rng);
+      ids.push_back(qid);
+    }
+  }
+
+  std::string tsvFile = dir + "/dump.tsv";
+  std::string idsFile = dir + "/dump.ids";
+
+  std::ofstream tsv(tsvFile, std::ios::binary);
+  tsv << "?geometry\n";
+  for (const auto& r : rows) tsv << r << "\n";
+  tsv.close();
+
+  std::ofstream idf(idsFile, std::ios::binary);
+  idf.write(reinterpret_cast<const char*>(ids.data()), ids.size() * 8);
+  idf.close();
+
+  DumpBackend backend(rows, ids);
+
+  for (size_t numShards : {1, 3}) {
+    for (size_t shard = 0; shard < numShards; shard++) {
+      std::string name = GeomCache::shardName(shard, numShards);
+
+      GeomCache fromBackend(backend.url(), -1, false);
+      fromBackend.setShard(shard, numShards);
+      fromBackend.load("", "hash");
+      fromBackend.serializeToDisk(dir + "/backend" + name);
+
+      GeomCache fromDumps(backend.url(), -1, false);
+      fromDumps.setShard(shard, numShards);
+      fromDumps.requestFromDumps(tsvFile, idsFile, "hash");
+      fromDumps.serializeToDisk(dir + "/dumps" + name);
+
+      std::string a = readFile(dir + "/backend" + name);
+      std::string b = readFile(dir + "/dumps" + name);
+      check(a.size() > 100 && a == b,
+            "cache built from dumps differs from the cache filled from the "
+            "backend (shard " +
+                std::to_string(shard) + " of " + std::to_string(numShards) +
+                ", " + std::to_string(a.size()) + " vs " +
+                std::to_string(b.size()) + " bytes)");
+
+      std::remove((dir + "/backend" + name).c_str());
+      std::remove((dir + "/dumps" + name).c_str());
+    }
+  }
+
+  std::remove(tsvFile.c_str());
+  std::remove(idsFile.c_str());
+}
+
+// _____________________________________________________________________________
+int main() {
+  curl_global_init(CURL_GLOBAL_DEFAULT);
+
+  char tmpl[] = "/tmp/petrimaps-test-XXXXXX";
+  if (!mkdtemp(tmpl)) {
+    std::cerr << "Could not create a temporary directory\n";
+    return 1;
+  }
+  std::string dir = tmpl;
+
+  try {
+    testDumpsMatchBackend(dir);
+  } catch (const std::exception& e) {
+    check(false, e.what());
+  }
+
+  rmdir(dir.c_str());
+
+  return result();
+}
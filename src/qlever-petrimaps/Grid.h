@@ -6,8 +6,10 @@
 #define PETRIMAPS_GRID_H_
 
 #include <map>
+#include <string>
 #include <unordered_set>
 #include <vector>
+#include "qlever-petrimaps/MmapVector.h"
 #include "util/geo/Geo.h"
 
 namespace petrimaps {
@@ -17,6 +19,23 @@ class GridException : public std::runtime_error {
   GridException(std::string const& msg) : std::runtime_error(msg) {}
 };
 
+// The values of a single grid cell
+template <typename V>
+class GridCell {
+ public:
+  GridCell(const V* begin, const V* end) : _begin(begin), _end(end) {}
+
+  const V* begin() const { return _begin; }
+  const V* end() const { return _end; }
+  size_t size() const { return _end - _begin; }
+
+  const V& operator[](size_t i) const { return _begin[i]; }
+
+ private:
+  const V* _begin;
+  const V* _end;
+};
+
 template <typename V, typename T>
 class Grid {
  public:
@@ -29,11 +48,17 @@ class Grid {
         _bb(o._bb),
         _xWidth(o._xWidth),
         _yHeight(o._yHeight),
-        _grid(o._grid) {
+        _grid(o._grid),
+        _compact(o._compact),
+        _counting(o._counting),
+        _cellEnds(std::move(o._cellEnds)),
+        _values(std::move(o._values)) {
     o._grid = 0;
   }
 
   Grid<V, T>& operator=(Grid<V, T>&& o) {
+    if (this == &o) return *this;
+    clear();
     _width = o._width;
     _height = o._height;
     _cellWidth = o._cellWidth;
@@ -42,6 +67,10 @@ class Grid {
     _xWidth = o._xWidth;
     _yHeight = o._yHeight;
     _grid = o._grid;
+    _compact = o._compact;
+    _counting = o._counting;
+    _cellEnds = std::move(o._cellEnds);
+    _values = std::move(o._values);
     o._grid = 0;
 
     return *this;
@@ -51,17 +80,19 @@ class Grid {
   // that covers the area of bounding box bbox
   Grid(double w, double h, const util::geo::Box<T>& bbox);
 
+  // initialization of a compact grid, which stores the values of all cells
+  // in a single array, backed by unlinked temporary files in directory dir.
+  // It is built in two passes over the values: first, add() only counts the
+  // values per cell. allocate() then reserves the array, and the second
+  // pass of add() calls, which must add the same values in the same order,
+  // stores them
+  Grid(double w, double h, const util::geo::Box<T>& bbox,
+       const std::string& dir);
+
   // the empty grid
   Grid();
 
-  ~Grid() {
-    if (!_grid) return;
-    for (size_t i = 0; i < _xWidth * _yHeight; i++) {
-      if (!_grid[i]) continue;
-      delete _grid[i];
-    }
-    delete[] _grid;
-  }
+  ~Grid() { clear(); }
 
   // add object t to this grid
   void add(const util::geo::Box<T>& box, const V& val);
@@ -72,7 +103,15 @@ class Grid {
   void get(size_t x, size_t y, std::unordered_set<V>* s) const;
   void get(const util::geo::Box<T>& btbox, std::vector<V>* s) const;
   void get(size_t x, size_t y, std::vector<V>* s) const;
-  const std::vector<V>* getCell(size_t x, size_t y) const;
+  GridCell<V> getCell(size_t x, size_t y) const;
+
+  // reorder the values of cell (x, y) such that the k-th value is the
+  // former order[k]-th one
+  void reorderCell(size_t x, size_t y, const std::vector<size_t>& order);
+
+  // end the counting pass of a compact grid
+  void allocate();
+  bool compact() const { return _compact; }
 
   size_t getXWidth() const;
   size_t getYHeight() const;
@@ -99,6 +138,16 @@ class Grid {
   size_t _yHeight;
 
   std::vector<V>** _grid;
+
+  // a compact grid stores the values of cell i at
+  // [_cellEnds[i - 1], _cellEnds[i]) in _values. While the values are
+  // added, _cellEnds[i] is the next free position of cell i
+  bool _compact;
+  bool _counting;
+  MmapVector<size_t> _cellEnds;
+  MmapVector<V> _values;
+
+  void clear();
 };
 
 #include "qlever-petrimaps/Grid.tpp"
@@ -11,12 +11,48 @@ Grid<V, T>::Grid()
       _cellHeight(0),
       _xWidth(0),
       _yHeight(0),
-      _grid(0) {}
+      _grid(0),
+      _compact(false),
+      _counting(false) {}
+
+// _____________________________________________________________________________
+template <typename V, typename T>
+Grid<V, T>::Grid(double w, double h, const util::geo::Box<T>& bbox,
+                 const std::string& dir)
+    : _cellWidth(fabs(w)),
+      _cellHeight(fabs(h)),
+      _bb(bbox),
+      _grid(0),
+      _compact(true),
+      _counting(true),
+      _cellEnds(dir),
+      _values(dir) {
+  _width = bbox.getUpperRight().getX() - bbox.getLowerLeft().getX();
+  _height = bbox.getUpperRight().getY() - bbox.getLowerLeft().getY();
+
+  if (_width < 0 || _height < 0) {
+    _width = 0;
+    _height = 0;
+    _xWidth = 0;
+    _yHeight = 0;
+    return;
+  }
+
+  _xWidth = ceil(_width / _cellWidth);
+  _yHeight = ceil(_height / _cellHeight);
+
+  _cellEnds.resize(_xWidth * _yHeight, 0);
+}
 
 // _____________________________________________________________________________
 template <typename V, typename T>
 Grid<V, T>::Grid(double w, double h, const util::geo::Box<T>& bbox)
-    : _cellWidth(fabs(w)), _cellHeight(fabs(h)), _bb(bbox), _grid() {
+    : _cellWidth(fabs(w)),
+      _cellHeight(fabs(h)),
+      _bb(bbox),
+      _grid(),
+      _compact(false),
+      _counting(false) {
   _width = bbox.getUpperRight().getX() - bbox.getLowerLeft().getX();
   _height = bbox.getUpperRight().getY() - bbox.getLowerLeft().getY();
 
@@ -62,6 +98,14 @@ void Grid<V, T>::add(const util::geo::Box<T>& box, const V& val) {
 template <typename V, typename T>
 void Grid<V, T>::add(size_t x, size_t y, V val) {
   if (x >= _xWidth || y >= _yHeight) return;
+  if (_compact) {
+    if (_counting) {
+      _cellEnds[y * _xWidth + x]++;
+    } else {
+      _values[_cellEnds[y * _xWidth + x]++] = val;
+    }
+    return;
+  }
   if (!_grid[y * _xWidth + x]) _grid[y * _xWidth + x] = new std::vector<V>();
   _grid[y * _xWidth + x]->push_back(val);
 }
@@ -97,21 +141,77 @@ void Grid<V, T>::get(const util::geo::Box<T>& box,
 // _____________________________________________________________________________
 template <typename V, typename T>
 void Grid<V, T>::get(size_t x, size_t y, std::unordered_set<V>* s) const {
-  if (!_grid[y * _xWidth + x]) return;
-  s->insert(_grid[y * _xWidth + x]->begin(), _grid[y * _xWidth + x]->end());
+  auto cell = getCell(x, y);
+  s->insert(cell.begin(), cell.end());
 }
 
 // _____________________________________________________________________________
 template <typename V, typename T>
 void Grid<V, T>::get(size_t x, size_t y, std::vector<V>* s) const {
-  if (!_grid[y * _xWidth + x]) return;
-  s->insert(s->end(), _grid[y * _xWidth + x]->begin(), _grid[y * _xWidth + x]->end());
+  auto cell = getCell(x, y);
+  s->insert(s->end(), cell.begin(), cell.end());
+}
+
+// _____________________________________________________________________________
+template <typename V, typename T>
+GridCell<V> Grid<V, T>::getCell(size_t x, size_t y) const {
+  size_t i = y * _xWidth + x;
+  if (_compact) {
+    const V* values = _values.begin();
+    return GridCell<V>(values + (i ? _cellEnds[i - 1] : 0),
+                       values + _cellEnds[i]);
+  }
+  if (!_grid[i]) return GridCell<V>(0, 0);
+  return GridCell<V>(_grid[i]->data(), _grid[i]->data() + _grid[i]->size());
 }
 
 // _____________________________________________________________________________
 template <typename V, typename T>
-const std::vector<V>* Grid<V, T>::getCell(size_t x, size_t y) const {
-  return _grid[y * _xWidth + x];
+void Grid<V, T>::reorderCell(size_t x, size_t y,
+                             const std::vector<size_t>& order) {
+  if (order.empty()) return;
+
+  size_t i = y * _xWidth + x;
+  V* values;
+  if (_compact) {
+    values = &_values[i ? _cellEnds[i - 1] : 0];
+  } else {
+    if (!_grid[i]) return;
+    values = _grid[i]->data();
+  }
+
+  std::vector<V> old(values, values + order.size());
+  for (size_t k = 0; k < order.size(); k++) values[k] = old[order[k]];
+}
+
+// _____________________________________________________________________________
+template <typename V, typename T>
+void Grid<V, T>::allocate() {
+  if (!_compact || !_counting) return;
+
+  // the counts become the start positions of the cells, which add() moves
+  // to their ends
+  size_t total = 0;
+  for (size_t i = 0; i < _cellEnds.size(); i++) {
+    size_t count = _cellEnds[i];
+    _cellEnds[i] = total;
+    total += count;
+  }
+
+  _values.resize(total, V());
+  _counting = false;
+}
+
+// _____________________________________________________________________________
+template <typename V, typename T>
+void Grid<V, T>::clear() {
+  if (!_grid) return;
+  for (size_t i = 0; i < _xWidth * _yHeight; i++) {
+    if (!_grid[i]) continue;
+    delete _grid[i];
+  }
+  delete[] _grid;
+  _grid = 0;
 }
 
 // _____________________________________________________________________________
@@ -0,0 +1,83 @@
+// Copyright 2026, agent <agent@local>
+
+#ifndef PETRIMAPS_HIERGRID_H_
+#define PETRIMAPS_HIERGRID_H_
+
+#include <string>
+#include <vector>
+#include "qlever-petrimaps/Grid.h"
+#include "util/geo/Geo.h"
+
+namespace petrimaps {
+
+// A loose, hierarchical grid. Level 0 has cells of the base cell size, each
+// following level doubles the cell size. Every value is stored exactly once,
+// in the cell of the finest level whose cell size is at least the extent
+// of the value's bounding box, chosen by the center of the bounding box.
+// Because cells are "loose" (a value may overlap its cell by half a cell
+// size in each direction), queries expand the query box per level.
+//
+// In contrast to Grid, large objects are not added to every cell they touch,
+// and get() never returns duplicates.
+template <typename V, typename T>
+class HierGrid {
+ public:
+  HierGrid(const HierGrid<V, T>&) = delete;
+  HierGrid(HierGrid<V, T>&& o)
+      : _cellSize(o._cellSize), _bb(o._bb), _levels(std::move(o._levels)) {}
+
+  HierGrid<V, T>& operator=(HierGrid<V, T>&& o) {
+    _cellSize = o._cellSize;
+    _bb = o._bb;
+    _levels = std::move(o._levels);
+    return *this;
+  };
+
+  // initialization of a hierarchical grid with base cell size cellSize that
+  // covers the area of bounding box bbox
+  HierGrid(double cellSize, const util::geo::Box<T>& bbox);
+
+  // initialization of a hierarchical grid of compact levels, backed by
+  // files in dir, see Grid
+  HierGrid(double cellSize, const util::geo::Box<T>& bbox,
+           const std::string& dir);
+
+  // the empty grid
+  HierGrid();
+
+  // add object t to this grid
+  void add(const util::geo::Box<T>& box, const V& val);
+
+  void get(const util::geo::Box<T>& btbox, std::vector<V>* s) const;
+
+  // end the counting pass of all compact levels
+  void allocate();
+  bool compact() const { return _levels.size() && _levels[0].compact(); }
+
+  size_t getNumLevels() const { return _levels.size(); }
+  const Grid<V, T>& getLevel(size_t l) const { return _levels[l]; }
+
+  double getCellWidth() const { return _cellSize; }
+  double getCellHeight() const { return _cellSize; }
+
+  util::geo::Box<T> getBBox() const { return _bb; }
+
+  // estimated number of cells of a hierarchical grid with base cell size
+  // cellSize covering bbox
+  static double estimateCells(double cellSize, const util::geo::Box<T>& bbox);
+
+ private:
+  double _cellSize;
+
+  util::geo::Box<T> _bb;
+
+  std::vector<Grid<V, T>> _levels;
+
+  void init(const std::string& dir);
+};
+
+#include "qlever-petrimaps/HierGrid.tpp"
+
+}  // namespace petrimaps
+
+#endif  // PETRIMAPS_HIERGRID_H_
@@ -0,0 +1,105 @@
+// Copyright 2026, agent <agent@local>
+
+// _____________________________________________________________________________
+template <typename V, typename T>
+HierGrid<V, T>::HierGrid() : _cellSize(0) {}
+
+// _____________________________________________________________________________
+template <typename V, typename T>
+HierGrid<V, T>::HierGrid(double cellSize, const util::geo::Box<T>& bbox)
+    : _cellSize(fabs(cellSize)), _bb(bbox) {
+  init("");
+}
+
+// _____________________________________________________________________________
+template <typename V, typename T>
+HierGrid<V, T>::HierGrid(double cellSize, const util::geo::Box<T>& bbox,
+                         const std::string& dir)
+    : _cellSize(fabs(cellSize)), _bb(bbox) {
+  init(dir);
+}
+
+// _____________________________________________________________________________
+template <typename V, typename T>
+void HierGrid<V, T>::init(const std::string& dir) {
+  double w = _bb.getUpperRight().getX() - _bb.getLowerLeft().getX();
+  double h = _bb.getUpperRight().getY() - _bb.getLowerLeft().getY();
+
+  if (w < 0 || h < 0 || _cellSize == 0) return;
+
+  // the coarsest level consists of a single cell covering the entire bbox
+  size_t numLevels = 1;
+  double size = _cellSize;
+  while (size < w || size < h) {
+    size *= 2;
+    numLevels++;
+  }
+
+  _levels.reserve(numLevels);
+  size = _cellSize;
+  for (size_t l = 0; l < numLevels; l++) {
+    if (dir.empty()) {
+      _levels.push_back(Grid<V, T>(size, size, _bb));
+    } else {
+      _levels.push_back(Grid<V, T>(size, size, _bb, dir));
+    }
+    size *= 2;
+  }
+}
+
+// _____________________________________________________________________________
+template <typename V, typename T>
+void HierGrid<V, T>::add(const util::geo::Box<T>& box, const V& val) {
+  if (_levels.size() == 0) return;
+
+  double w = box.getUpperRight().getX() - box.getLowerLeft().getX();
+  double h = box.getUpperRight().getY() - box.getLowerLeft().getY();
+  double ext = std::max(w, h);
+
+  size_t l = 0;
+  double size = _cellSize;
+  while (size < ext && l + 1 < _levels.size()) {
+    size *= 2;
+    l++;
+  }
+
+  util::geo::Point<T> center(
+      (box.getLowerLeft().getX() + box.getUpperRight().getX()) / 2,
+      (box.getLowerLeft().getY() + box.getUpperRight().getY()) / 2);
+
+  _levels[l].add(center, val);
+}
+
+// _____________________________________________________________________________
+template <typename V, typename T>
+void HierGrid<V, T>::get(const util::geo::Box<T>& box,
+                         std::vector<V>* s) const {
+  for (const auto& level : _levels) {
+    // values may overlap their cell by half a cell size in each direction
+    double pad = level.getCellWidth() / 2;
+    util::geo::Box<T> qbox(
+        {box.getLowerLeft().getX() - pad, box.getLowerLeft().getY() - pad},
+        {box.getUpperRight().getX() + pad, box.getUpperRight().getY() + pad});
+
+    if (!util::geo::intersects(qbox, _bb)) continue;
+    level.get(qbox, s);
+  }
+}
+
+// _____________________________________________________________________________
+template <typename V, typename T>
+void HierGrid<V, T>::allocate() {
+  for (auto& level : _levels) level.allocate();
+}
+
+// _____________________________________________________________________________
+template <typename V, typename T>
+double HierGrid<V, T>::estimateCells(double cellSize,
+                                     const util::geo::Box<T>& bbox) {
+  double w = bbox.getUpperRight().getX() - bbox.getLowerLeft().getX();
+  double h = bbox.getUpperRight().getY() - bbox.getLowerLeft().getY();
+  if (w < 0 || h < 0) return 0;
+
+  // each level has a quarter of the cells of the previous one
+  return fmax(1, ceil(w / cellSize)) * fmax(1, ceil(h / cellSize)) * 4.0 / 3.0;
+}
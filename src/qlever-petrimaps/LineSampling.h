@@ -0,0 +1,28 @@
+// Copyright 2026, agent <agent@local>
+
+#ifndef PETRIMAPS_LINESAMPLING_H_
+#define PETRIMAPS_LINESAMPLING_H_
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "util/geo/Geo.h"
+
+namespace petrimaps {
+
+// Walk the cells of a grid of square cells of size cellSize, with the lower
+// left corner at (llX, llY), that are crossed by the segment a-b, and call
+// f(x, y) with the middle of the part of the segment inside each of them.
+// The cells of a and b are skipped, they are covered by the vertices
+// themselves. Cells the segment only touches in a single point, e.g. at a
+// corner, are not crossed.
+template <typename F>
+void sampleSegment(const util::geo::DPoint& a, const util::geo::DPoint& b,
+                   double llX, double llY, double cellSize, F f);
+
+#include "qlever-petrimaps/LineSampling.tpp"
+
+}  // namespace petrimaps
+
+#endif  // PETRIMAPS_LINESAMPLING_H_
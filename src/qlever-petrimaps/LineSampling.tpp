@@ -0,0 +1,49 @@
+// Copyright 2026, agent <agent@local>
+
+// _____________________________________________________________________________
+template <typename F>
+void sampleSegment(const util::geo::DPoint& a, const util::geo::DPoint& b,
+                   double llX, double llY, double cellSize, F f) {
+  // positions in cell units, t is the position on the segment
+  double ux = (a.getX() - llX) / cellSize;
+  double uy = (a.getY() - llY) / cellSize;
+  double vx = (b.getX() - llX) / cellSize;
+  double vy = (b.getY() - llY) / cellSize;
+  double dx = vx - ux;
+  double dy = vy - uy;
+
+  double aX = std::floor(ux), aY = std::floor(uy);
+  double bX = std::floor(vx), bY = std::floor(vy);
+
+  double inf = std::numeric_limits<double>::infinity();
+  double tDeltaX = dx != 0 ? std::fabs(1 / dx) : inf;
+  double tDeltaY = dy != 0 ? std::fabs(1 / dy) : inf;
+  double tMaxX = dx > 0 ? (aX + 1 - ux) / dx : dx < 0 ? (aX - ux) / dx : inf;
+  double tMaxY = dy > 0 ? (aY + 1 - uy) / dy : dy < 0 ? (aY - uy) / dy : inf;
+
+  double tEnter = 0;
+  while (tEnter < 1) {
+    double tExit = std::min(1.0, std::min(tMaxX, tMaxY));
+
+    // parts of length 0 are skipped, they occur if a starts on a cell
+    // border and the segment leaves the cell of a right away
+    if (tExit > tEnter) {
+      double t = (tEnter + tExit) / 2;
+      double cX = std::floor(ux + t * dx), cY = std::floor(uy + t * dy);
+
+      if ((cX != aX || cY != aY) && (cX != bX || cY != bY)) {
+        f(a.getX() + t * (b.getX() - a.getX()),
+          a.getY() + t * (b.getY() - a.getY()));
+      }
+    }
+
+    // through a corner, both coordinates change at once. Advancing only
+    // one of them would yield a part of length 0 in a cell the segment
+    // only touches
+    bool stepX = tMaxX <= tMaxY;
+    bool stepY = tMaxY <= tMaxX;
+    if (stepX) tMaxX += tDeltaX;
+    if (stepY) tMaxY += tDeltaY;
+    tEnter = tExit;
+  }
+}
@@ -0,0 +1,246 @@
+// Copyright 2026, agent <agent@local>
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "qlever-petrimaps/LineSampling.h"
+#include "qlever-petrimaps/TestUtil.h"
+#include "util/geo/Geo.h"
+
+using petrimaps::sampleSegment;
+using petrimaps::test::check;
+using petrimaps::test::result;
+using util::geo::DPoint;
+
+typedef std::pair<int64_t, int64_t> Cell;
+
+const static double LL_X = -1000;
+const static double LL_Y = 250;
+const static double CELL_SIZE = 600;
+
+// distance of the points of the densified lines the line cache used to store
+const static double DENSIFY_DIST = 600;
+
+// _____________________________________________________________________________
+DPoint at(double cx, double cy) {
+  // point at position (cx, cy) of the grid, in cell units
+  return DPoint(LL_X + cx * CELL_SIZE, LL_Y + cy * CELL_SIZE);
+}
+
+// _____________________________________________________________________________
+Cell cellOf(double x, double y) {
+  return {static_cast<int64_t>(std::floor((x - LL_X) / CELL_SIZE)),
+          static_cast<int64_t>(std::floor((y - LL_Y) / CELL_SIZE))};
+}
+
+// _____________________________________________________________________________
+std::string segment(const DPoint& a, const DPoint& b) {
+  std::stringstream ss;
+  ss.precision(17);
+  ss << "(" << a.getX() << ", " << a.getY() << ") - (" << b.getX() << ", "
+     << b.getY() << ")";
+  return ss.str();
+}
+
+// _____________________________________________________________________________
+void checkSegment(const DPoint& a, const DPoint& b, size_t crossed) {
+  // the segment a-b crosses crossed cells, including the cells of a and b.
+  // There must be one sample in each of the cells in between
+  std::vector<DPoint> samples;
+  sampleSegment(a, b, LL_X, LL_Y, CELL_SIZE,
+                [&](double x, double y) { samples.push_back(DPoint(x, y)); });
+
+  size_t expected = crossed > 2 ? crossed - 2 : 0;
+  check(samples.size() == expected,
+        "got " + std::to_string(samples.size()) + " samples instead of " +
+            std::to_string(expected) + " for " + segment(a, b));
+
+  std::set<Cell> cells;
+  cells.insert(cellOf(a.getX(), a.getY()));
+  cells.insert(cellOf(b.getX(), b.getY()));
+  size_t endCells = cells.size();
+
+  for (const auto& p : samples) cells.insert(cellOf(p.getX(), p.getY()));
+  check(cells.size() == endCells + samples.size(),
+        "samples are not in distinct inner cells for " + segment(a, b));
+
+  // samples lie on the segment, strictly between a and b
+  double dx = b.getX() - a.getX(), dy = b.getY() - a.getY();
+  double len2 = dx * dx + dy * dy;
+  for (const auto& p : samples) {
+    double px = p.getX() - a.getX(), py = p.getY() - a.getY();
+    double t = (px * dx + py * dy) / len2;
+    double cross = px * dy - py * dx;
+    check(t > 0 && t < 1 && std::fabs(cross) < 1e-9 * len2,
+          "sample not inside " + segment(a, b));
+  }
+}
+
+// _____________________________________________________________________________
+void testAxisParallel() {
+  checkSegment(at(0.5, 0.5), at(10.5, 0.5), 11);
+  checkSegment(at(10.5, 0.5), at(0.5, 0.5), 11);
+  checkSegment(at(0.5, 0.5), at(0.5, 7.5), 8);
+  checkSegment(at(0.5, 7.5), at(0.5, -2.5), 11);
+
+  // on a grid line, the segment lies in the cells above it
+  checkSegment(at(0.5, 3), at(6.5, 3), 7);
+  checkSegment(at(2, 0.5), at(2, 4.5), 5);
+
+  // from and to cell borders
+  checkSegment(at(0, 0.5), at(5, 0.5), 6);
+  checkSegment(at(5, 0.5), at(0, 0.5), 6);
+  checkSegment(at(3, 1), at(3, -2), 4);
+}
+
+// _____________________________________________________________________________
+void testCorners() {
+  // diagonals through exact cell corners only cross the cells on the
+  // diagonal, not the ones touched at the corners
+  checkSegment(at(0.5, 0.5), at(5.5, 5.5), 6);
+  checkSegment(at(5.5, 5.5), at(0.5, 0.5), 6);
+  checkSegment(at(0.5, 5.5), at(5.5, 0.5), 6);
+  checkSegment(at(5.5, 0.5), at(0.5, 5.5), 6);
+  checkSegment(at(0.25, 0.25), at(3.75, 3.75), 4);
+
+  // through a single corner
+  checkSegment(at(0.5, 0.5), at(1.5, 1.5), 2);
+  checkSegment(at(0.5, 0.5), at(2.5, 2.5), 3);
+
+  // slope 2, through the corner at (1, 2)
+  checkSegment(at(0.5, 1), at(1.5, 3), 3);
+}
+
+// _____________________________________________________________________________
+void testSingleCell() {
+  checkSegment(at(0.1, 0.1), at(0.9, 0.8), 1);
+  checkSegment(at(0.9, 0.8), at(0.1, 0.1), 1);
+  checkSegment(at(3.5, 3.5), at(3.5, 3.5), 1);
+  checkSegment(at(-2.5, 4.2), at(-2.1, 4.9), 1);
+
+  // neighboring cells
+  checkSegment(at(0.5, 0.5), at(1.5, 0.5), 2);
+  checkSegment(at(0.5, 0.5), at(1.5, 1.2), 3);
+}
+
+// _____________________________________________________________________________
+void testRandom() {
+  // in general position, a segment crosses one cell per crossed grid line
+  std::mt19937 rng(5);
+  std::uniform_real_distribution<double> d(-40, 40);
+  for (size_t i = 0; i < 10000; i++) {
+    DPoint a = at(d(rng), d(rng));
+    DPoint b = at(d(rng), d(rng));
+    Cell ca = cellOf(a.getX(), a.getY());
+    Cell cb = cellOf(b.getX(), b.getY());
+    size_t crossed = std::llabs(cb.first - ca.first) +
+                     std::llabs(cb.second - ca.second) + 1;
+    checkSegment(a, b, crossed);
+  }
+}
+
+// _____________________________________________________________________________
+std::vector<DPoint> densify(const std::vector<DPoint>& line, double d) {
+  // the densification the line cache used to store, a point every d along
+  // each segment
+  std::vector<DPoint> ret;
+  if (line.empty()) return ret;
+  ret.push_back(line[0]);
+  for (size_t i = 1; i < line.size(); i++) {
+    double dx = line[i].getX() - line[i - 1].getX();
+    double dy = line[i].getY() - line[i - 1].getY();
+    double len = std::sqrt(dx * dx + dy * dy);
+    for (double cur = d; cur < len; cur += d) {
+      ret.push_back(DPoint(line[i - 1].getX() + dx / len * cur,
+                           line[i - 1].getY() + dy / len * cur));
+    }
+    ret.push_back(line[i]);
+  }
+  return ret;
+}
+
+// _____________________________________________________________________________
+size_t subCells(const std::vector<DPoint>& line, double subSize, bool sample) {
+  // number of points added to the line point grid for line with sub cells
+  // of size subSize, either from the densified line or by sampling its
+  // segments, dropping consecutive points in the same sub cell like the
+  // grid builder does
+  size_t n = 0;
+  bool first = true;
+  Cell last;
+  auto add = [&](double x, double y) {
+    Cell c(static_cast<int64_t>(std::floor((x - LL_X) / subSize)),
+           static_cast<int64_t>(std::floor((y - LL_Y) / subSize)));
+    if (first || c != last) n++;
+    last = c;
+    first = false;
+  };
+
+  if (!sample) {
+    for (const auto& p : densify(line, DENSIFY_DIST)) add(p.getX(), p.getY());
+    return n;
+  }
+
+  add(line[0].getX(), line[0].getY());
+  for (size_t i = 1; i < line.size(); i++) {
+    sampleSegment(line[i - 1], line[i], LL_X, LL_Y, DENSIFY_DIST, add);
+    add(line[i].getX(), line[i].getY());
+  }
+  return n;
+}
+
+// _____________________________________________________________________________
+void testDensity() {
+  // sampling the segments must yield about as many sub cells as the old
+  // densification, for sub cells smaller and larger than the sample
+  // distance. Per crossed square of size DENSIFY_DIST, a segment with
+  // direction (dx, dy) gets (|dx| + |dy|) / len samples per DENSIFY_DIST,
+  // between 1 and sqrt(2) times as many as the densification
+  std::mt19937 rng(7);
+  std::uniform_real_distribution<double> pos(-2e6, 2e6);
+  std::uniform_real_distribution<double> step(-5e4, 5e4);
+
+  std::vector<std::vector<DPoint>> lines;
+  for (size_t i = 0; i < 500; i++) {
+    std::vector<DPoint> line{DPoint(pos(rng), pos(rng))};
+    for (size_t j = 0; j < 8; j++) {
+      line.push_back(DPoint(line.back().getX() + step(rng),
+                            line.back().getY() + step(rng)));
+    }
+    lines.push_back(line);
+  }
+
+  // sub cells of the smallest, the default and the largest grid cells
+  for (double subSize : {4.0, 256.0, 600.0, 4096.0, 65536.0}) {
+    double old = 0, cur = 0;
+    for (const auto& line : lines) {
+      old += subCells(line, subSize, false);
+      cur += subCells(line, subSize, true);
+    }
+    double ratio = cur / old;
+    check(ratio > 0.9 && ratio < std::sqrt(2.0),
+          "sampled lines have " + std::to_string(ratio) +
+              " times the sub cells of the densified lines for sub cells of "
+              "size " + std::to_string(subSize));
+    std::cout << "sub cell size " << subSize << ": " << ratio
+              << " times the sub cells of the densified lines\n";
+  }
+}
+
+// _____________________________________________________________________________
+int main() {
+  testAxisParallel();
+  testCorners();
+  testSingleCell();
+  testRandom();
+  testDensity();
+
+  return result();
+}
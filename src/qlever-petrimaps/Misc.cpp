@@ -3,8 +3,10 @@
 // Authors: Patrick Brosi <brosi@informatik.uni-freiburg.de>
 
 #include <stdint.h>
+#include <unistd.h>
 
 #include <cstring>
+#include <fstream>
 #include <string>
 #include <vector>
 
@@ -13,6 +15,14 @@
 
 using petrimaps::RequestReader;
 
+// _____________________________________________________________________________
+size_t petrimaps::getAnonRSS() {
+  std::ifstream f("/proc/self/statm");
+  size_t size, resident, shared;
+  if (!(f >> size >> resident >> shared)) return util::getCurrentRSS();
+  return (resident - shared) * sysconf(_SC_PAGESIZE);
+}
+
 // _____________________________________________________________________________
 std::vector<std::string> RequestReader::requestColumns(const std::string& query) {
   CURLcode res;
@@ -252,7 +262,7 @@ size_t RequestReader::writeCbIds(void* contents, size_t size, size_t nmemb,
 // _____________________________________________________________________________
 void RequestReader::parseIds(const char* c, size_t size) {
   // TODO: just a rough approximation
-  checkMem(size, _maxMemory);
+  if (!idRunCb) checkMem(size, _maxMemory);
 
   for (size_t i = 0; i < size; i++) {
     if (_raw.size() < 10000) _raw.push_back(c[i]);
@@ -260,7 +270,8 @@ void RequestReader::parseIds(const char* c, size_t size) {
     _curByte = (_curByte + 1) % 8;
 
     if (_curByte == 0) {
-      _ids.push_back({_curId.val, _ids.size()});
+      _ids.push_back({_curId.val, _numIds++});
+      if (idRunCb && _ids.size() % idRunSize == 0) idRunCb(&_ids);
     }
   }
 }
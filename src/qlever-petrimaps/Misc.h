@@ -5,6 +5,7 @@
 #include <curl/curl.h>
 #include <stdint.h>
 
+#include <functional>
 #include <sstream>
 #include <stdexcept>
 #include <string>
@@ -78,8 +79,12 @@ class OutOfMemoryError : public std::exception {
   std::string _msg;
 };
 
+// resident memory of this process without file-backed pages, which the
+// kernel can write back and evict instead of running out of memory
+size_t getAnonRSS();
+
 inline void checkMem(size_t want, size_t max) {
-  size_t currentSize = util::getCurrentRSS();
+  size_t currentSize = getAnonRSS();
 
   if (currentSize + want > max) {
     throw OutOfMemoryError(want, currentSize, max);
@@ -128,7 +133,15 @@ struct RequestReader {
   ID _curId;
   size_t _received = 0;
   std::vector<IdMapping> _ids;
+  size_t _numIds = 0;
   size_t _maxMemory;
+
+  // if set, called whenever _ids holds a multiple of idRunSize ids, instead
+  // of checking the memory limit. The callback may take the ids out of the
+  // vector
+  std::function<void(std::vector<IdMapping>*)> idRunCb;
+  size_t idRunSize = 0;
+
   std::exception_ptr exceptionPtr;
 };
 
@@ -0,0 +1,76 @@
+// Copyright 2026, agent <agent@local>
+
+#ifndef PETRIMAPS_MMAPVECTOR_H_
+#define PETRIMAPS_MMAPVECTOR_H_
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace petrimaps {
+
+// Append-only array of trivially copyable values in a memory mapping. If a
+// directory is given, the mapping is backed by an (immediately unlinked)
+// temporary file in it, so the kernel can write its pages back and evict
+// them under memory pressure. Without a directory, the values are held in
+// anonymous memory.
+template <typename T>
+class MmapVector {
+ public:
+  MmapVector() : MmapVector("") {}
+  explicit MmapVector(const std::string& dir);
+
+  MmapVector(const MmapVector<T>&) = delete;
+  MmapVector(MmapVector<T>&& o);
+  MmapVector<T>& operator=(MmapVector<T>&& o);
+
+  ~MmapVector();
+
+  void push_back(const T& val) {
+    if (_size == _capacity) grow(_capacity ? _capacity * 2 : 1024);
+    _data[_size++] = val;
+  }
+
+  const T& operator[](size_t i) const { return _data[i]; }
+  T& operator[](size_t i) { return _data[i]; }
+
+  const T& back() const { return _data[_size - 1]; }
+
+  const T* begin() const { return _data; }
+  const T* end() const { return _data + _size; }
+
+  size_t size() const { return _size; }
+  bool empty() const { return _size == 0; }
+
+  void reserve(size_t n) {
+    if (n > _capacity) grow(n);
+  }
+
+  void resize(size_t n, const T& val);
+
+  // number of bytes held in anonymous memory
+  size_t memUsage() const;
+
+  bool fileBacked() const { return !_dir.empty(); }
+
+ private:
+  std::string _dir;
+  int _fd;
+  T* _data;
+  size_t _size;
+  size_t _capacity;
+
+  void grow(size_t capacity);
+  void release();
+};
+
+#include "qlever-petrimaps/MmapVector.tpp"
+
+}  // namespace petrimaps
+
+#endif  // PETRIMAPS_MMAPVECTOR_H_
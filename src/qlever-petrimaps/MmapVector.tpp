@@ -0,0 +1,112 @@
+// Copyright 2026, agent <agent@local>
+
+// _____________________________________________________________________________
+template <typename T>
+MmapVector<T>::MmapVector(const std::string& dir)
+    : _dir(dir), _fd(-1), _data(0), _size(0), _capacity(0) {}
+
+// _____________________________________________________________________________
+template <typename T>
+MmapVector<T>::MmapVector(MmapVector<T>&& o)
+    : _dir(o._dir),
+      _fd(o._fd),
+      _data(o._data),
+      _size(o._size),
+      _capacity(o._capacity) {
+  o._fd = -1;
+  o._data = 0;
+  o._size = 0;
+  o._capacity = 0;
+}
+
+// _____________________________________________________________________________
+template <typename T>
+MmapVector<T>& MmapVector<T>::operator=(MmapVector<T>&& o) {
+  if (this == &o) return *this;
+  release();
+  _dir = o._dir;
+  _fd = o._fd;
+  _data = o._data;
+  _size = o._size;
+  _capacity = o._capacity;
+  o._fd = -1;
+  o._data = 0;
+  o._size = 0;
+  o._capacity = 0;
+  return *this;
+}
+
+// _____________________________________________________________________________
+template <typename T>
+MmapVector<T>::~MmapVector() {
+  release();
+}
+
+// _____________________________________________________________________________
+template <typename T>
+void MmapVector<T>::release() {
+  if (_data) munmap(_data, _capacity * sizeof(T));
+  if (_fd != -1) close(_fd);
+  _data = 0;
+  _fd = -1;
+}
+
+// _____________________________________________________________________________
+template <typename T>
+void MmapVector<T>::resize(size_t n, const T& val) {
+  reserve(n);
+  for (size_t i = _size; i < n; i++) _data[i] = val;
+  _size = n;
+}
+
+// _____________________________________________________________________________
+template <typename T>
+void MmapVector<T>::grow(size_t capacity) {
+  void* data;
+
+  if (_dir.empty()) {
+    data = mmap(0, capacity * sizeof(T), PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (data == MAP_FAILED) throw std::runtime_error("Could not map memory");
+    if (_data) {
+      memcpy(data, _data, _size * sizeof(T));
+      munmap(_data, _capacity * sizeof(T));
+    }
+  } else {
+    if (_fd == -1) {
+      char* fName = strdup((_dir + "/petrimaps-mmap-XXXXXX").c_str());
+      _fd = mkstemp(fName);
+      if (_fd == -1) {
+        free(fName);
+        throw std::runtime_error("Could not create temporary file in " + _dir);
+      }
+
+      // immediately unlink
+      unlink(fName);
+      free(fName);
+    }
+
+    if (ftruncate(_fd, capacity * sizeof(T)) != 0) {
+      throw std::runtime_error("Could not grow temporary file in " + _dir);
+    }
+
+    // the file keeps the values, no copy needed
+    if (_data) munmap(_data, _capacity * sizeof(T));
+    data = mmap(0, capacity * sizeof(T), PROT_READ | PROT_WRITE, MAP_SHARED,
+                _fd, 0);
+    if (data == MAP_FAILED) {
+      _data = 0;
+      throw std::runtime_error("Could not map temporary file in " + _dir);
+    }
+  }
+
+  _data = static_cast<T*>(data);
+  _capacity = capacity;
+}
+
+// _____________________________________________________________________________
+template <typename T>
+size_t MmapVector<T>::memUsage() const {
+  if (_fd != -1) return 0;
+  return _capacity * sizeof(T);
+}
@@ -0,0 +1,119 @@
+// Copyright 2026, agent <agent@local>
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "qlever-petrimaps/ObjectTable.h"
+
+using petrimaps::ObjectTable;
+
+// _____________________________________________________________________________
+ObjectTable::ObjectTable(std::vector<std::pair<ID_TYPE, ID_TYPE>>&& objs)
+    : _rowRuns(true) {
+  build(objs);
+
+  // input is no longer needed
+  std::vector<std::pair<ID_TYPE, ID_TYPE>>().swap(objs);
+}
+
+// _____________________________________________________________________________
+ObjectTable::ObjectTable(const MmapVector<std::pair<ID_TYPE, ID_TYPE>>& objs,
+                         const std::string& dir)
+    : _geoms(dir), _rowRuns(true), _groupRows(dir) {
+  build(objs);
+}
+
+// _____________________________________________________________________________
+template <typename V>
+void ObjectTable::build(const V& objs) {
+  // first pass: determine groups, and whether rows increase monotonically
+  size_t numGroups = 0;
+  for (size_t i = 0; i < objs.size(); i++) {
+    if (i == 0 || objs[i].second != objs[i - 1].second) {
+      if (numGroups > 0 && objs[i].second < objs[i - 1].second)
+        _rowRuns = false;
+      numGroups++;
+    }
+  }
+
+  bool singleGroups = numGroups == objs.size();
+
+  if (!singleGroups) {
+    _groupBits.resize((objs.size() + 63) / 64, 0);
+    _groupRank.resize(_groupBits.size(), 0);
+    _groupStart.reserve(numGroups + 1);
+  }
+
+  if (!_rowRuns) _groupRows.reserve(numGroups);
+
+  _geoms.reserve(objs.size());
+
+  size_t group = 0;
+  for (size_t i = 0; i < objs.size(); i++) {
+    _geoms.push_back(objs[i].first);
+
+    if (i != 0 && objs[i].second == objs[i - 1].second) continue;
+
+    // new group starts at object i
+    if (!singleGroups) {
+      _groupBits[i / 64] |= uint64_t(1) << (i % 64);
+      _groupStart.push_back(i);
+    }
+
+    if (_rowRuns) {
+      if (group == 0 ||
+          objs[i].second != _runRow.back() + (group - _runGroup.back())) {
+        _runGroup.push_back(group);
+        _runRow.push_back(objs[i].second);
+      }
+    } else {
+      _groupRows.push_back(objs[i].second);
+    }
+
+    group++;
+  }
+
+  if (!singleGroups) {
+    _groupStart.push_back(objs.size());
+
+    ID_TYPE rank = 0;
+    for (size_t w = 0; w < _groupBits.size(); w++) {
+      _groupRank[w] = rank;
+      rank += __builtin_popcountll(_groupBits[w]);
+    }
+  }
+}
+
+// _____________________________________________________________________________
+size_t ObjectTable::group(size_t oid) const {
+  if (_groupBits.empty()) return oid;
+
+  size_t bit = oid % 64;
+  uint64_t mask = bit == 63 ? ~uint64_t(0) : (uint64_t(2) << bit) - 1;
+
+  return _groupRank[oid / 64] +
+         __builtin_popcountll(_groupBits[oid / 64] & mask) - 1;
+}
+
+// _____________________________________________________________________________
+ID_TYPE ObjectTable::row(size_t oid) const {
+  size_t g = group(oid);
+
+  if (!_rowRuns) return _groupRows[g];
+
+  size_t run =
+      std::upper_bound(_runGroup.begin(), _runGroup.end(), g) -
+      _runGroup.begin() - 1;
+
+  return _runRow[run] + (g - _runGroup[run]);
+}
+
+// _____________________________________________________________________________
+size_t ObjectTable::memUsage() const {
+  return _geoms.memUsage() + _groupBits.size() * sizeof(uint64_t) +
+         _groupRank.size() * sizeof(ID_TYPE) +
+         _groupStart.size() * sizeof(ID_TYPE) +
+         _runGroup.size() * sizeof(ID_TYPE) + _runRow.size() * sizeof(ID_TYPE) +
+         _groupRows.memUsage();
+}
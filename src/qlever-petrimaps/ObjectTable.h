@@ -0,0 +1,117 @@
+// Copyright 2026, agent <agent@local>
+
+#ifndef PETRIMAPS_OBJECTTABLE_H_
+#define PETRIMAPS_OBJECTTABLE_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "qlever-petrimaps/Misc.h"
+#include "qlever-petrimaps/MmapVector.h"
+
+namespace petrimaps {
+
+// A point object which shares its geometry with other result rows
+struct ClusterObj {
+  // object id of the cluster member
+  ID_TYPE oid;
+  // position of the member inside the cluster
+  uint32_t num;
+  // number of members
+  uint32_t tot;
+};
+
+// Columnar table of the objects of a query result. Each object is a single
+// geometry (a point or a line id from the GeomCache) belonging to a result
+// row. Consecutive objects belonging to the same result row (the parts of a
+// multi-geometry) form a group.
+//
+// Geometry ids are stored explicitly. Group boundaries are stored as a
+// rank-indexed bit vector, and are omitted completely if every object is
+// its own group. Result rows are stored once per group, and as runs of
+// consecutive rows if they are monotonically increasing.
+//
+// The per-object columns (geometry ids and group rows) can be backed by
+// files, see MmapVector.
+class ObjectTable {
+ public:
+  ObjectTable() : _rowRuns(false) {}
+
+  // build from (geom id, result row) pairs
+  explicit ObjectTable(std::vector<std::pair<ID_TYPE, ID_TYPE>>&& objs);
+
+  // build from (geom id, result row) pairs, with the per-object columns
+  // stored in temporary files in dir
+  ObjectTable(const MmapVector<std::pair<ID_TYPE, ID_TYPE>>& objs,
+              const std::string& dir);
+
+  size_t size() const { return _geoms.size(); }
+
+  ID_TYPE geom(size_t oid) const { return _geoms[oid]; }
+  ID_TYPE row(size_t oid) const;
+
+  // true if object oid is the first object of its group
+  bool startsGroup(size_t oid) const {
+    if (_groupBits.empty()) return true;
+    return (_groupBits[oid / 64] >> (oid % 64)) & 1;
+  }
+
+  // true if object oid is the only object of its group
+  bool isSingle(size_t oid) const {
+    return startsGroup(oid) && (oid + 1 == size() || startsGroup(oid + 1));
+  }
+
+  // range [groupBegin, groupEnd) of the objects in the group of object oid
+  size_t groupBegin(size_t oid) const {
+    if (_groupBits.empty()) return oid;
+    return _groupStart[group(oid)];
+  }
+
+  size_t groupEnd(size_t oid) const {
+    if (_groupBits.empty()) return oid + 1;
+    return _groupStart[group(oid) + 1];
+  }
+
+  size_t getNumGroups() const {
+    return _groupBits.empty() ? size() : _groupStart.size() - 1;
+  }
+
+  // approximate memory usage in bytes, without file-backed columns
+  size_t memUsage() const;
+
+  // true if the per-object columns are stored in files
+  bool fileBacked() const { return _geoms.fileBacked(); }
+
+ private:
+  size_t group(size_t oid) const;
+
+  template <typename V>
+  void build(const V& objs);
+
+  MmapVector<ID_TYPE> _geoms;
+
+  // bit i is set if object i is the first object of its group
+  std::vector<uint64_t> _groupBits;
+
+  // number of groups starting before each 64 bit word of _groupBits
+  std::vector<ID_TYPE> _groupRank;
+
+  // first object of each group, with a sentinel at the end
+  std::vector<ID_TYPE> _groupStart;
+
+  // if _rowRuns is set, the group rows are stored as runs of consecutive
+  // rows, each given by its first group and its first row
+  bool _rowRuns;
+  std::vector<ID_TYPE> _runGroup;
+  std::vector<ID_TYPE> _runRow;
+
+  // otherwise, the row of each group
+  MmapVector<ID_TYPE> _groupRows;
+};
+
+}  // namespace petrimaps
+
+#endif  // PETRIMAPS_OBJECTTABLE_H_
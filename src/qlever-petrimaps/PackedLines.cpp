@@ -0,0 +1,96 @@
+// Copyright 2026, agent <agent@local>
+
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#include "qlever-petrimaps/PackedLines.h"
+
+using petrimaps::PackedLineStore;
+
+// _____________________________________________________________________________
+PackedLineStore::Decoder::Decoder(const PackedLineStore& store, size_t lid)
+    : _p(store.line(lid)) {
+  _rem = readVarint(&_p) >> 1;
+
+  // the vertex deltas start at the lower left of the bounding box
+  _x = unzigzag(readVarint(&_p));
+  _y = unzigzag(readVarint(&_p));
+
+  // skip upper right
+  readVarint(&_p);
+  readVarint(&_p);
+}
+
+// _____________________________________________________________________________
+void PackedLineStore::add(const util::geo::Point<int32_t>& ll,
+                          const util::geo::Point<int32_t>& ur,
+                          const std::vector<util::geo::Point<int32_t>>& pts,
+                          bool isArea) {
+  size_t lid = _lineOffsets.size();
+  if (lid % PACKED_LINES_BLOCK_SIZE == 0) _blockOffsets.push_back(_data.size());
+
+  uint64_t rel = _data.size() - _blockOffsets.back();
+  if (rel > std::numeric_limits<uint32_t>::max()) {
+    throw std::runtime_error("Packed line block exceeds 4 GB");
+  }
+  _lineOffsets.push_back(rel);
+
+  writeVarint((static_cast<uint64_t>(pts.size()) << 1) | isArea);
+
+  writeVarint(zigzag(ll.getX()));
+  writeVarint(zigzag(ll.getY()));
+  writeVarint(zigzag(static_cast<int64_t>(ur.getX()) - ll.getX()));
+  writeVarint(zigzag(static_cast<int64_t>(ur.getY()) - ll.getY()));
+
+  int64_t x = ll.getX();
+  int64_t y = ll.getY();
+
+  for (const auto& p : pts) {
+    writeVarint(zigzag(p.getX() - x));
+    writeVarint(zigzag(p.getY() - y));
+    x = p.getX();
+    y = p.getY();
+  }
+}
+
+// _____________________________________________________________________________
+bool PackedLineStore::isArea(size_t lid) const {
+  const uint8_t* p = line(lid);
+  return readVarint(&p) & 1;
+}
+
+// _____________________________________________________________________________
+util::geo::DBox PackedLineStore::getBBox(size_t lid) const {
+  const uint8_t* p = line(lid);
+  readVarint(&p);
+
+  int64_t llX = unzigzag(readVarint(&p));
+  int64_t llY = unzigzag(readVarint(&p));
+  int64_t urX = llX + unzigzag(readVarint(&p));
+  int64_t urY = llY + unzigzag(readVarint(&p));
+
+  return util::geo::DBox({llX / 10.0, llY / 10.0}, {urX / 10.0, urY / 10.0});
+}
+
+// _____________________________________________________________________________
+void PackedLineStore::writeVarint(uint64_t v) {
+  while (v >= 0x80) {
+    _data.push_back(static_cast<uint8_t>(v) | 0x80);
+    v >>= 7;
+  }
+  _data.push_back(static_cast<uint8_t>(v));
+}
+
+// _____________________________________________________________________________
+size_t PackedLineStore::memUsage() const {
+  return _data.capacity() + _blockOffsets.capacity() * sizeof(uint64_t) +
+         _lineOffsets.capacity() * sizeof(uint32_t);
+}
+
+// _____________________________________________________________________________
+void PackedLineStore::shrinkToFit() {
+  _data.shrink_to_fit();
+  _blockOffsets.shrink_to_fit();
+  _lineOffsets.shrink_to_fit();
+}
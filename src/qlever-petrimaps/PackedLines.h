@@ -0,0 +1,97 @@
+// Copyright 2026, agent <agent@local>
+
+#ifndef PETRIMAPS_PACKEDLINES_H_
+#define PETRIMAPS_PACKEDLINES_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "util/geo/Geo.h"
+
+namespace petrimaps {
+
+// number of lines per block of the line offset index
+const static size_t PACKED_LINES_BLOCK_SIZE = 64;
+
+// Compact store for lines with integer coordinates (in 1/10 of a web
+// mercator unit). Each line is coded as a header (number of vertices and
+// area flag), its bounding box, and its vertices, each as zigzag varints of
+// the delta to the previous value. Lines are found via a per-block 64 bit
+// byte offset and a per-line 32 bit byte offset relative to its block.
+class PackedLineStore {
+ public:
+  // streaming decoder for the vertices of a single line
+  class Decoder {
+   public:
+    Decoder() : _p(0), _rem(0), _x(0), _y(0) {}
+    Decoder(const PackedLineStore& store, size_t lid);
+
+    bool next(util::geo::DPoint* p) {
+      if (_rem == 0) return false;
+      _x += unzigzag(readVarint(&_p));
+      _y += unzigzag(readVarint(&_p));
+      _rem--;
+      p->setX(_x / 10.0);
+      p->setY(_y / 10.0);
+      return true;
+    }
+
+   private:
+    const uint8_t* _p;
+    size_t _rem;
+    int64_t _x, _y;
+  };
+
+  // add a line with bounding box (ll, ur) and vertices pts
+  void add(const util::geo::Point<int32_t>& ll,
+           const util::geo::Point<int32_t>& ur,
+           const std::vector<util::geo::Point<int32_t>>& pts, bool isArea);
+
+  size_t size() const { return _lineOffsets.size(); }
+
+  bool isArea(size_t lid) const;
+  util::geo::DBox getBBox(size_t lid) const;
+
+  // approximate memory usage in bytes
+  size_t memUsage() const;
+
+  void shrinkToFit();
+
+ private:
+  std::vector<uint8_t> _data;
+  std::vector<uint64_t> _blockOffsets;
+  std::vector<uint32_t> _lineOffsets;
+
+  const uint8_t* line(size_t lid) const {
+    return &_data[0] + _blockOffsets[lid / PACKED_LINES_BLOCK_SIZE] +
+           _lineOffsets[lid];
+  }
+
+  void writeVarint(uint64_t v);
+
+  static uint64_t readVarint(const uint8_t** p) {
+    uint64_t ret = 0;
+    int shift = 0;
+    while (**p & 0x80) {
+      ret |= static_cast<uint64_t>(**p & 0x7F) << shift;
+      shift += 7;
+      (*p)++;
+    }
+    ret |= static_cast<uint64_t>(**p) << shift;
+    (*p)++;
+    return ret;
+  }
+
+  static uint64_t zigzag(int64_t v) {
+    return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+  }
+
+  static int64_t unzigzag(uint64_t v) {
+    return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+  }
+};
+
+}  // namespace petrimaps
+
+#endif  // PETRIMAPS_PACKEDLINES_H_
@@ -7,24 +7,38 @@
 #include <iostream>
 
 #include "qlever-petrimaps/server/Server.h"
+#include "qlever-petrimaps/server/ShardClient.h"
 #include "util/Misc.h"
 #include "util/http/Server.h"
 #include "util/log/Log.h"
 
 using petrimaps::Server;
+using petrimaps::ShardClient;
 
 // _____________________________________________________________________________
 void printHelp(int argc, char** argv) {
   UNUSED(argc);
   std::cout << "Usage: " << argv[0]
-            << " [-p <port>] [-m <maxmemory>] [-c <cachedir>] [--help] [-h]"
+            << " [-p <port>] [-m <maxmemory>] [-c <cachedir>] [-w <seconds>]"
+            << " [-z] [-l <file>] [-s <i>/<n> | -S <url,...>] [-P <url,...>]"
+            << " [--help] [-h]"
             << "\n";
   std::cout
       << "\nAllowed arguments:\n    -p <port>    Port for server to listen to "
          "(default: 9090)"
       << "\n    -m <memory>  Max memory in GB (default: 90% of system RAM)"
       << "\n    -c <dir>     cache dir (default: none)"
-      << "\n    -t <minutes> request cache lifetime (default: 360)\n";
+      << "\n    -t <minutes> request cache lifetime (default: 360)"
+      << "\n    -w <seconds> interval for polling the index hashes of the "
+         "backends, 0 disables (default: 60)"
+      << "\n    -z           keep lines delta-varint packed in memory"
+      << "\n    -l <file>    append a log of all map requests to <file>, for "
+         "petrimaps-replay"
+      << "\n    -s <i>/<n>   only hold shard i of n of the geometry caches"
+      << "\n    -S <urls>    coordinate the comma-separated shard servers "
+         "<urls>"
+      << "\n    -P <urls>    fetch missing cache files from the "
+         "comma-separated petrimaps peers <urls> (needs -c)\n";
 }
 
 // _____________________________________________________________________________
@@ -41,9 +55,16 @@ int main(int argc, char** argv) {
   // default port
   int port = 9090;
   int cacheLifetime = 6 * 60;
+  int indexHashInterval = 60;
   double maxMemoryGB =
       (sysconf(_SC_PHYS_PAGES) * sysconf(_SC_PAGE_SIZE) * 0.9) / 1000000000;
   std::string cacheDir;
+  bool packLines = false;
+  std::string requestLog;
+  size_t shard = 0;
+  size_t numShards = 1;
+  std::string shardUrls;
+  std::string peerUrls;
 
   for (int i = 1; i < argc; i++) {
     std::string cur = argv[i];
@@ -74,9 +95,59 @@ int main(int argc, char** argv) {
         exit(1);
       }
       cacheLifetime = atof(argv[i]);
+    } else if (cur == "-w") {
+      if (++i >= argc) {
+        LOG(ERROR) << "Missing argument for index hash interval (-w).";
+        exit(1);
+      }
+      indexHashInterval = atoi(argv[i]);
+    } else if (cur == "-z") {
+      packLines = true;
+    } else if (cur == "-l") {
+      if (++i >= argc) {
+        LOG(ERROR) << "Missing argument for request log (-l).";
+        exit(1);
+      }
+      requestLog = argv[i];
+    } else if (cur == "-s") {
+      if (++i >= argc) {
+        LOG(ERROR) << "Missing argument for shard (-s).";
+        exit(1);
+      }
+      auto parts = util::split(argv[i], '/');
+      if (parts.size() != 2 || atoi(parts[1].c_str()) < 1 ||
+          atoi(parts[0].c_str()) < 0 ||
+          atoi(parts[0].c_str()) >= atoi(parts[1].c_str())) {
+        LOG(ERROR) << "Invalid shard (-s), expected <i>/<n> with i < n.";
+        exit(1);
+      }
+      shard = atoi(parts[0].c_str());
+      numShards = atoi(parts[1].c_str());
+    } else if (cur == "-S") {
+      if (++i >= argc) {
+        LOG(ERROR) << "Missing argument for shard servers (-S).";
+        exit(1);
+      }
+      shardUrls = argv[i];
+    } else if (cur == "-P") {
+      if (++i >= argc) {
+        LOG(ERROR) << "Missing argument for peers (-P).";
+        exit(1);
+      }
+      peerUrls = argv[i];
     }
   }
 
+  if (peerUrls.size() && cacheDir.empty()) {
+    LOG(ERROR) << "Fetching from peers (-P) needs a cache dir (-c).";
+    exit(1);
+  }
+
+  if (shardUrls.size() && numShards > 1) {
+    LOG(ERROR) << "A coordinator (-S) cannot hold a shard (-s) itself.";
+    exit(1);
+  }
+
   if (cacheDir.size() && access(cacheDir.c_str(), W_OK) != 0) {
     std::stringstream ss;
     ss << "No write access to cache dir " << cacheDir;
@@ -85,7 +156,30 @@ int main(int argc, char** argv) {
 
   LOG(INFO) << "Starting server...";
   LOG(INFO) << "Max memory is " << maxMemoryGB << " GB...";
-  Server serv(maxMemoryGB * 1000000000, cacheDir, cacheLifetime);
+  Server serv(maxMemoryGB * 1000000000, cacheDir, cacheLifetime,
+              indexHashInterval, packLines, requestLog);
+
+  if (numShards > 1) {
+    LOG(INFO) << "Holding shard " << shard << " of " << numShards << "...";
+    serv.setShard(shard, numShards);
+  }
+
+  if (shardUrls.size()) {
+    auto urls = ShardClient::parseUrls(shardUrls);
+    if (urls.empty()) {
+      LOG(ERROR) << "No shard servers (-S) given.";
+      exit(1);
+    }
+    LOG(INFO) << "Coordinating " << urls.size() << " shard servers...";
+    serv.setShards(urls);
+  }
+
+  if (peerUrls.size()) {
+    auto urls = ShardClient::parseUrls(peerUrls);
+    LOG(INFO) << "Fetching missing cache files from " << urls.size()
+              << " peers...";
+    serv.setPeers(urls);
+  }
 
   LOG(INFO) << "Listening on port " << port;
   util::http::HttpServer(port, &serv, std::thread::hardware_concurrency())
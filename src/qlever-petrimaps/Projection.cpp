@@ -0,0 +1,119 @@
+// Copyright 2026, agent <agent@local>
+
+#include <stdint.h>
+#include <string.h>
+
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "qlever-petrimaps/Projection.h"
+
+using util::geo::DLine;
+using util::geo::DPoint;
+
+// the polynomials below are accurate for latitudes up to this, beyond it
+// the scalar projection is used
+const static double FAST_MAX_LAT = 86;
+
+const static double DEG_TO_RAD = 0.017453292519943295;
+const static double EARTH_RAD = 6378137.0;
+const static double LN2 = 0.6931471805599453;
+const static double SQRT2 = 1.4142135623730951;
+
+// _____________________________________________________________________________
+static inline double sinPoly(double x) {
+  // Taylor series up to x^21, error below 3e-16 for |x| <= pi / 2
+  double x2 = x * x;
+  double r = 1.9572941063391263e-20;
+  r = r * x2 - 8.22063524662433e-18;
+  r = r * x2 + 2.8114572543455206e-15;
+  r = r * x2 - 7.647163731819816e-13;
+  r = r * x2 + 1.6059043836821613e-10;
+  r = r * x2 - 2.505210838544172e-08;
+  r = r * x2 + 2.7557319223985893e-06;
+  r = r * x2 - 0.0001984126984126984;
+  r = r * x2 + 0.008333333333333333;
+  r = r * x2 - 0.16666666666666666;
+  r = r * x2 + 1.0;
+  return r * x;
+}
+
+// _____________________________________________________________________________
+static inline double logPoly(double v) {
+  // v = m * 2^e with m in [sqrt(1/2), sqrt(2)), then
+  // log(m) = 2 * atanh(z) with z = (m - 1) / (m + 1), |z| <= 0.172
+  uint64_t bits;
+  memcpy(&bits, &v, sizeof(bits));
+  double e = static_cast<int64_t>((bits >> 52) & 0x7ff) - 1023;
+  bits = (bits & 0x000fffffffffffffULL) | 0x3ff0000000000000ULL;
+  double m;
+  memcpy(&m, &bits, sizeof(m));
+
+  bool big = m > SQRT2;
+  m = big ? m * 0.5 : m;
+  e = big ? e + 1 : e;
+
+  double z = (m - 1) / (m + 1);
+  double z2 = z * z;
+
+  // atanh series up to z^21, error below 1e-18
+  double r = 1.0 / 21;
+  r = r * z2 + 1.0 / 19;
+  r = r * z2 + 1.0 / 17;
+  r = r * z2 + 1.0 / 15;
+  r = r * z2 + 1.0 / 13;
+  r = r * z2 + 1.0 / 11;
+  r = r * z2 + 1.0 / 9;
+  r = r * z2 + 1.0 / 7;
+  r = r * z2 + 1.0 / 5;
+  r = r * z2 + 1.0 / 3;
+  r = r * z2 + 1.0;
+
+  return e * LN2 + 2 * z * r;
+}
+
+// _____________________________________________________________________________
+void petrimaps::projectWebMerc(const double* lng, const double* lat, double* x,
+                               double* y, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    // clamp, out-of-range coordinates are fixed below
+    double a = lat[i];
+    a = a > FAST_MAX_LAT ? FAST_MAX_LAT : a;
+    a = a < -FAST_MAX_LAT ? -FAST_MAX_LAT : a;
+    double s = sinPoly(a * DEG_TO_RAD);
+    x[i] = EARTH_RAD * lng[i] * DEG_TO_RAD;
+    y[i] = EARTH_RAD / 2 * logPoly((1.0 + s) / (1.0 - s));
+  }
+
+  for (size_t i = 0; i < n; i++) {
+    if (std::fabs(lat[i]) < FAST_MAX_LAT && std::isfinite(lng[i])) continue;
+    auto p = util::geo::latLngToWebMerc(DPoint(lng[i], lat[i]));
+    x[i] = p.getX();
+    y[i] = p.getY();
+  }
+}
+
+// _____________________________________________________________________________
+void petrimaps::projectLine(const double* lng, const double* lat, size_t n,
+                            DLine* out) {
+  thread_local std::vector<double> xs, ys;
+  if (xs.size() < n) {
+    xs.resize(n);
+    ys.resize(n);
+  }
+
+  projectWebMerc(lng, lat, xs.data(), ys.data(), n);
+
+  for (size_t i = 0; i < n; i++) {
+    // same as GeomCache::pointValid()
+    if (xs[i] > std::numeric_limits<double>::max() ||
+        xs[i] < std::numeric_limits<double>::lowest() ||
+        ys[i] > std::numeric_limits<double>::max() ||
+        ys[i] < std::numeric_limits<double>::lowest()) {
+      continue;
+    }
+
+    out->push_back({xs[i], ys[i]});
+  }
+}
@@ -0,0 +1,28 @@
+// Copyright 2026, agent <agent@local>
+
+#ifndef PETRIMAPS_PROJECTION_H_
+#define PETRIMAPS_PROJECTION_H_
+
+#include <stddef.h>
+
+#include "util/geo/Geo.h"
+
+namespace petrimaps {
+
+// Project the n WGS84 coordinates (lng[i], lat[i]) to web mercator (x[i],
+// y[i]). The loop is branch-free and uses polynomial approximations of sin
+// and log, so the compiler can vectorize it (Projection.cpp is built with
+// -fno-trapping-math for this). Results differ from
+// util::geo::latLngToWebMerc() by less than 1e-6 map units; coordinates
+// close to the poles and non-finite input take the scalar path.
+void projectWebMerc(const double* lng, const double* lat, double* x,
+                    double* y, size_t n);
+
+// Project the n coordinates like projectWebMerc(), drop invalid points and
+// append the resulting line to out.
+void projectLine(const double* lng, const double* lat, size_t n,
+                 util::geo::DLine* out);
+
+}  // namespace petrimaps
+
+#endif  // PETRIMAPS_PROJECTION_H_
@@ -0,0 +1,202 @@
+// Copyright 2026, agent <agent@local>
+
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "qlever-petrimaps/Projection.h"
+#include "qlever-petrimaps/TestUtil.h"
+#include "util/geo/Geo.h"
+
+using petrimaps::projectLine;
+using petrimaps::projectWebMerc;
+using petrimaps::test::check;
+using petrimaps::test::result;
+using util::geo::DPoint;
+
+typedef std::chrono::steady_clock Clock;
+
+// max difference to util::geo::latLngToWebMerc() promised in Projection.h
+const static double MAX_ERROR = 1e-6;
+
+// _____________________________________________________________________________
+bool same(double a, double b) {
+  return (std::isnan(a) && std::isnan(b)) || a == b;
+}
+
+// _____________________________________________________________________________
+std::string coord(double lng, double lat) {
+  std::stringstream ss;
+  ss << std::setprecision(17) << "(" << lng << ", " << lat << ")";
+  return ss.str();
+}
+
+// _____________________________________________________________________________
+double maxError(const std::vector<double>& lng,
+                const std::vector<double>& lat) {
+  // project all coordinates at once and compare with the scalar projection.
+  // Non-finite results must match exactly
+  size_t n = lng.size();
+  std::vector<double> x(n, 0), y(n, 0);
+  projectWebMerc(lng.data(), lat.data(), x.data(), y.data(), n);
+
+  double err = 0;
+  for (size_t i = 0; i < n; i++) {
+    auto p = util::geo::latLngToWebMerc(DPoint(lng[i], lat[i]));
+    if (!std::isfinite(p.getX()) || !std::isfinite(p.getY())) {
+      check(same(x[i], p.getX()) && same(y[i], p.getY()),
+            "non-finite projection of " + coord(lng[i], lat[i]));
+      continue;
+    }
+    err = std::max(err, std::fabs(x[i] - p.getX()));
+    err = std::max(err, std::fabs(y[i] - p.getY()));
+  }
+  return err;
+}
+
+// _____________________________________________________________________________
+void testRange() {
+  // latitudes from -86 to 86 in steps of 0.001 degrees, and longitudes
+  // covering the entire range
+  std::vector<double> lng, lat;
+  for (int i = -86000; i <= 86000; i++) {
+    lat.push_back(i / 1000.0);
+    lng.push_back(std::fmod(i * 0.37 + 360000, 360) - 180);
+  }
+
+  double err = maxError(lng, lat);
+  std::cout << "max error for latitudes -86..86: " << err << "\n";
+  check(err < MAX_ERROR, "error for latitudes -86..86 exceeds 1e-6");
+
+  // random coordinates, including the polar regions
+  std::mt19937 rng(3);
+  std::uniform_real_distribution<double> dLng(-180, 180), dLat(-90, 90);
+  for (size_t i = 0; i < lng.size(); i++) {
+    lng[i] = dLng(rng);
+    lat[i] = dLat(rng);
+  }
+
+  err = maxError(lng, lat);
+  std::cout << "max error for random coordinates: " << err << "\n";
+  check(err < MAX_ERROR, "error for random coordinates exceeds 1e-6");
+}
+
+// _____________________________________________________________________________
+void testBoundary() {
+  // at and beyond +-86 degrees, the scalar projection is used, and the
+  // results must be identical
+  double below = std::nextafter(86.0, 0.0);
+  double above = std::nextafter(86.0, 90.0);
+  std::vector<double> lats = {86, above, 86.5, 89.99, 90, 91, 180};
+
+  for (double l : lats) {
+    for (double sign : {1.0, -1.0}) {
+      double lng = 13.4, lat = sign * l;
+      double x, y;
+      projectWebMerc(&lng, &lat, &x, &y, 1);
+      auto p = util::geo::latLngToWebMerc(DPoint(lng, lat));
+      check(same(x, p.getX()) && same(y, p.getY()),
+            "scalar fallback differs for " + coord(lng, lat));
+    }
+  }
+
+  // just below the boundary, the polynomials are still used
+  std::vector<double> lng = {13.4, 13.4, -179.9, 179.9};
+  std::vector<double> lat = {below, -below, below, -below};
+  check(maxError(lng, lat) < MAX_ERROR,
+        "error just below +-86 degrees exceeds 1e-6");
+}
+
+// _____________________________________________________________________________
+void testNonFinite() {
+  double nan = std::numeric_limits<double>::quiet_NaN();
+  double inf = std::numeric_limits<double>::infinity();
+
+  std::vector<double> vals = {nan, inf, -inf, 0, 45.5};
+  std::vector<double> lng, lat;
+  for (double a : vals) {
+    for (double b : vals) {
+      lng.push_back(a);
+      lat.push_back(b);
+    }
+  }
+
+  // non-finite results are checked by maxError()
+  check(maxError(lng, lat) < MAX_ERROR, "error for non-finite input");
+
+  // points projected to infinity are dropped from lines
+  std::vector<double> lineLng = {7.8, 7.9, 8.0, 8.1};
+  std::vector<double> lineLat = {47.9, 90, 48.0, -90};
+  util::geo::DLine line;
+  projectLine(lineLng.data(), lineLat.data(), lineLng.size(), &line);
+  check(line.size() == 2, "projectLine() keeps points at infinity");
+}
+
+// _____________________________________________________________________________
+void testTails() {
+  // every input length must be handled, not only multiples of the
+  // vector width
+  for (size_t n = 0; n < 33; n++) {
+    std::vector<double> lng(n), lat(n);
+    for (size_t i = 0; i < n; i++) {
+      lng[i] = -170 + 10.3 * i;
+      lat[i] = -80 + 5.1 * i;
+    }
+    check(maxError(lng, lat) < MAX_ERROR,
+          "error for " + std::to_string(n) + " coordinates");
+  }
+}
+
+// _____________________________________________________________________________
+void benchThroughput() {
+  size_t n = 1 << 22;
+  size_t reps = 5;
+
+  std::vector<double> lng(n), lat(n), x(n), y(n);
+  std::mt19937 rng(7);
+  std::uniform_real_distribution<double> dLng(-180, 180), dLat(-85, 85);
+  for (size_t i = 0; i < n; i++) {
+    lng[i] = dLng(rng);
+    lat[i] = dLat(rng);
+  }
+
+  auto start = Clock::now();
+  for (size_t r = 0; r < reps; r++) {
+    projectWebMerc(lng.data(), lat.data(), x.data(), y.data(), n);
+  }
+  double batched =
+      std::chrono::duration<double>(Clock::now() - start).count() / reps;
+
+  start = Clock::now();
+  for (size_t r = 0; r < reps; r++) {
+    for (size_t i = 0; i < n; i++) {
+      auto p = util::geo::latLngToWebMerc(DPoint(lng[i], lat[i]));
+      x[i] = p.getX();
+      y[i] = p.getY();
+    }
+  }
+  double scalar =
+      std::chrono::duration<double>(Clock::now() - start).count() / reps;
+
+  std::cout << std::fixed << std::setprecision(1)
+            << "projectWebMerc: " << n / batched / 1000000.0
+            << " Mpoints/s, latLngToWebMerc: " << n / scalar / 1000000.0
+            << " Mpoints/s (" << scalar / batched << "x)\n";
+}
+
+// _____________________________________________________________________________
+int main() {
+  testRange();
+  testBoundary();
+  testNonFinite();
+  testTails();
+  benchThroughput();
+
+  return result();
+}
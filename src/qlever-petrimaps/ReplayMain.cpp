@@ -0,0 +1,463 @@
+// Copyright 2026, agent <agent@local>
+
+#include <curl/curl.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "qlever-petrimaps/server/RequestLog.h"
+#include "util/Misc.h"
+#include "util/log/Log.h"
+
+using petrimaps::RequestLog;
+using petrimaps::RequestLogEntry;
+
+typedef std::chrono::steady_clock Clock;
+
+// timings of a single replayed request, in ms
+struct ReplayResult {
+  bool ok;
+  double queue;
+  double ttfb;
+  double transfer;
+  double total;
+};
+
+struct ReplayState {
+  std::vector<RequestLogEntry> entries;
+  std::vector<Clock::time_point> scheduled;
+  std::vector<ReplayResult> results;
+
+  std::string baseUrl;
+  std::string backend;
+
+  // sessions created by a /query request of the log
+  std::set<std::string> logSessions;
+
+  // recorded session id -> replayed session id, empty if the query failed
+  std::map<std::string, std::string> sessions;
+
+  std::deque<size_t> queue;
+  bool done = false;
+
+  std::mutex m;
+  std::condition_variable cv;
+};
+
+// _____________________________________________________________________________
+void printHelp(int argc, char** argv) {
+  UNUSED(argc);
+  std::cout << "Usage: " << argv[0]
+            << " [-u <url>] [-b <backend>] [-s <speed>] [-j <num>] [--help] "
+               "[-h] <request log>"
+            << "\n";
+  std::cout
+      << "\nReplays a request log written by petrimaps -l and reports the "
+         "latencies per endpoint.\n"
+      << "\nAllowed arguments:\n    -u <url>     petrimaps server to replay "
+         "against (default: http://localhost:9090)"
+      << "\n    -b <url>     replace the backend of all queries, e.g. by a "
+         "local stand-in backend"
+      << "\n    -s <speed>   replay speed relative to the recording, 0 sends "
+         "requests as fast as possible (default: 1)"
+      << "\n    -j <num>     max number of concurrent requests (default: 4)\n";
+}
+
+// _____________________________________________________________________________
+size_t writeCb(void* contents, size_t size, size_t nmemb, void* userp) {
+  size_t realSize = size * nmemb;
+  if (userp) {
+    static_cast<std::string*>(userp)->append(static_cast<char*>(contents),
+                                             realSize);
+  }
+  return realSize;
+}
+
+// _____________________________________________________________________________
+std::vector<std::string> splitSessions(const std::string& val) {
+  std::vector<std::string> ret(1);
+  for (size_t i = 0; i < val.size(); i++) {
+    if (val[i] == ',') {
+      ret.push_back("");
+    } else if (val.compare(i, 3, "%2C") == 0 || val.compare(i, 3, "%2c") == 0) {
+      ret.push_back("");
+      i += 2;
+    } else {
+      ret.back() += val[i];
+    }
+  }
+  return ret;
+}
+
+// _____________________________________________________________________________
+std::string rewriteParams(CURL* curl, const std::string& params,
+                          const std::string& backend,
+                          const std::map<std::string, std::string>& sessions) {
+  std::string ret;
+  size_t pos = 0;
+
+  while (pos <= params.size()) {
+    size_t end = params.find('&', pos);
+    if (end == std::string::npos) end = params.size();
+
+    std::string kv = params.substr(pos, end - pos);
+    size_t eq = kv.find('=');
+    std::string key = kv.substr(0, eq);
+
+    if (eq != std::string::npos) {
+      std::string val = kv.substr(eq + 1);
+      if (key == "id" || key == "layers") {
+        // /heatmap may render several comma-separated sessions
+        std::string ids;
+        for (const auto& id : splitSessions(val)) {
+          if (ids.size()) ids += ",";
+          ids += sessions.count(id) ? sessions.find(id)->second : id;
+        }
+        kv = key + "=" + ids;
+      } else if (key == "backend" && backend.size()) {
+        char* esc = curl_easy_escape(curl, backend.c_str(), backend.size());
+        kv = key + "=" + esc;
+        curl_free(esc);
+      }
+    }
+
+    if (pos > 0) ret += "&";
+    ret += kv;
+    pos = end + 1;
+  }
+
+  return ret;
+}
+
+// _____________________________________________________________________________
+std::vector<std::string> sessionsOf(const RequestLogEntry& e) {
+  size_t q = e.url.find('?');
+  std::string params =
+      (q == std::string::npos ? "" : e.url.substr(q + 1)) + "&" + e.payload;
+
+  size_t pos = 0;
+  while (pos < params.size()) {
+    size_t end = params.find('&', pos);
+    if (end == std::string::npos) end = params.size();
+
+    std::string kv = params.substr(pos, end - pos);
+    if (kv.compare(0, 3, "id=") == 0) return splitSessions(kv.substr(3));
+    if (kv.compare(0, 7, "layers=") == 0) return splitSessions(kv.substr(7));
+
+    pos = end + 1;
+  }
+
+  return {};
+}
+
+// _____________________________________________________________________________
+void replay(ReplayState* state) {
+  CURL* curl = curl_easy_init();
+  if (!curl) throw std::runtime_error("Could not initialize curl");
+
+  while (true) {
+    size_t i;
+    {
+      std::unique_lock<std::mutex> lock(state->m);
+      state->cv.wait(lock,
+                     [state] { return state->done || !state->queue.empty(); });
+      if (state->queue.empty()) break;
+      i = state->queue.front();
+      state->queue.pop_front();
+    }
+
+    const auto& e = state->entries[i];
+    ReplayResult res{false, 0, 0, 0, 0};
+
+    // wait until the sessions referenced by this request have been replayed
+    std::map<std::string, std::string> sessions;
+    bool sessionFailed = false;
+
+    for (const auto& session : sessionsOf(e)) {
+      if (session.empty() || !state->logSessions.count(session)) continue;
+      std::unique_lock<std::mutex> lock(state->m);
+      state->cv.wait(lock, [state, &session] {
+        return state->sessions.count(session) > 0;
+      });
+      sessions[session] = state->sessions[session];
+      if (sessions[session].empty()) sessionFailed = true;
+    }
+
+    auto begin = Clock::now();
+    res.queue = std::chrono::duration<double, std::milli>(
+                    begin - state->scheduled[i])
+                    .count();
+
+    std::string body;
+    bool ok = !sessionFailed;
+
+    if (ok) {
+      std::string url = e.url;
+      size_t q = url.find('?');
+      if (q != std::string::npos) {
+        url = url.substr(0, q + 1) +
+              rewriteParams(curl, url.substr(q + 1), state->backend, sessions);
+      }
+      url = state->baseUrl + url;
+
+      std::string payload;
+      if (e.payload.size()) {
+        payload = rewriteParams(curl, e.payload, state->backend, sessions);
+      }
+
+      curl_easy_reset(curl);
+      curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+      curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeCb);
+      curl_easy_setopt(curl, CURLOPT_WRITEDATA,
+                       e.endpoint == "/query" ? &body : 0);
+      curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");
+      if (payload.size()) {
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, payload.c_str());
+      }
+
+      long httpCode = 0;
+      double ttfb = 0, total = 0;
+
+      CURLcode code = curl_easy_perform(curl);
+      curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &httpCode);
+      curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME, &ttfb);
+      curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME, &total);
+
+      ok = code == CURLE_OK && httpCode == 200;
+      res.ttfb = ttfb * 1000;
+      res.total = total * 1000;
+      res.transfer = res.total - res.ttfb;
+
+      if (code != CURLE_OK) {
+        LOG(WARN) << "[REPLAY] " << e.endpoint << ": "
+                  << curl_easy_strerror(code);
+      }
+    }
+
+    res.ok = ok;
+
+    {
+      std::lock_guard<std::mutex> guard(state->m);
+      state->results[i] = res;
+
+      if (e.endpoint == "/query" && e.session.size()) {
+        // the answer of /query starts with the new session id
+        const std::string key = "{\"qid\" : \"";
+        std::string newSession;
+        if (ok && body.compare(0, key.size(), key) == 0) {
+          newSession =
+              body.substr(key.size(), body.find('"', key.size()) - key.size());
+        }
+        state->sessions[e.session] = newSession;
+        state->cv.notify_all();
+      }
+    }
+  }
+
+  curl_easy_cleanup(curl);
+}
+
+// _____________________________________________________________________________
+double percentile(const std::vector<double>& sorted, double p) {
+  if (sorted.empty()) return 0;
+  size_t i = std::ceil(p * sorted.size());
+  if (i > 0) i--;
+  return sorted[std::min(i, sorted.size() - 1)];
+}
+
+// _____________________________________________________________________________
+void printReport(const ReplayState& state) {
+  std::map<std::string, std::vector<size_t>> byEndpoint;
+  for (size_t i = 0; i < state.entries.size(); i++) {
+    byEndpoint[state.entries[i].endpoint].push_back(i);
+  }
+
+  std::cout << std::fixed << std::setprecision(1);
+  std::cout << "\n"
+            << std::left << std::setw(10) << "endpoint" << std::right
+            << std::setw(8) << "count" << std::setw(8) << "errors"
+            << "  " << std::left << std::setw(10) << "phase" << std::right
+            << std::setw(10) << "p50" << std::setw(10) << "p90"
+            << std::setw(10) << "p99" << std::setw(10) << "max"
+            << "  (ms)\n";
+
+  for (const auto& ep : byEndpoint) {
+    std::vector<double> queue, ttfb, transfer, total, recorded;
+    size_t errors = 0;
+
+    for (size_t i : ep.second) {
+      const auto& r = state.results[i];
+      recorded.push_back(state.entries[i].duration);
+      if (!r.ok) {
+        errors++;
+        continue;
+      }
+      queue.push_back(r.queue);
+      ttfb.push_back(r.ttfb);
+      transfer.push_back(r.transfer);
+      total.push_back(r.total);
+    }
+
+    std::vector<std::pair<std::string, std::vector<double>*>> phases = {
+        {"queue", &queue},
+        {"ttfb", &ttfb},
+        {"transfer", &transfer},
+        {"total", &total},
+        {"recorded", &recorded}};
+
+    bool first = true;
+    for (const auto& ph : phases) {
+      auto& v = *ph.second;
+      std::sort(v.begin(), v.end());
+
+      if (first) {
+        std::cout << std::left << std::setw(10) << ep.first << std::right
+                  << std::setw(8) << ep.second.size() << std::setw(8)
+                  << errors;
+      } else {
+        std::cout << std::setw(26) << "";
+      }
+      first = false;
+
+      std::cout << "  " << std::left << std::setw(10) << ph.first
+                << std::right << std::setw(10) << percentile(v, 0.5)
+                << std::setw(10) << percentile(v, 0.9) << std::setw(10)
+                << percentile(v, 0.99) << std::setw(10)
+                << (v.empty() ? 0 : v.back()) << "\n";
+    }
+  }
+
+  std::cout << "\nqueue: delay between the recorded start (scaled by the "
+               "replay speed) and the actual start,\nttfb: time until the "
+               "first byte of the answer, transfer: remaining time,\n"
+               "recorded: server-side duration in the recording\n";
+}
+
+// _____________________________________________________________________________
+int main(int argc, char** argv) {
+  // disable output buffering for standard output
+  setbuf(stdout, NULL);
+
+  curl_global_init(CURL_GLOBAL_DEFAULT);
+
+  ReplayState state;
+  state.baseUrl = "http://localhost:9090";
+
+  double speed = 1;
+  size_t numThreads = 4;
+  std::string logFile;
+
+  for (int i = 1; i < argc; i++) {
+    std::string cur = argv[i];
+    if (cur == "-h" || cur == "--help") {
+      printHelp(argc, argv);
+      exit(0);
+    } else if (cur == "-u") {
+      if (++i >= argc) {
+        LOG(ERROR) << "Missing argument for server url (-u).";
+        exit(1);
+      }
+      state.baseUrl = argv[i];
+    } else if (cur == "-b") {
+      if (++i >= argc) {
+        LOG(ERROR) << "Missing argument for backend (-b).";
+        exit(1);
+      }
+      state.backend = argv[i];
+    } else if (cur == "-s") {
+      if (++i >= argc) {
+        LOG(ERROR) << "Missing argument for speed (-s).";
+        exit(1);
+      }
+      speed = atof(argv[i]);
+    } else if (cur == "-j") {
+      if (++i >= argc) {
+        LOG(ERROR) << "Missing argument for concurrency (-j).";
+        exit(1);
+      }
+      numThreads = std::max(1, atoi(argv[i]));
+    } else {
+      logFile = cur;
+    }
+  }
+
+  if (logFile.empty()) {
+    printHelp(argc, argv);
+    exit(1);
+  }
+
+  while (state.baseUrl.size() && state.baseUrl.back() == '/') {
+    state.baseUrl.pop_back();
+  }
+
+  state.entries = RequestLog::read(logFile);
+
+  // the log is written in order of completion
+  std::stable_sort(state.entries.begin(), state.entries.end(),
+                   [](const RequestLogEntry& a, const RequestLogEntry& b) {
+                     return a.start < b.start;
+                   });
+
+  for (const auto& e : state.entries) {
+    if (e.endpoint == "/query" && e.session.size()) {
+      state.logSessions.insert(e.session);
+    }
+  }
+
+  state.results.resize(state.entries.size());
+  state.scheduled.resize(state.entries.size());
+
+  LOG(INFO) << "[REPLAY] Replaying " << state.entries.size()
+            << " requests against " << state.baseUrl << " with " << numThreads
+            << " connections...";
+
+  std::vector<std::thread> thrds;
+  for (size_t i = 0; i < numThreads; i++) {
+    thrds.push_back(std::thread(replay, &state));
+  }
+
+  auto t0 = Clock::now();
+  double first = state.entries.size() ? state.entries.front().start : 0;
+
+  for (size_t i = 0; i < state.entries.size(); i++) {
+    auto at = t0;
+    if (speed > 0) {
+      at += std::chrono::duration_cast<Clock::duration>(
+          std::chrono::duration<double, std::milli>(
+              (state.entries[i].start - first) / speed));
+      std::this_thread::sleep_until(at);
+    }
+
+    std::lock_guard<std::mutex> guard(state.m);
+    state.scheduled[i] = at;
+    state.queue.push_back(i);
+    state.cv.notify_all();
+  }
+
+  {
+    std::lock_guard<std::mutex> guard(state.m);
+    state.done = true;
+    state.cv.notify_all();
+  }
+
+  for (auto& t : thrds) t.join();
+
+  LOG(INFO) << "[REPLAY] ... done in "
+            << std::chrono::duration<double>(Clock::now() - t0).count()
+            << " s";
+
+  printReport(state);
+
+  curl_global_cleanup();
+}
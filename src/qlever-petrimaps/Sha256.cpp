@@ -0,0 +1,127 @@
+// Copyright 2026, agent <agent@local>
+
+#include <string.h>
+
+#include <algorithm>
+#include <cstdio>
+
+#include "qlever-petrimaps/Sha256.h"
+
+using petrimaps::Sha256;
+
+// round constants
+const static uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+// _____________________________________________________________________________
+static inline uint32_t rotr(uint32_t x, int n) {
+  return (x >> n) | (x << (32 - n));
+}
+
+// _____________________________________________________________________________
+Sha256::Sha256() : _len(0), _bufSize(0) {
+  const uint32_t init[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                            0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+  memcpy(_h, init, sizeof(_h));
+}
+
+// _____________________________________________________________________________
+void Sha256::compress(uint32_t* h, const unsigned char* block) {
+  uint32_t w[64];
+  for (size_t i = 0; i < 16; i++) {
+    w[i] = (uint32_t(block[4 * i]) << 24) | (uint32_t(block[4 * i + 1]) << 16) |
+           (uint32_t(block[4 * i + 2]) << 8) | uint32_t(block[4 * i + 3]);
+  }
+  for (size_t i = 16; i < 64; i++) {
+    uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+    uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+    w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+  }
+
+  uint32_t a = h[0], b = h[1], c = h[2], d = h[3];
+  uint32_t e = h[4], f = h[5], g = h[6], k = h[7];
+
+  for (size_t i = 0; i < 64; i++) {
+    uint32_t s1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+    uint32_t ch = (e & f) ^ (~e & g);
+    uint32_t t1 = k + s1 + ch + K[i] + w[i];
+    uint32_t s0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+    uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+    uint32_t t2 = s0 + maj;
+
+    k = g;
+    g = f;
+    f = e;
+    e = d + t1;
+    d = c;
+    c = b;
+    b = a;
+    a = t1 + t2;
+  }
+
+  h[0] += a;
+  h[1] += b;
+  h[2] += c;
+  h[3] += d;
+  h[4] += e;
+  h[5] += f;
+  h[6] += g;
+  h[7] += k;
+}
+
+// _____________________________________________________________________________
+void Sha256::update(const char* data, size_t size) {
+  _len += size;
+
+  while (size > 0) {
+    size_t n = std::min(size, 64 - _bufSize);
+    memcpy(_buf + _bufSize, data, n);
+    _bufSize += n;
+    data += n;
+    size -= n;
+
+    if (_bufSize == 64) {
+      compress(_h, _buf);
+      _bufSize = 0;
+    }
+  }
+}
+
+// _____________________________________________________________________________
+std::string Sha256::hex(size_t bytes) const {
+  // pad a copy of the state, so update() can still be called afterwards
+  uint32_t h[8];
+  memcpy(h, _h, sizeof(h));
+
+  unsigned char block[128];
+  memcpy(block, _buf, _bufSize);
+  size_t size = _bufSize < 56 ? 64 : 128;
+  memset(block + _bufSize, 0, size - _bufSize);
+  block[_bufSize] = 0x80;
+
+  uint64_t bits = _len * 8;
+  for (size_t i = 0; i < 8; i++) {
+    block[size - 1 - i] = static_cast<unsigned char>(bits >> (8 * i));
+  }
+
+  compress(h, block);
+  if (size == 128) compress(h, block + 64);
+
+  std::string ret;
+  char buf[3];
+  for (size_t i = 0; i < std::min<size_t>(bytes, 32); i++) {
+    snprintf(buf, sizeof(buf), "%02x", (h[i / 4] >> (24 - 8 * (i % 4))) & 0xff);
+    ret += buf;
+  }
+  return ret;
+}
@@ -0,0 +1,37 @@
+// Copyright 2026, agent <agent@local>
+
+#ifndef PETRIMAPS_SHA256_H_
+#define PETRIMAPS_SHA256_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+namespace petrimaps {
+
+// Streaming SHA-256 (FIPS 180-4) of a byte sequence, for ids which must not
+// collide even for crafted inputs. See Checksum for a faster, but not
+// collision resistant, checksum.
+class Sha256 {
+ public:
+  Sha256();
+
+  void update(const char* data, size_t size);
+
+  // the first bytes of the digest of all bytes passed to update() so far, as
+  // 2 * bytes hex digits, at most 32 bytes
+  std::string hex(size_t bytes) const;
+
+ private:
+  uint32_t _h[8];
+  uint64_t _len;
+  unsigned char _buf[64];
+  size_t _bufSize;
+
+  static void compress(uint32_t* h, const unsigned char* block);
+};
+
+}  // namespace petrimaps
+
+#endif  // PETRIMAPS_SHA256_H_
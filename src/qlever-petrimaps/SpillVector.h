@@ -0,0 +1,79 @@
+// Copyright 2026, agent <agent@local>
+
+#ifndef PETRIMAPS_SPILLVECTOR_H_
+#define PETRIMAPS_SPILLVECTOR_H_
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace petrimaps {
+
+// Append-only vector of trivially copyable values, stored in fixed-size
+// in-memory segments. On request, full segments are spilled to an
+// (immediately unlinked) temporary file. moveTo() assembles the final
+// std::vector segment by segment, freeing each segment after it was copied.
+template <typename T>
+class SpillVector {
+ public:
+  SpillVector(const SpillVector<T>&) = delete;
+
+  // tmpName is the prefix of the temporary file used for spilling
+  SpillVector(const std::string& tmpName, size_t segmentSize);
+  explicit SpillVector(const std::string& tmpName)
+      : SpillVector(tmpName, 1 << 20) {}
+
+  ~SpillVector();
+
+  void push_back(const T& val) {
+    if (_segments.empty() || _segments.back().size() == _segmentSize) {
+      _segments.push_back(std::vector<T>());
+      _segments.back().reserve(_segmentSize);
+    }
+    _segments.back().push_back(val);
+    _size++;
+  }
+
+  size_t size() const { return _size; }
+
+  // remove all values at positions >= size
+  void truncate(size_t size);
+
+  // write all full in-memory segments to the temporary file
+  void spill();
+
+  // move all values into v (which is replaced), this vector is empty
+  // afterwards
+  void moveTo(std::vector<T>* v);
+
+  void clear();
+
+  // number of bytes held in memory
+  size_t memUsage() const;
+
+ private:
+  std::string _tmpName;
+  size_t _segmentSize;
+  size_t _size;
+
+  // number of segments in the temporary file, the in-memory segments
+  // follow them
+  size_t _numSpilled;
+
+  std::vector<std::vector<T>> _segments;
+
+  std::fstream _file;
+
+  void unspill();
+};
+
+#include "qlever-petrimaps/SpillVector.tpp"
+
+}  // namespace petrimaps
+
+#endif  // PETRIMAPS_SPILLVECTOR_H_
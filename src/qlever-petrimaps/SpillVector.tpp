@@ -0,0 +1,119 @@
+// Copyright 2026, agent <agent@local>
+
+// _____________________________________________________________________________
+template <typename T>
+SpillVector<T>::SpillVector(const std::string& tmpName, size_t segmentSize)
+    : _tmpName(tmpName),
+      _segmentSize(segmentSize),
+      _size(0),
+      _numSpilled(0) {}
+
+// _____________________________________________________________________________
+template <typename T>
+SpillVector<T>::~SpillVector() {
+  if (_file.is_open()) _file.close();
+}
+
+// _____________________________________________________________________________
+template <typename T>
+void SpillVector<T>::truncate(size_t size) {
+  if (size >= _size) return;
+
+  while (_numSpilled * _segmentSize > size) unspill();
+
+  size_t rel = size - _numSpilled * _segmentSize;
+  size_t k = rel / _segmentSize;
+
+  _segments.resize(k + 1);
+  _segments[k].resize(rel % _segmentSize);
+  _size = size;
+}
+
+// _____________________________________________________________________________
+template <typename T>
+void SpillVector<T>::spill() {
+  size_t k = 0;
+  while (k < _segments.size() && _segments[k].size() == _segmentSize) k++;
+
+  if (k == 0) return;
+
+  if (!_file.is_open()) {
+    char* fName = strdup((_tmpName + "XXXXXX").c_str());
+    int fd = mkstemp(fName);
+    if (fd == -1) throw std::runtime_error("Could not create temporary file");
+    _file.open(fName, std::ios::out | std::ios::in | std::ios::binary);
+
+    // immediately unlink
+    unlink(fName);
+    close(fd);
+    free(fName);
+  }
+
+  _file.clear();
+  _file.seekp(_numSpilled * _segmentSize * sizeof(T));
+
+  for (size_t i = 0; i < k; i++) {
+    _file.write(reinterpret_cast<const char*>(&_segments[i][0]),
+                sizeof(T) * _segmentSize);
+  }
+
+  if (!_file.good()) throw std::runtime_error("Could not write spill file");
+
+  _segments.erase(_segments.begin(), _segments.begin() + k);
+  _numSpilled += k;
+}
+
+// _____________________________________________________________________________
+template <typename T>
+void SpillVector<T>::unspill() {
+  std::vector<T> seg(_segmentSize);
+
+  _numSpilled--;
+  _file.clear();
+  _file.seekg(_numSpilled * _segmentSize * sizeof(T));
+  _file.read(reinterpret_cast<char*>(&seg[0]), sizeof(T) * _segmentSize);
+
+  if (!_file.good()) throw std::runtime_error("Could not read spill file");
+
+  _segments.insert(_segments.begin(), std::move(seg));
+}
+
+// _____________________________________________________________________________
+template <typename T>
+void SpillVector<T>::moveTo(std::vector<T>* v) {
+  std::vector<T>().swap(*v);
+  v->reserve(_size);
+
+  if (_numSpilled) {
+    v->resize(_numSpilled * _segmentSize);
+    _file.clear();
+    _file.seekg(0);
+    _file.read(reinterpret_cast<char*>(&(*v)[0]), sizeof(T) * v->size());
+    if (!_file.good()) throw std::runtime_error("Could not read spill file");
+  }
+
+  // free each segment directly after it was copied
+  for (auto& seg : _segments) {
+    v->insert(v->end(), seg.begin(), seg.end());
+    std::vector<T>().swap(seg);
+  }
+
+  clear();
+}
+
+// _____________________________________________________________________________
+template <typename T>
+void SpillVector<T>::clear() {
+  _segments.clear();
+  _size = 0;
+  _numSpilled = 0;
+  if (_file.is_open()) _file.close();
+}
+
+// _____________________________________________________________________________
+template <typename T>
+size_t SpillVector<T>::memUsage() const {
+  size_t ret = 0;
+  for (const auto& seg : _segments) ret += seg.capacity() * sizeof(T);
+  return ret;
+}
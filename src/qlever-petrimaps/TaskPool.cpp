@@ -0,0 +1,183 @@
+// Copyright 2026, agent <agent@local>
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "qlever-petrimaps/TaskPool.h"
+
+using petrimaps::TaskPool;
+
+namespace {
+// the pool and queue of the current worker thread, if any
+thread_local TaskPool* tlsPool = 0;
+thread_local size_t tlsQueue = 0;
+}  // namespace
+
+// _____________________________________________________________________________
+TaskPool::TaskPool(size_t numWorkers)
+    : _pending(0), _nextQueue(0), _stop(false) {
+  for (size_t i = 0; i < numWorkers; i++) {
+    _queues.push_back(std::unique_ptr<Queue>(new Queue()));
+  }
+
+  for (size_t i = 0; i < numWorkers; i++) {
+    _workers.push_back(std::thread(&TaskPool::work, this, i));
+  }
+}
+
+// _____________________________________________________________________________
+TaskPool::~TaskPool() {
+  {
+    std::lock_guard<std::mutex> lock(_m);
+    _stop = true;
+  }
+  _cv.notify_all();
+
+  for (auto& t : _workers) t.join();
+}
+
+// _____________________________________________________________________________
+TaskPool& TaskPool::global() {
+  // the calling thread always participates, so use one worker less
+  static TaskPool pool(
+      std::max(1u, std::thread::hardware_concurrency()) - 1);
+  return pool;
+}
+
+// _____________________________________________________________________________
+void TaskPool::parallelFor(
+    size_t n, size_t grain,
+    const std::function<void(size_t, size_t, size_t)>& f) {
+  if (n == 0) return;
+  if (grain == 0) grain = std::max<size_t>(1, n / (4 * numSlots()));
+
+  size_t numChunks = (n + grain - 1) / grain;
+
+  if (numChunks == 1 || _workers.empty()) {
+    for (size_t b = 0; b < n; b += grain) f(b, std::min(n, b + grain), 0);
+    return;
+  }
+
+  auto job = std::make_shared<Job>();
+  job->f = f;
+  job->n = n;
+  job->grain = grain;
+  job->numChunks = numChunks;
+  job->nextChunk = 0;
+  job->doneChunks = 0;
+  job->participants = 1;
+  job->failed = false;
+
+  size_t helpers = std::min(_workers.size(), numChunks - 1);
+  for (size_t i = 0; i < helpers; i++) {
+    push([job]() { runChunks(job.get(), job->participants++); });
+  }
+
+  // the caller has slot 0
+  runChunks(job.get(), 0);
+
+  {
+    std::unique_lock<std::mutex> lock(job->m);
+    job->cv.wait(lock, [&job]() { return job->doneChunks == job->numChunks; });
+  }
+
+  if (job->ex) std::rethrow_exception(job->ex);
+}
+
+// _____________________________________________________________________________
+void TaskPool::parallelInvoke(const std::vector<std::function<void()>>& fs) {
+  parallelFor(fs.size(), 1, [&fs](size_t begin, size_t end, size_t slot) {
+    (void)slot;
+    for (size_t i = begin; i < end; i++) fs[i]();
+  });
+}
+
+// _____________________________________________________________________________
+void TaskPool::runChunks(Job* job, size_t slot) {
+  while (true) {
+    size_t c = job->nextChunk++;
+    if (c >= job->numChunks) return;
+
+    if (!job->failed) {
+      size_t begin = c * job->grain;
+      size_t end = std::min(job->n, begin + job->grain);
+      try {
+        job->f(begin, end, slot);
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(job->m);
+        if (!job->ex) job->ex = std::current_exception();
+        job->failed = true;
+      }
+    }
+
+    if (++job->doneChunks == job->numChunks) {
+      std::lock_guard<std::mutex> lock(job->m);
+      job->cv.notify_all();
+    }
+  }
+}
+
+// _____________________________________________________________________________
+void TaskPool::push(std::function<void()>&& task) {
+  // workers push to their own queue, other threads distribute round-robin
+  size_t q = tlsPool == this ? tlsQueue : _nextQueue++ % _queues.size();
+
+  {
+    std::lock_guard<std::mutex> lock(_queues[q]->m);
+    _queues[q]->tasks.push_back(std::move(task));
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(_m);
+    _pending++;
+  }
+  _cv.notify_one();
+}
+
+// _____________________________________________________________________________
+bool TaskPool::pop(size_t id, std::function<void()>* task) {
+  // newest task from the own queue first
+  {
+    std::lock_guard<std::mutex> lock(_queues[id]->m);
+    if (!_queues[id]->tasks.empty()) {
+      *task = std::move(_queues[id]->tasks.back());
+      _queues[id]->tasks.pop_back();
+      _pending--;
+      return true;
+    }
+  }
+
+  // otherwise, steal the oldest task of another queue
+  for (size_t i = 1; i < _queues.size(); i++) {
+    size_t q = (id + i) % _queues.size();
+    std::lock_guard<std::mutex> lock(_queues[q]->m);
+    if (!_queues[q]->tasks.empty()) {
+      *task = std::move(_queues[q]->tasks.front());
+      _queues[q]->tasks.pop_front();
+      _pending--;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// _____________________________________________________________________________
+void TaskPool::work(size_t id) {
+  tlsPool = this;
+  tlsQueue = id;
+
+  while (true) {
+    std::function<void()> task;
+    if (pop(id, &task)) {
+      task();
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(_m);
+    _cv.wait(lock, [this]() { return _stop || _pending > 0; });
+    if (_stop && _pending == 0) return;
+  }
+}
@@ -0,0 +1,87 @@
+// Copyright 2026, agent <agent@local>
+
+#ifndef PETRIMAPS_TASKPOOL_H_
+#define PETRIMAPS_TASKPOOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace petrimaps {
+
+// Process-wide pool of worker threads with per-worker work-stealing task
+// queues. Parallel loops split their range into chunks, which are claimed
+// by the calling thread and by helper tasks running on idle workers. As the
+// caller always participates, parallel loops may be nested and may be
+// started from any thread, without oversubscribing the CPU.
+class TaskPool {
+ public:
+  explicit TaskPool(size_t numWorkers);
+  ~TaskPool();
+
+  TaskPool(const TaskPool&) = delete;
+  TaskPool& operator=(const TaskPool&) = delete;
+
+  // the pool shared by the entire process
+  static TaskPool& global();
+
+  // upper bound (exclusive) of the slot ids passed to parallelFor()
+  size_t numSlots() const { return _workers.size() + 1; }
+
+  // call f(begin, end, slot) for chunks [begin, end) of at most grain
+  // indices covering [0, n). Concurrent calls of f within one parallelFor()
+  // get distinct slots < numSlots(). If grain is 0, a grain size is chosen
+  // automatically. Returns when all chunks are done, the first exception
+  // thrown by f is rethrown.
+  void parallelFor(size_t n, size_t grain,
+                   const std::function<void(size_t, size_t, size_t)>& f);
+
+  // run all functions in fs, possibly in parallel
+  void parallelInvoke(const std::vector<std::function<void()>>& fs);
+
+ private:
+  struct Job {
+    std::function<void(size_t, size_t, size_t)> f;
+    size_t n;
+    size_t grain;
+    size_t numChunks;
+    std::atomic<size_t> nextChunk;
+    std::atomic<size_t> doneChunks;
+    std::atomic<size_t> participants;
+    std::atomic<bool> failed;
+    std::mutex m;
+    std::condition_variable cv;
+    std::exception_ptr ex;
+  };
+
+  struct Queue {
+    std::mutex m;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  std::vector<std::thread> _workers;
+  std::vector<std::unique_ptr<Queue>> _queues;
+
+  std::atomic<size_t> _pending;
+  std::atomic<size_t> _nextQueue;
+  bool _stop;
+
+  std::mutex _m;
+  std::condition_variable _cv;
+
+  void work(size_t id);
+  void push(std::function<void()>&& task);
+  bool pop(size_t id, std::function<void()>* task);
+
+  static void runChunks(Job* job, size_t slot);
+};
+
+}  // namespace petrimaps
+
+#endif  // PETRIMAPS_TASKPOOL_H_
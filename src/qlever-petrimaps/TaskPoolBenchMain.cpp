@@ -0,0 +1,172 @@
+// Copyright 2026, agent <agent@local>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "qlever-petrimaps/TaskPool.h"
+#include "util/Misc.h"
+#include "util/log/Log.h"
+
+using petrimaps::TaskPool;
+
+typedef std::chrono::steady_clock Clock;
+
+// prevents the workload from being optimized away
+static std::atomic<uint64_t> sink(0);
+
+// _____________________________________________________________________________
+void printHelp(int argc, char** argv) {
+  UNUSED(argc);
+  std::cout << "Usage: " << argv[0]
+            << " [-n <num>] [-r <num>] [-c <num>] [-g <num>] [--help] [-h]"
+            << "\n";
+  std::cout
+      << "\nRuns 1, 2, 4, ... concurrent parallelFor() workloads on the "
+         "global task pool and reports the throughput per concurrency.\n"
+      << "\nAllowed arguments:\n    -n <num>     indices per parallelFor() "
+         "(default: 4194304)"
+      << "\n    -r <num>     parallelFor() calls per concurrent caller "
+         "(default: 8)"
+      << "\n    -c <num>     max number of concurrent callers (default: 2 "
+         "times the number of pool slots)"
+      << "\n    -g <num>     grain size, 0 chooses it automatically "
+         "(default: 0)\n";
+}
+
+// _____________________________________________________________________________
+uint64_t mix(uint64_t x) {
+  // splitmix64 finalizer, a cheap and branch-free per-index workload
+  x += 0x9e3779b97f4a7c15ull;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+  return x ^ (x >> 31);
+}
+
+// _____________________________________________________________________________
+double runWorkload(TaskPool* pool, size_t n, size_t grain) {
+  auto start = Clock::now();
+
+  std::vector<uint64_t> sums(pool->numSlots(), 0);
+  pool->parallelFor(n, grain, [&](size_t b, size_t e, size_t slot) {
+    uint64_t sum = 0;
+    for (size_t i = b; i < e; i++) sum += mix(i);
+    sums[slot] += sum;
+  });
+
+  uint64_t sum = 0;
+  for (auto s : sums) sum += s;
+  sink += sum;
+
+  return std::chrono::duration<double, std::milli>(Clock::now() - start)
+      .count();
+}
+
+// _____________________________________________________________________________
+int main(int argc, char** argv) {
+  // disable output buffering for standard output
+  setbuf(stdout, NULL);
+
+  auto& pool = TaskPool::global();
+
+  size_t n = 1 << 22;
+  size_t reps = 8;
+  size_t maxCallers = 2 * pool.numSlots();
+  size_t grain = 0;
+
+  for (int i = 1; i < argc; i++) {
+    std::string cur = argv[i];
+    if (cur == "-h" || cur == "--help") {
+      printHelp(argc, argv);
+      exit(0);
+    } else if (cur == "-n") {
+      if (++i >= argc) {
+        LOG(ERROR) << "Missing argument for number of indices (-n).";
+        exit(1);
+      }
+      n = std::max(1, atoi(argv[i]));
+    } else if (cur == "-r") {
+      if (++i >= argc) {
+        LOG(ERROR) << "Missing argument for repetitions (-r).";
+        exit(1);
+      }
+      reps = std::max(1, atoi(argv[i]));
+    } else if (cur == "-c") {
+      if (++i >= argc) {
+        LOG(ERROR) << "Missing argument for concurrency (-c).";
+        exit(1);
+      }
+      maxCallers = std::max(1, atoi(argv[i]));
+    } else if (cur == "-g") {
+      if (++i >= argc) {
+        LOG(ERROR) << "Missing argument for grain size (-g).";
+        exit(1);
+      }
+      grain = std::max(0, atoi(argv[i]));
+    } else {
+      printHelp(argc, argv);
+      exit(1);
+    }
+  }
+
+  std::vector<size_t> callers;
+  for (size_t c = 1; c < maxCallers; c *= 2) callers.push_back(c);
+  callers.push_back(maxCallers);
+
+  std::cout << pool.numSlots() << " pool slots, " << n << " indices per "
+            << "workload, " << reps << " workloads per caller\n";
+
+  // warm up the workers
+  runWorkload(&pool, n, grain);
+
+  std::cout << std::fixed << std::setprecision(1);
+  std::cout << "\n"
+            << std::right << std::setw(8) << "callers" << std::setw(12)
+            << "Mindex/s" << std::setw(10) << "speedup" << std::setw(10)
+            << "p50" << std::setw(10) << "max"
+            << "  (ms per workload)\n";
+
+  double base = 0;
+
+  for (size_t c : callers) {
+    std::vector<std::vector<double>> lat(c);
+    std::vector<std::thread> threads;
+
+    auto start = Clock::now();
+    for (size_t i = 0; i < c; i++) {
+      threads.push_back(std::thread([&, i]() {
+        for (size_t r = 0; r < reps; r++) {
+          lat[i].push_back(runWorkload(&pool, n, grain));
+        }
+      }));
+    }
+    for (auto& t : threads) t.join();
+    double secs =
+        std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::vector<double> all;
+    for (const auto& l : lat) all.insert(all.end(), l.begin(), l.end());
+    std::sort(all.begin(), all.end());
+
+    double tput = c * reps * n / secs / 1000000.0;
+    if (base == 0) base = tput;
+
+    std::cout << std::setw(8) << c << std::setw(12) << tput << std::setw(9)
+              << tput / base << "x" << std::setw(10)
+              << all[all.size() / 2] << std::setw(10) << all.back() << "\n";
+  }
+
+  std::cout << "\nspeedup: throughput relative to a single caller, which "
+               "already uses all pool slots.\nIt should stay close to 1x as "
+               "the number of callers grows.\n";
+
+  LOG(DEBUG) << "Checksum " << sink;
+
+  return 0;
+}
@@ -0,0 +1,41 @@
+// Copyright 2026, agent <agent@local>
+
+#ifndef PETRIMAPS_TESTUTIL_H_
+#define PETRIMAPS_TESTUTIL_H_
+
+#include <stddef.h>
+
+#include <iostream>
+#include <string>
+
+namespace petrimaps {
+namespace test {
+
+// number of failed checks so far
+inline size_t& failures() {
+  static size_t n = 0;
+  return n;
+}
+
+// _____________________________________________________________________________
+inline void check(bool ok, const std::string& what) {
+  if (ok) return;
+  std::cerr << "FAILED: " << what << "\n";
+  failures()++;
+}
+
+// report the checks, the exit code of a test main
+inline int result() {
+  if (failures()) {
+    std::cerr << failures() << " checks failed\n";
+    return 1;
+  }
+
+  std::cout << "All checks passed\n";
+  return 0;
+}
+
+}  // namespace test
+}  // namespace petrimaps
+
+#endif  // PETRIMAPS_TESTUTIL_H_
@@ -0,0 +1,160 @@
+// Copyright 2026, agent <agent@local>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "qlever-petrimaps/server/ClusterIndex.h"
+#include "qlever-petrimaps/server/RenderCache.h"
+
+using petrimaps::ClusterIndex;
+using petrimaps::PointCluster;
+
+// highest zoom level for which clusters are built
+const static int CLUSTER_MAX_ZOOM = 16;
+
+// side length of a cluster cell in pixels of its zoom level
+const static double CLUSTER_CELL_PX = 16;
+
+// a level is only stored if it has at most this many clusters per point
+const static double CLUSTER_MAX_RATIO = 0.5;
+
+const static uint64_t CELL_MASK = 0xFFFFFFFF;
+
+// _____________________________________________________________________________
+void ClusterIndex::build(size_t n,
+                         const std::function<void(const AddFunc&)>& each,
+                         size_t maxMemory) {
+  _levels.clear();
+  _levels.resize(CLUSTER_MAX_ZOOM + 1);
+  _maxZoom = -1;
+
+  if (n == 0) return;
+
+  // (cell key, cluster) of the current level, the highest level is filled
+  // directly from the points
+  std::vector<std::pair<uint64_t, PointCluster>> cur;
+  checkMem(n * sizeof(cur[0]), maxMemory);
+  cur.reserve(n);
+
+  each([&cur](const util::geo::FPoint& p, ID_TYPE oid) {
+    cur.push_back({cellKey(p, CLUSTER_MAX_ZOOM), {p, oid, 1}});
+  });
+
+  for (int z = CLUSTER_MAX_ZOOM; z >= 0; z--) {
+    if (z < CLUSTER_MAX_ZOOM) {
+      // each cell of level z covers 2x2 cells of level z + 1
+      for (auto& c : cur) {
+        c.first = ((c.first >> 33) << 32) | ((c.first & CELL_MASK) >> 1);
+      }
+    }
+
+    // also order by object id to make the merge order deterministic
+    std::sort(cur.begin(), cur.end(),
+              [](const std::pair<uint64_t, PointCluster>& a,
+                 const std::pair<uint64_t, PointCluster>& b) {
+                if (a.first != b.first) return a.first < b.first;
+                return a.second.oid < b.second.oid;
+              });
+
+    size_t out = 0;
+    for (size_t a = 0; a < cur.size();) {
+      double x = 0, y = 0;
+      uint64_t num = 0;
+      size_t b = a;
+
+      for (; b < cur.size() && cur[b].first == cur[a].first; b++) {
+        x += cur[b].second.pos.getX() * cur[b].second.num;
+        y += cur[b].second.pos.getY() * cur[b].second.num;
+        num += cur[b].second.num;
+      }
+
+      // the smallest object id is the one of the first member
+      cur[out] = {cur[a].first,
+                  {{static_cast<float>(x / num), static_cast<float>(y / num)},
+                   cur[a].second.oid,
+                   static_cast<uint32_t>(num)}};
+      out++;
+      a = b;
+    }
+    cur.resize(out);
+
+    if (cur.size() > n * CLUSTER_MAX_RATIO) continue;
+
+    if (_maxZoom < 0) _maxZoom = z;
+
+    checkMem(cur.size() * (sizeof(uint64_t) + sizeof(PointCluster)),
+             maxMemory);
+
+    auto& level = _levels[z];
+    level.keys.reserve(cur.size());
+    level.clusters.reserve(cur.size());
+    for (const auto& c : cur) {
+      level.keys.push_back(c.first);
+      level.clusters.push_back(c.second);
+    }
+  }
+}
+
+// _____________________________________________________________________________
+int ClusterIndex::zoomLevel(double res) const {
+  if (!(res > 0) || _maxZoom < 0) return -1;
+
+  int z = std::floor(std::log2(RenderCache::zoomRes(0) / res) + 0.5);
+  if (z < 0) z = 0;
+  if (z > _maxZoom) return -1;
+
+  return z;
+}
+
+// _____________________________________________________________________________
+void ClusterIndex::get(int z, const util::geo::FBox& box,
+                       std::vector<const PointCluster*>* ret) const {
+  if (z < 0 || z > _maxZoom) return;
+  const auto& level = _levels[z];
+
+  uint64_t ll = cellKey(box.getLowerLeft(), z);
+  uint64_t ur = cellKey(box.getUpperRight(), z);
+
+  // also return the clusters of the adjacent cells, their markers may
+  // reach into box
+  uint64_t xBeg = std::max<uint64_t>(ll & CELL_MASK, 1) - 1;
+  uint64_t yBeg = std::max<uint64_t>(ll >> 32, 1) - 1;
+  uint64_t xEnd = std::min<uint64_t>(ur & CELL_MASK, CELL_MASK - 1) + 1;
+  uint64_t yEnd = std::min<uint64_t>(ur >> 32, CELL_MASK - 1) + 1;
+
+  for (uint64_t y = yBeg; y <= yEnd; y++) {
+    auto it = std::lower_bound(level.keys.begin(), level.keys.end(),
+                               (y << 32) | xBeg);
+    for (; it != level.keys.end() && *it <= ((y << 32) | xEnd); it++) {
+      ret->push_back(&level.clusters[it - level.keys.begin()]);
+    }
+  }
+}
+
+// _____________________________________________________________________________
+size_t ClusterIndex::memUsage() const {
+  size_t ret = 0;
+  for (const auto& level : _levels) {
+    ret += level.keys.capacity() * sizeof(uint64_t) +
+           level.clusters.capacity() * sizeof(PointCluster);
+  }
+  return ret;
+}
+
+// _____________________________________________________________________________
+double ClusterIndex::cellSize(int z) {
+  return CLUSTER_CELL_PX * RenderCache::zoomRes(z);
+}
+
+// _____________________________________________________________________________
+uint64_t ClusterIndex::cellKey(const util::geo::FPoint& p, int z) {
+  double s = cellSize(z);
+  double x = std::floor((p.getX() + WEB_MERC_EXT) / s);
+  double y = std::floor((p.getY() + WEB_MERC_EXT) / s);
+
+  uint64_t cx = std::min<double>(CELL_MASK, std::max(0.0, x));
+  uint64_t cy = std::min<double>(CELL_MASK, std::max(0.0, y));
+
+  return (cy << 32) | cx;
+}
@@ -0,0 +1,76 @@
+// Copyright 2026, agent <agent@local>
+
+#ifndef PETRIMAPS_SERVER_CLUSTERINDEX_H_
+#define PETRIMAPS_SERVER_CLUSTERINDEX_H_
+
+#include <stdint.h>
+
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include "qlever-petrimaps/Misc.h"
+#include "util/geo/Geo.h"
+
+namespace petrimaps {
+
+// A cluster of result points at some zoom level.
+struct PointCluster {
+  // centroid of the members
+  util::geo::FPoint pos;
+  // representative member, the member with the smallest object id
+  ID_TYPE oid;
+  // number of members
+  uint32_t num;
+};
+
+// Hierarchical clustering of the result points, one level per web mercator
+// zoom level. At each level, the points falling into the same cell of a
+// world-aligned grid (CLUSTER_CELL_PX pixels at this zoom level) are merged.
+// Each cell is exactly 4 cells of the level above, so level z is built from
+// level z + 1 alone.
+//
+// Levels at which clustering would reduce the number of points by less than
+// half are not stored; maxZoom() is the highest stored level, all levels below
+// it are stored as well.
+class ClusterIndex {
+ public:
+  typedef std::function<void(const util::geo::FPoint&, ID_TYPE)> AddFunc;
+
+  ClusterIndex() {}
+
+  // build the index over n points, which each() passes to its argument as
+  // (position, object id)
+  void build(size_t n, const std::function<void(const AddFunc&)>& each,
+             size_t maxMemory);
+
+  // highest stored zoom level, -1 if no level is stored
+  int maxZoom() const { return _maxZoom; }
+
+  // stored zoom level for images of resolution res, or -1
+  int zoomLevel(double res) const;
+
+  // clusters of zoom level z whose cell intersects box
+  void get(int z, const util::geo::FBox& box,
+           std::vector<const PointCluster*>* ret) const;
+
+  // approximate memory usage in bytes
+  size_t memUsage() const;
+
+ private:
+  struct Level {
+    // row-major cell keys (y << 32 | x), sorted
+    std::vector<uint64_t> keys;
+    std::vector<PointCluster> clusters;
+  };
+
+  std::vector<Level> _levels;
+  int _maxZoom = -1;
+
+  static double cellSize(int z);
+  static uint64_t cellKey(const util::geo::FPoint& p, int z);
+};
+
+}  // namespace petrimaps
+
+#endif  // PETRIMAPS_SERVER_CLUSTERINDEX_H_
@@ -0,0 +1,91 @@
+// Copyright 2026, agent <agent@local>
+
+#include <algorithm>
+#include <cmath>
+
+#include "qlever-petrimaps/server/RenderCache.h"
+
+using petrimaps::RenderCache;
+using petrimaps::ZoomRaster;
+
+// max relative difference between a requested resolution and the resolution
+// of a zoom level to still use the raster of this zoom level
+const static double ZOOM_RES_TOLERANCE = 0.01;
+
+// _____________________________________________________________________________
+double RenderCache::zoomRes(int z) {
+  return (2 * WEB_MERC_EXT) / (256.0 * (int64_t(1) << z));
+}
+
+// _____________________________________________________________________________
+int RenderCache::zoomLevel(double res) {
+  if (!(res > 0)) return -1;
+
+  int z = std::round(std::log2((2 * WEB_MERC_EXT) / (256.0 * res)));
+  if (z < 0 || z > 30) return -1;
+
+  if (fabs(zoomRes(z) - res) / res > ZOOM_RES_TOLERANCE) return -1;
+
+  return z;
+}
+
+// _____________________________________________________________________________
+void RenderCache::put(std::shared_ptr<const ZoomRaster> raster) {
+  std::lock_guard<std::mutex> guard(_m);
+  _rasters[raster->zoom] = raster;
+}
+
+// _____________________________________________________________________________
+std::shared_ptr<const ZoomRaster> RenderCache::get(int z) const {
+  std::lock_guard<std::mutex> guard(_m);
+  auto it = _rasters.find(z);
+  if (it == _rasters.end()) return nullptr;
+  return it->second;
+}
+
+// _____________________________________________________________________________
+void RenderCache::draw(const ZoomRaster& raster, const util::geo::DBox& bbox,
+                       int w, int h, std::vector<uint32_t>& points,
+                       std::vector<double>& points2) {
+  double res = zoomRes(raster.zoom);
+
+  // offset of the requested image in the raster
+  int64_t dx =
+      std::llround((bbox.getLowerLeft().getX() + WEB_MERC_EXT) / res) -
+      raster.x0;
+  int64_t dy =
+      std::llround((WEB_MERC_EXT - bbox.getUpperRight().getY()) / res) -
+      raster.y0;
+
+  int64_t rxBeg = std::max<int64_t>(0, dx);
+  int64_t rxEnd = std::min<int64_t>(raster.w, dx + w);
+  if (rxBeg >= rxEnd) return;
+
+  int64_t qyBeg = std::max<int64_t>(0, -dy);
+  int64_t qyEnd = std::min<int64_t>(h, raster.h - dy);
+
+  for (int64_t qy = qyBeg; qy < qyEnd; qy++) {
+    uint64_t rowBeg = (qy + dy) * raster.w;
+
+    auto it = std::lower_bound(raster.pixels.begin(), raster.pixels.end(),
+                               rowBeg + rxBeg);
+
+    for (; it != raster.pixels.end() && *it < rowBeg + rxEnd; it++) {
+      size_t qx = *it - rowBeg - dx;
+      size_t p = qy * w + qx;
+      if (points2[p] == 0) points.push_back(p);
+      points2[p] += raster.weights[it - raster.pixels.begin()];
+    }
+  }
+}
+
+// _____________________________________________________________________________
+size_t RenderCache::memUsage() const {
+  std::lock_guard<std::mutex> guard(_m);
+  size_t ret = 0;
+  for (const auto& r : _rasters) {
+    ret += r.second->pixels.capacity() * sizeof(uint32_t) +
+           r.second->weights.capacity() * sizeof(float);
+  }
+  return ret;
+}
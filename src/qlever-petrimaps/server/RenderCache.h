@@ -0,0 +1,65 @@
+// Copyright 2026, agent <agent@local>
+
+#ifndef PETRIMAPS_SERVER_RENDERCACHE_H_
+#define PETRIMAPS_SERVER_RENDERCACHE_H_
+
+#include <stdint.h>
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "util/geo/Geo.h"
+
+namespace petrimaps {
+
+// half the side length of the web mercator world square
+const static double WEB_MERC_EXT = 20037508.342789244;
+
+// Sparse raster of the accumulated point weights of a session, rendered at
+// the resolution of a web mercator zoom level. Pixel coordinates are relative
+// to the upper left corner of the world at this zoom level.
+struct ZoomRaster {
+  int zoom;
+
+  // upper left pixel and size of the raster
+  int64_t x0, y0;
+  size_t w, h;
+
+  // non-zero pixels (y * w + x), sorted, and their weights
+  std::vector<uint32_t> pixels;
+  std::vector<float> weights;
+};
+
+// Per-session store of pre-rendered zoom rasters, safe for concurrent use.
+class RenderCache {
+ public:
+  // resolution (web mercator units per pixel) of zoom level z
+  static double zoomRes(int z);
+
+  // zoom level with resolution res, or -1 if res matches no zoom level
+  static int zoomLevel(double res);
+
+  void put(std::shared_ptr<const ZoomRaster> raster);
+
+  // raster for zoom level z, or nullptr
+  std::shared_ptr<const ZoomRaster> get(int z) const;
+
+  // add the pixels of raster inside the w x h image of bbox to points and
+  // points2, in the layout used by Server::drawPoint()
+  static void draw(const ZoomRaster& raster, const util::geo::DBox& bbox,
+                   int w, int h, std::vector<uint32_t>& points,
+                   std::vector<double>& points2);
+
+  // approximate memory usage in bytes
+  size_t memUsage() const;
+
+ private:
+  mutable std::mutex _m;
+  std::map<int, std::shared_ptr<const ZoomRaster>> _rasters;
+};
+
+}  // namespace petrimaps
+
+#endif  // PETRIMAPS_SERVER_RENDERCACHE_H_
@@ -0,0 +1,119 @@
+// Copyright 2026, agent <agent@local>
+
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <stdexcept>
+
+#include "qlever-petrimaps/server/RequestLog.h"
+
+using petrimaps::RequestLog;
+using petrimaps::RequestLogEntry;
+
+// _____________________________________________________________________________
+RequestLog::RequestLog(const std::string& path)
+    : _created(std::chrono::steady_clock::now()),
+      _out(path, std::ios::out | std::ios::app) {
+  if (!_out.good()) {
+    throw std::runtime_error("Could not open request log " + path);
+  }
+}
+
+// _____________________________________________________________________________
+void RequestLog::log(std::chrono::steady_clock::time_point start,
+                     const std::string& endpoint, int status,
+                     const std::string& session, const std::string& url,
+                     const std::string& payload) {
+  auto end = std::chrono::steady_clock::now();
+
+  double startMs =
+      std::chrono::duration<double, std::milli>(start - _created).count();
+  double durMs = std::chrono::duration<double, std::milli>(end - start).count();
+
+  std::stringstream line;
+  line.setf(std::ios::fixed);
+  line.precision(3);
+  line << startMs << '\t' << endpoint << '\t' << durMs << '\t' << status
+       << '\t' << session << '\t' << encode(url) << '\t' << encode(payload)
+       << '\n';
+
+  std::lock_guard<std::mutex> guard(_m);
+  _out << line.str();
+  _out.flush();
+}
+
+// _____________________________________________________________________________
+std::vector<RequestLogEntry> RequestLog::read(const std::string& path) {
+  std::ifstream in(path);
+  if (!in.good()) {
+    throw std::runtime_error("Could not open request log " + path);
+  }
+
+  std::vector<RequestLogEntry> ret;
+  std::string line;
+  size_t lineNum = 0;
+
+  while (std::getline(in, line)) {
+    lineNum++;
+    if (line.empty()) continue;
+
+    // fields may be empty
+    std::vector<std::string> fields(1);
+    for (char c : line) {
+      if (c == '\t') {
+        fields.push_back("");
+      } else {
+        fields.back() += c;
+      }
+    }
+
+    if (fields.size() < 7) {
+      std::stringstream ss;
+      ss << "Malformed request log line " << lineNum << " in " << path;
+      throw std::runtime_error(ss.str());
+    }
+
+    RequestLogEntry e;
+    e.start = std::atof(fields[0].c_str());
+    e.endpoint = fields[1];
+    e.duration = std::atof(fields[2].c_str());
+    e.status = std::atoi(fields[3].c_str());
+    e.session = fields[4];
+    e.url = decode(fields[5]);
+    e.payload = decode(fields[6]);
+    ret.push_back(e);
+  }
+
+  return ret;
+}
+
+// _____________________________________________________________________________
+std::string RequestLog::encode(const std::string& s) {
+  std::string ret;
+  ret.reserve(s.size());
+  for (unsigned char c : s) {
+    if (c < 0x20 || c == '%' || c == 0x7f) {
+      char buf[4];
+      snprintf(buf, sizeof(buf), "%%%02X", c);
+      ret += buf;
+    } else {
+      ret += c;
+    }
+  }
+  return ret;
+}
+
+// _____________________________________________________________________________
+std::string RequestLog::decode(const std::string& s) {
+  std::string ret;
+  ret.reserve(s.size());
+  for (size_t i = 0; i < s.size(); i++) {
+    if (s[i] == '%' && i + 2 < s.size()) {
+      ret += static_cast<char>(std::strtol(s.substr(i + 1, 2).c_str(), 0, 16));
+      i += 2;
+    } else {
+      ret += s[i];
+    }
+  }
+  return ret;
+}
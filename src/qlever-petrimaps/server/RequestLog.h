@@ -0,0 +1,60 @@
+// Copyright 2026, agent <agent@local>
+
+#ifndef PETRIMAPS_SERVER_REQUESTLOG_H_
+#define PETRIMAPS_SERVER_REQUESTLOG_H_
+
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace petrimaps {
+
+// A single logged request. The log is a text file with one tab-separated
+// line per request:
+//
+//   <start ms> <endpoint> <duration ms> <status> <session> <url> <payload>
+//
+// The start time is relative to the creation of the log. session is the id
+// of the session created by a /query request, and empty for all other
+// endpoints. The payload is percent-encoded.
+struct RequestLogEntry {
+  double start;
+  std::string endpoint;
+  double duration;
+  int status;
+  std::string session;
+  std::string url;
+  std::string payload;
+};
+
+// Thread-safe writer for request logs.
+class RequestLog {
+ public:
+  explicit RequestLog(const std::string& path);
+
+  // time point to be passed as start to log()
+  std::chrono::steady_clock::time_point now() const {
+    return std::chrono::steady_clock::now();
+  }
+
+  void log(std::chrono::steady_clock::time_point start,
+           const std::string& endpoint, int status, const std::string& session,
+           const std::string& url, const std::string& payload);
+
+  // parse a request log written by this class
+  static std::vector<RequestLogEntry> read(const std::string& path);
+
+ private:
+  std::chrono::steady_clock::time_point _created;
+  std::ofstream _out;
+  std::mutex _m;
+
+  static std::string encode(const std::string& s);
+  static std::string decode(const std::string& s);
+};
+
+}  // namespace petrimaps
+
+#endif  // PETRIMAPS_SERVER_REQUESTLOG_H_
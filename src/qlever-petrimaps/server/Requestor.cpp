@@ -2,28 +2,66 @@
 // Chair of Algorithms and Data Structures.
 // Authors: Patrick Brosi <brosi@informatik.uni-freiburg.de>
 
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
 #include <cstring>
 #include <iostream>
-#include <algorithm>
+#include <numeric>
 #include <regex>
 #include <sstream>
+#include <unordered_set>
 
+#include "qlever-petrimaps/LineSampling.h"
 #include "qlever-petrimaps/Misc.h"
+#include "qlever-petrimaps/MmapVector.h"
+#include "qlever-petrimaps/TaskPool.h"
 #include "qlever-petrimaps/server/Requestor.h"
 #include "util/Misc.h"
 #include "util/geo/Geo.h"
 #include "util/geo/PolyLine.h"
 #include "util/log/Log.h"
-#ifdef _OPENMP
-#include <omp.h>
-#else
-#define omp_get_thread_num() 0
-#endif
 
+using petrimaps::ClusterIndex;
 using petrimaps::GeomCache;
+using petrimaps::MmapVector;
+using petrimaps::PointCluster;
 using petrimaps::Requestor;
 using petrimaps::RequestReader;
 using petrimaps::ResObj;
+using petrimaps::sampleSegment;
+using petrimaps::TaskPool;
+
+// cell sizes of the result grids are chosen between these bounds depending
+// on the density of the result
+const static double MAX_GRID_SIZE = 65536;
+const static double MIN_GRID_SIZE = 1024;
+
+// target average number of objects per occupied grid cell
+const static double GRID_TARGET_OCCUPANCY = 256;
+
+// point grid cells with more objects are sorted by the y offsets of their
+// points, lookups then only scan the rows of the cell they need
+const static size_t SORTED_CELL_SIZE = 1024;
+
+// upper bound for the number of cells of a single grid
+const static double MAX_GRID_CELLS = 1 << 22;
+
+// max number of objects sampled to estimate the density of a result
+const static size_t GRID_SAMPLE_SIZE = 1 << 16;
+
+// approximate distance between the samples of a line in the line point grid
+const static double LINE_SAMPLE_DIST = 600;
+
+// number of ids of the sorted runs of an out-of-core build
+const static size_t ID_RUN_SIZE = 1 << 24;
+
+// number of ids read at once from each run while merging the runs
+const static size_t MERGE_BLOCK_SIZE = 1 << 16;
+
+// number of ids joined with the geom cache at once in an out-of-core build
+const static size_t JOIN_BATCH_SIZE = 1 << 22;
 
 // _____________________________________________________________________________
 void Requestor::request(const std::string& qry) {
@@ -40,49 +78,62 @@ void Requestor::request(const std::string& qry) {
 
   _query = qry;
   _ready = false;
-  _objects.clear();
+  _objects = ObjectTable();
   _clusterObjects.clear();
+  _clusterIndex = ClusterIndex();
 
-  RequestReader reader(_cache->getBackendURL(), _maxMemory);
-  _query = qry;
+  fetchObjects(qry);
 
-  LOG(INFO) << "[REQUESTOR] Requesting IDs for query " << qry;
-  reader.requestIds(prepQuery(qry));
+  LOG(INFO) << "[REQUESTOR] ... done, got " << _objects.size() << " objects ("
+            << _objects.memUsage() << " bytes in memory).";
 
-  LOG(INFO) << "[REQUESTOR] Done, have " << reader._ids.size()
-            << " ids in total.";
+  _buildPhase = BuildGrids;
 
-  // join with geoms from GeomCache
+  // objects that did not fit into memory need out of core grids, too
+  bool outOfCore = _objects.fileBacked();
 
-  // sort by qlever id
-  LOG(INFO) << "[REQUESTOR] Sorting results by qlever ID...";
-  std::sort(reader._ids.begin(), reader._ids.end());
-  LOG(INFO) << "[REQUESTOR] ... done";
+  try {
+    buildGrids(outOfCore ? _spillDir : "");
+  } catch (const OutOfMemoryError& e) {
+    if (_spillDir.empty() || outOfCore) throw;
 
-  LOG(INFO) << "[REQUESTOR] Retrieving geoms from cache...";
+    LOG(INFO) << "[REQUESTOR] " << e.what();
+    LOG(INFO) << "[REQUESTOR] Building out of core and retrying...";
 
-  // (geom id, result row)
-  const auto& ret = _cache->getRelObjects(reader._ids);
-  _objects = ret.first;
-  _numObjects = ret.second;
-  LOG(INFO) << "[REQUESTOR] ... done, got " << _objects.size() << " objects.";
+    _pgrid = petrimaps::Grid<ID_TYPE, float>();
+    _pqgrid = petrimaps::Grid<util::geo::Point<uint16_t>, float>();
+    _lgrid = petrimaps::HierGrid<ID_TYPE, float>();
+    _lpgrid = petrimaps::Grid<util::geo::Point<uint8_t>, float>();
+    std::vector<ClusterObj>().swap(_clusterObjects);
+    _clusterIndex = ClusterIndex();
+
+    moveObjectsOutOfCore();
+    buildGrids(_spillDir);
+  }
+
+  _ready = true;
+  _buildPhase = Done;
+
+  LOG(INFO) << "[REQUESTOR] ...done";
+}
 
+// _____________________________________________________________________________
+void Requestor::buildGrids(const std::string& dir) {
   LOG(INFO) << "[REQUESTOR] Calculating bounding box of result...";
 
-  size_t NUM_THREADS = std::thread::hardware_concurrency();
+  auto& pool = TaskPool::global();
+  size_t NUM_THREADS = pool.numSlots();
 
   std::vector<util::geo::FBox> pointBoxes(NUM_THREADS);
   std::vector<util::geo::DBox> lineBoxes(NUM_THREADS);
   std::vector<size_t> numLines(NUM_THREADS, 0);
   util::geo::FBox pointBbox;
   util::geo::DBox lineBbox;
-  size_t batch = ceil(static_cast<double>(_objects.size()) / NUM_THREADS);
 
-#pragma omp parallel for num_threads(NUM_THREADS) schedule(static)
-  for (size_t t = 0; t < NUM_THREADS; t++) {
-    for (size_t i = batch * t; i < batch * (t + 1) && i < _objects.size();
-         i++) {
-      auto geomId = _objects[i].first;
+  pool.parallelFor(_objects.size(), 1 << 16, [&](size_t b, size_t e,
+                                                  size_t t) {
+    for (size_t i = b; i < e; i++) {
+      auto geomId = _objects.geom(i);
 
       if (geomId < I_OFFSET) {
         auto pId = geomId;
@@ -96,7 +147,7 @@ void Requestor::request(const std::string& qry) {
         numLines[t]++;
       }
     }
-  }
+  });
 
   for (const auto& box : pointBoxes) {
     pointBbox = util::geo::extendBox(box, pointBbox);
@@ -122,9 +173,36 @@ void Requestor::request(const std::string& qry) {
   } else {
     LOG(INFO) << "[REQUESTOR] Line BBox: " << util::geo::getWKT(lineBbox);
   }
-  LOG(INFO) << "[REQUESTOR] Building grid...";
+  LOG(INFO) << "[REQUESTOR] Sampling result density...";
+
+  // sample the positions of the result objects to estimate their density
+  std::vector<util::geo::FPoint> pointSample;
+  std::vector<util::geo::FPoint> lineSample;
+  size_t step = std::max<size_t>(1, _objects.size() / GRID_SAMPLE_SIZE);
+
+  for (size_t i = 0; i < _objects.size(); i += step) {
+    auto geomId = _objects.geom(i);
+    if (geomId < I_OFFSET) {
+      pointSample.push_back(_cache->getPoints()[geomId]);
+    } else if (geomId < std::numeric_limits<ID_TYPE>::max()) {
+      auto box = _cache->getLineBBox(geomId - I_OFFSET);
+      lineSample.push_back(
+          {(box.getLowerLeft().getX() + box.getUpperRight().getX()) / 2,
+           (box.getLowerLeft().getY() + box.getUpperRight().getY()) / 2});
+    }
+  }
+
+  util::geo::FBox fLineBbox = {
+      {lineBbox.getLowerLeft().getX(), lineBbox.getLowerLeft().getY()},
+      {lineBbox.getUpperRight().getX(), lineBbox.getUpperRight().getY()}};
 
-  double GRID_SIZE = 65536;
+  double pGridSize = gridCellSize(pointSample, pointSample.size() * step,
+                                  pointBbox);
+  double lGridSize = gridCellSize(lineSample, lineSample.size() * step,
+                                  fLineBbox);
+
+  LOG(INFO) << "[REQUESTOR] ... done";
+  LOG(INFO) << "[REQUESTOR] Building grid...";
 
   double pw =
       pointBbox.getUpperRight().getX() - pointBbox.getLowerLeft().getX();
@@ -132,87 +210,179 @@ void Requestor::request(const std::string& qry) {
       pointBbox.getUpperRight().getY() - pointBbox.getLowerLeft().getY();
 
   // estimate memory consumption of empty grid
-  double pxWidth = fmax(0, ceil(pw / GRID_SIZE));
-  double pyHeight = fmax(0, ceil(ph / GRID_SIZE));
+  double pxWidth = fmax(0, ceil(pw / pGridSize));
+  double pyHeight = fmax(0, ceil(ph / pGridSize));
 
   double lw = lineBbox.getUpperRight().getX() - lineBbox.getLowerLeft().getX();
   double lh = lineBbox.getUpperRight().getY() - lineBbox.getLowerLeft().getY();
 
   // estimate memory consumption of empty grid
-  double lxWidth = fmax(0, ceil(lw / GRID_SIZE));
-  double lyHeight = fmax(0, ceil(lh / GRID_SIZE));
+  double lxWidth = fmax(0, ceil(lw / lGridSize));
+  double lyHeight = fmax(0, ceil(lh / lGridSize));
 
   LOG(INFO) << "[REQUESTOR] (" << pxWidth << "x" << pyHeight
-            << " cell point grid)";
+            << " cell point grid, cell size " << pGridSize << ")";
   LOG(INFO) << "[REQUESTOR] (" << lxWidth << "x" << lyHeight
-            << " cell line grid)";
+            << " cell line grid, cell size " << lGridSize << ")";
+
+  if (dir.empty()) {
+    checkMem(16 * (pxWidth * pyHeight), _maxMemory);
+    checkMem(8 * HierGrid<ID_TYPE, float>::estimateCells(lGridSize, fLineBbox),
+             _maxMemory);
+    checkMem(8 * (lxWidth * lyHeight), _maxMemory);
+
+    _pgrid = petrimaps::Grid<ID_TYPE, float>(pGridSize, pGridSize, pointBbox);
+    _pqgrid = petrimaps::Grid<util::geo::Point<uint16_t>, float>(
+        pGridSize, pGridSize, pointBbox);
+    _lgrid = petrimaps::HierGrid<ID_TYPE, float>(lGridSize, fLineBbox);
+    _lpgrid = petrimaps::Grid<util::geo::Point<uint8_t>, float>(
+        lGridSize, lGridSize, fLineBbox);
+  } else {
+    LOG(INFO) << "[REQUESTOR] (compact grids in " << dir << ")";
+
+    _pgrid = petrimaps::Grid<ID_TYPE, float>(pGridSize, pGridSize, pointBbox,
+                                             dir);
+    _pqgrid = petrimaps::Grid<util::geo::Point<uint16_t>, float>(
+        pGridSize, pGridSize, pointBbox, dir);
+    _lgrid = petrimaps::HierGrid<ID_TYPE, float>(lGridSize, fLineBbox, dir);
+    _lpgrid = petrimaps::Grid<util::geo::Point<uint8_t>, float>(
+        lGridSize, lGridSize, fLineBbox, dir);
+  }
 
-  checkMem(8 * (pxWidth * pyHeight), _maxMemory);
-  checkMem(8 * (lxWidth * lyHeight), _maxMemory);
-  checkMem(8 * (lxWidth * lyHeight), _maxMemory);
+  // the grids and the cluster index are independent of each other, build
+  // them in parallel
+  std::vector<std::function<void()>> tasks;
+
+  tasks.push_back([this]() {
+    // cluster objects if they have the same geometry, don't do for
+    // multigeoms. The objects are not necessarily sorted by geometry, so
+    // first sort the single point objects by geometry, and keep those whose
+    // geometry occurs more than once. (geom id, object id)
+    std::vector<std::pair<ID_TYPE, ID_TYPE>> clustered;
+
+    for (size_t i = 0; i < _objects.size(); i++) {
+      auto geomId = _objects.geom(i);
+      if (geomId < I_OFFSET && _objects.isSingle(i)) {
+        clustered.push_back({geomId, i});
+      }
 
-  util::geo::FBox fLineBbox = {
-      {lineBbox.getLowerLeft().getX(), lineBbox.getLowerLeft().getY()},
-      {lineBbox.getUpperRight().getX(), lineBbox.getUpperRight().getY()}};
+      // every 100000 objects, check memory...
+      if (i % 100000 == 0) checkMem(1, _maxMemory);
+    }
 
-  _pgrid = petrimaps::Grid<ID_TYPE, float>(GRID_SIZE, GRID_SIZE, pointBbox);
-  _lgrid = petrimaps::Grid<ID_TYPE, float>(GRID_SIZE, GRID_SIZE, fLineBbox);
-  _lpgrid = petrimaps::Grid<util::geo::Point<uint8_t>, float>(
-      GRID_SIZE, GRID_SIZE, fLineBbox);
+    std::sort(clustered.begin(), clustered.end());
 
-  std::exception_ptr ePtr;
+    size_t numClustered = 0;
+    for (size_t a = 0; a < clustered.size();) {
+      size_t b = a + 1;
+      while (b < clustered.size() &&
+             clustered[b].first == clustered[a].first) {
+        b++;
+      }
 
-#pragma omp parallel sections
-  {
-#pragma omp section
-    {
-      size_t j = _objects.size();
+      if (b - a > 1) {
+        std::copy(clustered.begin() + a, clustered.begin() + b,
+                  clustered.begin() + numClustered);
+        numClustered += b - a;
+      }
+
+      a = b;
+    }
+
+    clustered.resize(numClustered);
+    clustered.shrink_to_fit();
+
+    // add to the point grid, and the offset inside the cell to the
+    // offset grid
+    auto add = [this](const util::geo::FPoint& p, ID_TYPE id) {
+      size_t cellX = _pgrid.getCellXFromX(p.getX());
+      size_t cellY = _pgrid.getCellYFromY(p.getY());
+
+      double sXd = (p.getX() - _pgrid.getBBox().getLowerLeft().getX() -
+                    cellX * _pgrid.getCellWidth()) /
+                   (_pgrid.getCellWidth() / 65536);
+      double sYd = (p.getY() - _pgrid.getBBox().getLowerLeft().getY() -
+                    cellY * _pgrid.getCellHeight()) /
+                   (_pgrid.getCellHeight() / 65536);
 
+      uint16_t sX = std::min(65535.0, std::max(0.0, sXd));
+      uint16_t sY = std::min(65535.0, std::max(0.0, sYd));
+
+      _pgrid.add(cellX, cellY, id);
+      _pqgrid.add(cellX, cellY, {sX, sY});
+    };
+
+    auto fill = [&]() {
       for (size_t i = 0; i < _objects.size(); i++) {
-        const auto& p = _objects[i];
-        auto geomId = p.first;
+        auto geomId = _objects.geom(i);
         if (geomId >= I_OFFSET) continue;
 
-        size_t clusterI = 0;
-        // cluster if they have same geometry, don't do for multigeoms
-        while (i < _objects.size() - 1 && geomId == _objects[i + 1].first &&
-               p.second != _objects[i + 1].second) {
-          clusterI++;
-          i++;
+        std::pair<ID_TYPE, ID_TYPE> obj(geomId, i);
+        if (!std::binary_search(clustered.begin(), clustered.end(), obj)) {
+          add(_cache->getPoints()[geomId], i);
         }
 
-        if (clusterI > 0) {
-          for (size_t m = 0; m < clusterI; m++) {
-            const auto& p = _objects[i - m];
-            auto geomId = p.first;
-            _pgrid.add(_cache->getPoints()[geomId], j);
-            _clusterObjects.push_back({i - m, {m, clusterI}});
-            j++;
-          }
-        } else {
-          _pgrid.add(_cache->getPoints()[geomId], i);
+        // every 100000 objects, check memory...
+        if (i % 100000 == 0) checkMem(1, _maxMemory);
+      }
+
+      size_t j = _objects.size();
+      _clusterObjects.clear();
+
+      for (size_t a = 0; a < clustered.size();) {
+        size_t b = a + 1;
+        while (b < clustered.size() &&
+               clustered[b].first == clustered[a].first) {
+          b++;
         }
 
-        // every 100000 objects, check memory...
-        if (i % 100000 == 0) {
-          try {
-            checkMem(1, _maxMemory);
-          } catch (...) {
-#pragma omp critical
-            { ePtr = std::current_exception(); }
-            break;
-          }
+        size_t clusterI = b - a - 1;
+
+        for (size_t m = 0; m < clusterI; m++) {
+          auto oid = clustered[b - 1 - m].second;
+          add(_cache->getPoints()[clustered[a].first], j);
+          _clusterObjects.push_back({oid, static_cast<uint32_t>(m),
+                                     static_cast<uint32_t>(clusterI)});
+          j++;
         }
+
+        a = b;
       }
+    };
+
+    // compact grids first count the values per cell, see Grid
+    fill();
+    if (_pgrid.compact()) {
+      _pgrid.allocate();
+      _pqgrid.allocate();
+      fill();
     }
 
-#pragma omp section
-    {
-      size_t i = 0;
-      for (const auto& l : _objects) {
-        if (l.first >= I_OFFSET &&
-            l.first < std::numeric_limits<ID_TYPE>::max()) {
-          auto geomId = l.first - I_OFFSET;
+    // the uniform cell size is chosen for the average occupancy, dense
+    // parts of the result may still overload single cells
+    for (size_t x = 0; x < _pgrid.getXWidth(); x++) {
+      for (size_t y = 0; y < _pgrid.getYHeight(); y++) {
+        auto qcell = _pqgrid.getCell(x, y);
+        if (qcell.size() <= SORTED_CELL_SIZE) continue;
+
+        std::vector<size_t> order(qcell.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+          return qcell[a].getY() < qcell[b].getY();
+        });
+
+        _pgrid.reorderCell(x, y, order);
+        _pqgrid.reorderCell(x, y, order);
+      }
+    }
+  });
+
+  tasks.push_back([this]() {
+    auto fill = [this]() {
+      for (size_t i = 0; i < _objects.size();) {
+        auto gid = _objects.geom(i);
+        if (gid >= I_OFFSET && gid < std::numeric_limits<ID_TYPE>::max()) {
+          auto geomId = gid - I_OFFSET;
           auto box = _cache->getLineBBox(geomId);
           util::geo::FBox fbox = {
               {box.getLowerLeft().getX(), box.getLowerLeft().getY()},
@@ -222,96 +392,354 @@ void Requestor::request(const std::string& qry) {
         i++;
 
         // every 100000 objects, check memory...
-        if (i % 100000 == 0) {
-          try {
-            checkMem(1, _maxMemory);
-          } catch (...) {
-#pragma omp critical
-            { ePtr = std::current_exception(); }
-            break;
+        if (i % 100000 == 0) checkMem(1, _maxMemory);
+      }
+    };
+
+    fill();
+    if (_lgrid.compact()) {
+      _lgrid.allocate();
+      fill();
+    }
+  });
+
+  tasks.push_back([this]() {
+    double llX = _lpgrid.getBBox().getLowerLeft().getX();
+    double llY = _lpgrid.getBBox().getLowerLeft().getY();
+
+    // sub cells are 1/256th of a grid cell. Between two vertices, a segment
+    // is sampled once per square of size LINE_SAMPLE_DIST it crosses,
+    // independent of the grid cell size, which yields about the same sub
+    // cells as the 600 m densification the line cache used to store
+    double subSize = _lpgrid.getCellWidth() / 256;
+
+    bool first = true;
+    size_t lastCellX = 0;
+    size_t lastCellY = 0;
+    uint8_t lastX = 0;
+    uint8_t lastY = 0;
+
+    auto add = [&](double x, double y) {
+      size_t cellX = _lpgrid.getCellXFromX(x);
+      size_t cellY = _lpgrid.getCellYFromY(y);
+
+      // position inside the cell, in 1/256th of the cell size
+      double sXd = (x - llX - cellX * _lpgrid.getCellWidth()) / subSize;
+      double sYd = (y - llY - cellY * _lpgrid.getCellHeight()) / subSize;
+
+      uint8_t sX = std::min(255.0, std::max(0.0, sXd));
+      uint8_t sY = std::min(255.0, std::max(0.0, sYd));
+
+      if (first || lastCellX != cellX || lastCellY != cellY || lastX != sX ||
+          lastY != sY) {
+        _lpgrid.add(cellX, cellY, {sX, sY});
+        lastCellX = cellX;
+        lastCellY = cellY;
+        lastX = sX;
+        lastY = sY;
+        first = false;
+      }
+    };
+
+    auto fill = [&]() {
+      for (size_t i = 0; i < _objects.size();) {
+        auto gid = _objects.geom(i);
+        if (gid >= I_OFFSET && gid < std::numeric_limits<ID_TYPE>::max()) {
+          auto geomId = gid - I_OFFSET;
+
+          LineReader reader(*_cache, geomId);
+          util::geo::DPoint a, b;
+
+          first = true;
+
+          if (reader.next(&a)) add(a.getX(), a.getY());
+
+          while (reader.next(&b)) {
+            sampleSegment(a, b, llX, llY, LINE_SAMPLE_DIST, add);
+            add(b.getX(), b.getY());
+            a = b;
           }
         }
+        i++;
+
+        // every 100000 objects, check memory...
+        if (i % 100000 == 0) checkMem(1, _maxMemory);
       }
+    };
+
+    fill();
+    if (_lpgrid.compact()) {
+      _lpgrid.allocate();
+      fill();
     }
+  });
 
-#pragma omp section
-    {
-      size_t i = 0;
-      for (const auto& l : _objects) {
-        if (l.first >= I_OFFSET &&
-            l.first < std::numeric_limits<ID_TYPE>::max()) {
-          auto geomId = l.first - I_OFFSET;
+  tasks.push_back([this]() {
+    size_t numPoints = 0;
+    for (size_t i = 0; i < _objects.size(); i++) {
+      if (_objects.geom(i) < I_OFFSET) numPoints++;
+    }
 
-          size_t start = _cache->getLine(geomId);
-          size_t end = _cache->getLineEnd(geomId);
+    auto each = [this](const ClusterIndex::AddFunc& add) {
+      for (size_t i = 0; i < _objects.size(); i++) {
+        auto geomId = _objects.geom(i);
+        if (geomId < I_OFFSET) add(_cache->getPoints()[geomId], i);
+      }
+    };
+
+    // the cluster index is optional, without it the objects style renders
+    // the plain points
+    try {
+      _clusterIndex.build(numPoints, each, _maxMemory);
+    } catch (const OutOfMemoryError& e) {
+      LOG(WARN) << "[REQUESTOR] No cluster index, " << e.what();
+      _clusterIndex = ClusterIndex();
+    }
+  });
 
-          double mainX = 0;
-          double mainY = 0;
+  pool.parallelInvoke(tasks);
 
-          size_t gi = 0;
+  LOG(INFO) << "[REQUESTOR] (cluster index up to zoom level "
+            << _clusterIndex.maxZoom() << ", " << _clusterIndex.memUsage()
+            << " bytes)";
+}
 
-          uint8_t lastX = 0;
-          uint8_t lastY = 0;
+// _____________________________________________________________________________
+void Requestor::fetchObjects(const std::string& query) {
+  RequestReader reader(_backendUrl, _maxMemory);
 
-          for (size_t li = start; li < end; li++) {
-            const auto& cur = _cache->getLinePoints()[li];
+  bool sorted = !_cache->hasQidIndex();
 
-            if (isMCoord(cur.getX())) {
-              mainX = rmCoord(cur.getX());
-              mainY = rmCoord(cur.getY());
-              continue;
-            }
+  // temporary file holding the runs, opened once the ids do not fit into
+  // memory anymore
+  int fd = -1;
 
-            // skip bounding box at beginning
-            if (++gi < 3) continue;
-
-            // extract real geometry
-            util::geo::FPoint curP(
-                (mainX * M_COORD_GRANULARITY + cur.getX()) / 10.0,
-                (mainY * M_COORD_GRANULARITY + cur.getY()) / 10.0);
-
-            size_t cellX = _lpgrid.getCellXFromX(curP.getX());
-            size_t cellY = _lpgrid.getCellYFromY(curP.getY());
-
-            uint8_t sX =
-                (curP.getX() - _lpgrid.getBBox().getLowerLeft().getX() +
-                 cellX * _lpgrid.getCellWidth()) /
-                256;
-            uint8_t sY =
-                (curP.getY() - _lpgrid.getBBox().getLowerLeft().getY() +
-                 cellY * _lpgrid.getCellHeight()) /
-                256;
-
-            if (gi == 3 || lastX != sX || lastY != sY) {
-              _lpgrid.add(cellX, cellY, {sX, sY});
-              lastX = sX;
-              lastY = sY;
-            }
-          }
-        }
-        i++;
+  // [begin, end) of the runs in the temporary file, in ids
+  std::vector<std::pair<size_t, size_t>> runs;
+  size_t numIds = 0;
 
-        // every 100000 objects, check memory...
-        if (i % 100000 == 0) {
-          try {
-            checkMem(1, _maxMemory);
-          } catch (...) {
-#pragma omp critical
-            { ePtr = std::current_exception(); }
-            break;
-          }
+  auto writeRun = [&](std::vector<IdMapping>* ids) {
+    if (ids->empty()) return;
+
+    if (fd == -1) fd = openSpillFile();
+
+    // sort by qlever id, not needed if the cache can look up qids directly
+    if (sorted) std::sort(ids->begin(), ids->end());
+
+    writeIds(fd, numIds, *ids);
+    runs.push_back({numIds, numIds + ids->size()});
+    numIds += ids->size();
+    ids->clear();
+
+    // the ids kept in memory before the first run may have left a much
+    // larger buffer behind
+    if (ids->capacity() > ID_RUN_SIZE) {
+      std::vector<IdMapping>().swap(*ids);
+      ids->reserve(ID_RUN_SIZE);
+    }
+  };
+
+  if (!_spillDir.empty()) {
+    // the ids are kept in memory as long as another run fits, afterwards
+    // the ids received so far and all following ones are written to runs
+    reader.idRunSize = ID_RUN_SIZE;
+    reader.idRunCb = [&](std::vector<IdMapping>* ids) {
+      if (runs.empty()) {
+        try {
+          checkMem(ID_RUN_SIZE * sizeof(IdMapping), _maxMemory);
+          return;
+        } catch (const OutOfMemoryError& e) {
+          LOG(INFO) << "[REQUESTOR] " << e.what();
+          LOG(INFO) << "[REQUESTOR] Continuing out of core in runs of "
+                    << ID_RUN_SIZE << " ids...";
         }
       }
+      writeRun(ids);
+    };
+  }
+
+  try {
+    _buildPhase = FetchIds;
+
+    LOG(INFO) << "[REQUESTOR] Requesting IDs for query " << query;
+    reader.requestIds(prepQuery(query));
+
+    if (!runs.empty()) {
+      writeRun(&reader._ids);
+
+      LOG(INFO) << "[REQUESTOR] Done, have " << numIds << " ids in "
+                << runs.size() << " runs.";
+
+      joinRuns(fd, runs, sorted);
+      close(fd);
+      return;
+    }
+  } catch (...) {
+    if (fd != -1) close(fd);
+    throw;
+  }
+
+  LOG(INFO) << "[REQUESTOR] Done, have " << reader._ids.size()
+            << " ids in total.";
+
+  // join with geoms from GeomCache
+
+  // sort by qlever id, not needed if the cache can look up qids directly
+  if (sorted) {
+    LOG(INFO) << "[REQUESTOR] Sorting results by qlever ID...";
+    std::sort(reader._ids.begin(), reader._ids.end());
+    LOG(INFO) << "[REQUESTOR] ... done";
+  }
+
+  LOG(INFO) << "[REQUESTOR] Retrieving geoms from cache...";
+
+  _buildPhase = JoinGeoms;
+
+  // (geom id, result row)
+  auto ret = _cache->getRelObjects(reader._ids);
+
+  // the ids are not needed anymore
+  std::vector<IdMapping>().swap(reader._ids);
+
+  _objects = ObjectTable(std::move(ret.first));
+  _numObjects = ret.second;
+}
+
+// _____________________________________________________________________________
+void Requestor::joinRuns(int fd, std::vector<std::pair<size_t, size_t>> runs,
+                         bool sorted) {
+  LOG(INFO) << "[REQUESTOR] Retrieving geoms from cache...";
+
+  _buildPhase = JoinGeoms;
+  _numObjects = 0;
+
+  MmapVector<std::pair<ID_TYPE, ID_TYPE>> objs(_spillDir);
+
+  std::vector<IdMapping> batch;
+  batch.reserve(JOIN_BATCH_SIZE);
+
+  auto join = [&]() {
+    // (geom id, result row)
+    auto ret = _cache->getRelObjects(batch);
+    for (const auto& o : ret.first) objs.push_back(o);
+    _numObjects += ret.second;
+    batch.clear();
+  };
+
+  // the next ids of each run
+  std::vector<std::vector<IdMapping>> heads(runs.size());
+  std::vector<size_t> headPos(runs.size(), 0);
+
+  auto refill = [&](size_t r) {
+    size_t n = std::min(MERGE_BLOCK_SIZE, runs[r].second - runs[r].first);
+    readIds(fd, runs[r].first, n, &heads[r]);
+    runs[r].first += n;
+    headPos[r] = 0;
+    return n > 0;
+  };
+
+  // the batches are sorted, as the sorted join expects them, if the runs
+  // are merged by qid. Otherwise, the runs are simply concatenated
+  auto cmp = [&](size_t a, size_t b) {
+    return heads[b][headPos[b]] < heads[a][headPos[a]];
+  };
+  std::vector<size_t> heap;
+
+  for (size_t r = 0; r < runs.size(); r++) {
+    if (!refill(r)) continue;
+    if (!sorted) {
+      do {
+        if (batch.size() + heads[r].size() > JOIN_BATCH_SIZE) join();
+        batch.insert(batch.end(), heads[r].begin(), heads[r].end());
+      } while (refill(r));
+    } else {
+      heap.push_back(r);
+    }
+  }
+
+  std::make_heap(heap.begin(), heap.end(), cmp);
+
+  while (!heap.empty()) {
+    std::pop_heap(heap.begin(), heap.end(), cmp);
+    size_t r = heap.back();
+
+    batch.push_back(heads[r][headPos[r]]);
+    if (batch.size() >= JOIN_BATCH_SIZE) join();
+
+    if (++headPos[r] < heads[r].size() || refill(r)) {
+      std::push_heap(heap.begin(), heap.end(), cmp);
+    } else {
+      heap.pop_back();
     }
   }
 
-  if (ePtr) {
-    std::rethrow_exception(ePtr);
+  join();
+
+  _objects = ObjectTable(objs, _spillDir);
+}
+
+// _____________________________________________________________________________
+void Requestor::moveObjectsOutOfCore() {
+  MmapVector<std::pair<ID_TYPE, ID_TYPE>> objs(_spillDir);
+  objs.reserve(_objects.size());
+
+  for (size_t i = 0; i < _objects.size(); i++) {
+    objs.push_back({_objects.geom(i), _objects.row(i)});
+  }
+
+  _objects = ObjectTable(objs, _spillDir);
+}
+
+// _____________________________________________________________________________
+int Requestor::openSpillFile() const {
+  char* fName = strdup((_spillDir + "/petrimaps-ids-XXXXXX").c_str());
+  int fd = mkstemp(fName);
+  if (fd == -1) {
+    free(fName);
+    throw std::runtime_error("Could not create temporary file in " +
+                             _spillDir);
   }
 
-  _ready = true;
+  // immediately unlink
+  unlink(fName);
+  free(fName);
 
-  LOG(INFO) << "[REQUESTOR] ...done";
+  return fd;
+}
+
+// _____________________________________________________________________________
+void Requestor::writeIds(int fd, size_t pos,
+                         const std::vector<IdMapping>& ids) {
+  const char* data = reinterpret_cast<const char*>(ids.data());
+  size_t size = ids.size() * sizeof(IdMapping);
+  off_t off = pos * sizeof(IdMapping);
+
+  while (size > 0) {
+    ssize_t n = pwrite(fd, data, size, off);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) throw std::runtime_error("Could not write temporary file");
+    data += n;
+    size -= n;
+    off += n;
+  }
+}
+
+// _____________________________________________________________________________
+void Requestor::readIds(int fd, size_t pos, size_t n,
+                        std::vector<IdMapping>* ids) {
+  ids->resize(n);
+  char* data = reinterpret_cast<char*>(ids->data());
+  size_t size = n * sizeof(IdMapping);
+  off_t off = pos * sizeof(IdMapping);
+
+  while (size > 0) {
+    ssize_t r = pread(fd, data, size, off);
+    if (r < 0 && errno == EINTR) continue;
+    if (r <= 0) throw std::runtime_error("Could not read temporary file");
+    data += r;
+    size -= r;
+    off += r;
+  }
 }
 
 // _____________________________________________________________________________
@@ -320,7 +748,7 @@ std::vector<std::pair<std::string, std::string>> Requestor::requestRow(
   if (!_cache->ready()) {
     throw std::runtime_error("Geom cache not ready");
   }
-  RequestReader reader(_cache->getBackendURL(), _maxMemory);
+  RequestReader reader(_backendUrl, _maxMemory);
   LOG(INFO) << "[REQUESTOR] Requesting single row " << row << " for query "
             << _query;
   auto query = prepQueryRow(_query, row);
@@ -342,7 +770,7 @@ void Requestor::requestRows(
   if (!_cache->ready()) {
     throw std::runtime_error("Geom cache not ready");
   }
-  RequestReader reader(_cache->getBackendURL(), _maxMemory);
+  RequestReader reader(_backendUrl, _maxMemory);
   LOG(INFO) << "[REQUESTOR] Requesting rows for query " << _query;
 
   ReaderCbPair cbPair{&reader, cb};
@@ -382,7 +810,7 @@ std::string Requestor::prepQuery(std::string query) const {
   if (var == "*") {
     // if we have a wildcard variable (*), we request the list of variables
     // from the backend by sending a LIMIT 0 requests.
-    RequestReader reader(_cache->getBackendURL(), _maxMemory);
+    RequestReader reader(_backendUrl, _maxMemory);
     auto cols = reader.requestColumns(query + " LIMIT 0");
     if (cols.size() > 0) var = cols.back();
   }
@@ -409,7 +837,8 @@ std::string Requestor::prepQueryRow(std::string query, uint64_t row) const {
 
 // _____________________________________________________________________________
 const ResObj Requestor::getNearest(util::geo::DPoint rp, double rad, double res,
-                                   util::geo::FBox fullbox) const {
+                                   util::geo::FBox fullbox,
+                                   int clusterZoom) const {
   if (!_cache->ready()) {
     throw std::runtime_error("Geom cache not ready");
   }
@@ -418,7 +847,8 @@ const ResObj Requestor::getNearest(util::geo::DPoint rp, double rad, double res,
 
   auto frp = util::geo::FPoint{rp.getX(), rp.getY()};
 
-  size_t NUM_THREADS = std::thread::hardware_concurrency();
+  auto& pool = TaskPool::global();
+  size_t NUM_THREADS = pool.numSlots();
 
   size_t nearest = 0;
   double dBest = std::numeric_limits<double>::max();
@@ -430,90 +860,89 @@ const ResObj Requestor::getNearest(util::geo::DPoint rp, double rad, double res,
                                 std::numeric_limits<double>::max());
   size_t nearestL = 0;
   double dBestL = std::numeric_limits<double>::max();
-#pragma omp parallel sections
-  {
-#pragma omp section
-    {
-      // points
 
-      std::vector<ID_TYPE> ret;
+  // set if the nearest point was looked up in the cluster index
+  const PointCluster* nearestCluster = 0;
+
+  std::vector<std::function<void()>> tasks;
+
+  tasks.push_back([&]() {
+    // points
+
+    if (clusterZoom >= 0) {
+      std::vector<const PointCluster*> clusters;
+      _clusterIndex.get(clusterZoom, fbox, &clusters);
+
+      for (const auto* c : clusters) {
+        if (!util::geo::contains(c->pos, fbox)) continue;
+
+        double d = util::geo::dist(c->pos, frp);
 
-      if (res > 0)
-        _pgrid.get(fullbox, &ret);
-      else
-        _pgrid.get(fbox, &ret);
+        if (d < dBestVec[0]) {
+          nearestVec[0] = c->oid;
+          dBestVec[0] = d;
+          nearestCluster = c;
+        }
+      }
+      return;
+    }
+
+    std::vector<ID_TYPE> ret;
 
-#pragma omp parallel for num_threads(NUM_THREADS) schedule(static)
-      for (size_t idx = 0; idx < ret.size(); idx++) {
+    if (res > 0)
+      _pgrid.get(fullbox, &ret);
+    else
+      getPoints(fbox, &ret);
+
+    pool.parallelFor(ret.size(), 0, [&](size_t b, size_t e, size_t t) {
+      for (size_t idx = b; idx < e; idx++) {
         auto i = ret[idx];
         util::geo::FPoint p;
         if (i >= _objects.size()) {
           size_t cid = i - _objects.size();
           p = clusterGeom(cid, res);
         } else {
-          p = _cache->getPoints()[_objects[i].first];
+          p = _cache->getPoints()[_objects.geom(i)];
         }
 
         if (!util::geo::contains(p, fbox)) continue;
 
         double d = util::geo::dist(p, frp);
 
-        if (d < dBestVec[omp_get_thread_num()]) {
-          nearestVec[omp_get_thread_num()] = i;
-          dBestVec[omp_get_thread_num()] = d;
+        if (d < dBestVec[t]) {
+          nearestVec[t] = i;
+          dBestVec[t] = d;
         }
       }
-    }
+    });
+  });
 
-#pragma omp section
-    {
-      // lines
-      std::vector<ID_TYPE> retL;
-      _lgrid.get(fbox, &retL);
+  tasks.push_back([&]() {
+    // lines
+    std::vector<ID_TYPE> retL;
+    _lgrid.get(fbox, &retL);
 
-#pragma omp parallel for num_threads(NUM_THREADS) schedule(static)
-      for (size_t idx = 0; idx < retL.size(); idx++) {
+    pool.parallelFor(retL.size(), 0, [&](size_t b, size_t e, size_t t) {
+      for (size_t idx = b; idx < e; idx++) {
         const auto& i = retL[idx];
-        auto lBox = _cache->getLineBBox(_objects[i].first - I_OFFSET);
+        auto lid = _objects.geom(i) - I_OFFSET;
+        auto lBox = _cache->getLineBBox(lid);
         if (!util::geo::intersects(lBox, box)) continue;
 
-        size_t start = _cache->getLine(_objects[i].first - I_OFFSET);
-        size_t end = _cache->getLineEnd(_objects[i].first - I_OFFSET);
-
         // TODO _____________________ own function
         double d = std::numeric_limits<double>::infinity();
 
         util::geo::DPoint curPa, curPb;
         int s = 0;
 
-        size_t gi = 0;
-
-        double mainX = 0;
-        double mainY = 0;
-
-        bool isArea = Requestor::isArea(_objects[i].first - I_OFFSET);
+        bool isArea = Requestor::isArea(lid);
 
         util::geo::DLine areaBorder;
 
-        for (size_t i = start; i < end; i++) {
-          // extract real geom
-          const auto& cur = _cache->getLinePoints()[i];
-
-          if (isMCoord(cur.getX())) {
-            mainX = rmCoord(cur.getX());
-            mainY = rmCoord(cur.getY());
-            continue;
-          }
-
-          // skip bounding box at beginning
-          gi++;
-          if (gi < 3) continue;
-
-          // extract real geometry
-          util::geo::DPoint curP(
-              (mainX * M_COORD_GRANULARITY + cur.getX()) / 10.0,
-              (mainY * M_COORD_GRANULARITY + cur.getY()) / 10.0);
+        LineReader reader(*_cache, lid);
+        util::geo::DPoint curP;
 
+        while (reader.next(&curP)) {
           if (isArea) areaBorder.push_back(curP);
 
           if (s == 0) {
@@ -545,13 +974,15 @@ const ResObj Requestor::getNearest(util::geo::DPoint rp, double rad, double res,
           }
         }
 
-        if (d < dBestLVec[omp_get_thread_num()]) {
-          nearestLVec[omp_get_thread_num()] = i;
-          dBestLVec[omp_get_thread_num()] = d;
+        if (d < dBestLVec[t]) {
+          nearestLVec[t] = i;
+          dBestLVec[t] = d;
         }
       }
-    }
-  }
+    });
+  });
+
+  pool.parallelInvoke(tasks);
 
   // join threads
   for (size_t i = 0; i < NUM_THREADS; i++) {
@@ -566,23 +997,39 @@ const ResObj Requestor::getNearest(util::geo::DPoint rp, double rad, double res,
     }
   }
 
+  if (dBest < rad && dBest <= dBestL && nearestCluster) {
+    auto oid = nearestCluster->oid;
+
+    if (nearestCluster->num == 1) {
+      return {true, oid, geomPointGeoms(oid), requestRow(_objects.row(oid)),
+              {},   {},  0,   dBest};
+    }
+
+    // the cluster is represented by one of its members, at the position
+    // of the cluster marker
+    return {true, oid, {nearestCluster->pos}, requestRow(_objects.row(oid)),
+            {},   {},  nearestCluster->num, dBest};
+  }
+
   if (dBest < rad && dBest <= dBestL) {
     size_t row = 0;
     if (nearest >= _objects.size())
-      row = _objects[_clusterObjects[nearest - _objects.size()].first].second;
+      row = _objects.row(_clusterObjects[nearest - _objects.size()].oid);
     else
-      row = _objects[nearest].second;
+      row = _objects.row(nearest);
 
     return {true,
             nearest >= _objects.size() ? nearest - _objects.size() : nearest,
             geomPointGeoms(nearest, res),
             requestRow(row),
             {},
-            {}};
+            {},
+            0,
+            dBest};
   }
 
   if (dBestL < rad && dBestL <= dBest) {
-    size_t lineId = _objects[nearestL].first - I_OFFSET;
+    size_t lineId = _objects.geom(nearestL) - I_OFFSET;
 
     bool isArea = Requestor::isArea(lineId);
 
@@ -590,29 +1037,33 @@ const ResObj Requestor::getNearest(util::geo::DPoint rp, double rad, double res,
 
     if (isArea && util::geo::contains(rp, util::geo::DPolygon(dline))) {
       return {true,  nearestL,
-              {frp}, requestRow(_objects[nearestL].second),
-              {},    geomPolyGeoms(nearestL, rad / 10)};
+              {frp}, requestRow(_objects.row(nearestL)),
+              {},    geomPolyGeoms(nearestL, rad / 10),
+              0,     0};
     } else {
       if (isArea) {
         auto p = util::geo::PolyLine<double>(dline).projectOn(rp).p;
         auto fp = util::geo::FPoint(p.getX(), p.getY());
         return {true, nearestL,
-                {fp}, requestRow(_objects[nearestL].second),
-                {},   geomPolyGeoms(nearestL, rad / 10)};
+                {fp}, requestRow(_objects.row(nearestL)),
+                {},   geomPolyGeoms(nearestL, rad / 10),
+                0,    dBestL};
       } else {
         auto p = util::geo::PolyLine<double>(dline).projectOn(rp).p;
         auto fp = util::geo::FPoint(p.getX(), p.getY());
         return {true,
                 nearestL,
                 {fp},
-                requestRow(_objects[nearestL].second),
+                requestRow(_objects.row(nearestL)),
                 geomLineGeoms(nearestL, rad / 10),
-                {}};
+                {},
+                0,
+                dBestL};
       }
     }
   }
 
-  return {false, 0, {{0, 0}}, {}, {}, {}};
+  return {false, 0, {{0, 0}}, {}, {}, {}, 0, 0};
 }
 
 // _____________________________________________________________________________
@@ -620,20 +1071,20 @@ const ResObj Requestor::getGeom(size_t id, double rad) const {
   if (!_cache->ready()) {
     throw std::runtime_error("Geom cache not ready");
   }
-  auto obj = _objects[id];
+  auto gid = _objects.geom(id);
 
-  if (obj.first >= I_OFFSET) {
-    size_t lineId = obj.first - I_OFFSET;
+  if (gid >= I_OFFSET) {
+    size_t lineId = gid - I_OFFSET;
 
     bool isArea = Requestor::isArea(lineId);
 
     if (isArea) {
-      return {true, id, {{0, 0}}, {}, {}, geomPolyGeoms(id, rad / 10)};
+      return {true, id, {{0, 0}}, {}, {}, geomPolyGeoms(id, rad / 10), 0, 0};
     } else {
-      return {true, id, {{0, 0}}, {}, geomLineGeoms(id, rad / 10), {}};
+      return {true, id, {{0, 0}}, {}, geomLineGeoms(id, rad / 10), {}, 0, 0};
     }
   } else {
-    return {true, id, geomPointGeoms(id), {}, {}, {}};
+    return {true, id, geomPointGeoms(id), {}, {}, {}, 0, 0};
   }
 }
 
@@ -641,41 +1092,17 @@ const ResObj Requestor::getGeom(size_t id, double rad) const {
 util::geo::DLine Requestor::extractLineGeom(size_t lineId) const {
   util::geo::DLine dline;
 
-  size_t start = _cache->getLine(lineId);
-  size_t end = _cache->getLineEnd(lineId);
-
-  double mainX = 0;
-  double mainY = 0;
-
-  size_t gi = 0;
-
-  for (size_t i = start; i < end; i++) {
-    // extract real geom
-    const auto& cur = _cache->getLinePoints()[i];
-
-    if (isMCoord(cur.getX())) {
-      mainX = rmCoord(cur.getX());
-      mainY = rmCoord(cur.getY());
-      continue;
-    }
-
-    // skip bounding box at beginning
-    gi++;
-    if (gi < 3) continue;
+  LineReader reader(*_cache, lineId);
+  util::geo::DPoint curP;
 
-    util::geo::DPoint curP((mainX * M_COORD_GRANULARITY + cur.getX()) / 10.0,
-                           (mainY * M_COORD_GRANULARITY + cur.getY()) / 10.0);
-    dline.push_back(curP);
-  }
+  while (reader.next(&curP)) dline.push_back(curP);
 
   return dline;
 }
 
 // _____________________________________________________________________________
 bool Requestor::isArea(size_t lineId) const {
-  size_t end = _cache->getLineEnd(lineId);
-
-  return isMCoord(_cache->getLinePoints()[end - 1].getX());
+  return _cache->isLineArea(lineId);
 }
 
 // _____________________________________________________________________________
@@ -684,17 +1111,9 @@ util::geo::MultiLine<double> Requestor::geomLineGeoms(size_t oid,
   std::vector<util::geo::DLine> polys;
 
   // catch multigeometries
-  for (size_t i = oid;
-       i < _objects.size() && _objects[i].second == _objects[oid].second; i++) {
-    if (_objects[oid].first < I_OFFSET) continue;
-    const auto& fline = extractLineGeom(_objects[i].first - I_OFFSET);
-    polys.push_back(util::geo::simplify(fline, eps));
-  }
-
-  for (size_t i = oid - 1;
-       i < _objects.size() && _objects[i].second == _objects[oid].second; i--) {
-    if (_objects[oid].first < I_OFFSET) continue;
-    const auto& fline = extractLineGeom(_objects[i].first - I_OFFSET);
+  for (size_t i = _objects.groupBegin(oid); i < _objects.groupEnd(oid); i++) {
+    if (_objects.geom(i) < I_OFFSET) continue;
+    const auto& fline = extractLineGeom(_objects.geom(i) - I_OFFSET);
     polys.push_back(util::geo::simplify(fline, eps));
   }
 
@@ -716,20 +1135,13 @@ util::geo::MultiPoint<float> Requestor::geomPointGeoms(size_t oid,
   }
 
   if (oid >= _objects.size()) {
-    oid = _clusterObjects[oid - _objects.size()].first;
+    oid = _clusterObjects[oid - _objects.size()].oid;
   }
 
   // catch multigeometries
-  for (size_t i = oid;
-       i < _objects.size() && _objects[i].second == _objects[oid].second; i++) {
-    if (_objects[oid].first >= I_OFFSET) continue;
-    points.push_back(_cache->getPoints()[_objects[i].first]);
-  }
-
-  for (size_t i = oid - 1;
-       i < _objects.size() && _objects[i].second == _objects[oid].second; i--) {
-    if (_objects[oid].first >= I_OFFSET) continue;
-    points.push_back(_cache->getPoints()[_objects[i].first]);
+  for (size_t i = _objects.groupBegin(oid); i < _objects.groupEnd(oid); i++) {
+    if (_objects.geom(i) >= I_OFFSET) continue;
+    points.push_back(_cache->getPoints()[_objects.geom(i)]);
   }
 
   return points;
@@ -741,17 +1153,9 @@ util::geo::MultiPolygon<double> Requestor::geomPolyGeoms(size_t oid,
   std::vector<util::geo::DPolygon> polys;
 
   // catch multigeometries
-  for (size_t i = oid;
-       i < _objects.size() && _objects[i].second == _objects[oid].second; i++) {
-    if (_objects[oid].first < I_OFFSET) continue;
-    const auto& dline = extractLineGeom(_objects[i].first - I_OFFSET);
-    polys.push_back(util::geo::DPolygon(util::geo::simplify(dline, eps)));
-  }
-
-  for (size_t i = oid - 1;
-       i < _objects.size() && _objects[i].second == _objects[oid].second; i--) {
-    if (_objects[oid].first < I_OFFSET) continue;
-    const auto& dline = extractLineGeom(_objects[i].first - I_OFFSET);
+  for (size_t i = _objects.groupBegin(oid); i < _objects.groupEnd(oid); i++) {
+    if (_objects.geom(i) < I_OFFSET) continue;
+    const auto& dline = extractLineGeom(_objects.geom(i) - I_OFFSET);
     polys.push_back(util::geo::DPolygon(util::geo::simplify(dline, eps)));
   }
 
@@ -760,13 +1164,13 @@ util::geo::MultiPolygon<double> Requestor::geomPolyGeoms(size_t oid,
 
 // _____________________________________________________________________________
 util::geo::FPoint Requestor::clusterGeom(size_t cid, double res) const {
-  size_t oid = _clusterObjects[cid].first;
-  const auto& pp = _cache->getPoints()[_objects[oid].first];
+  size_t oid = _clusterObjects[cid].oid;
+  const auto& pp = _cache->getPoints()[_objects.geom(oid)];
 
   if (res < 0) return {pp};
 
-  size_t num = _clusterObjects[cid].second.first;
-  size_t tot = _clusterObjects[cid].second.second;
+  size_t num = _clusterObjects[cid].num;
+  size_t tot = _clusterObjects[cid].tot;
 
   double a = 25;
   double b = 6;
@@ -798,3 +1202,77 @@ util::geo::FPoint Requestor::clusterGeom(size_t cid, double res) const {
     return util::geo::FPoint{x, y};
   }
 }
+
+// _____________________________________________________________________________
+void Requestor::getPoints(const util::geo::FBox& box,
+                          std::vector<ID_TYPE>* ret) const {
+  size_t swX = _pgrid.getCellXFromX(box.getLowerLeft().getX());
+  size_t swY = _pgrid.getCellYFromY(box.getLowerLeft().getY());
+  size_t neX = _pgrid.getCellXFromX(box.getUpperRight().getX());
+  size_t neY = _pgrid.getCellYFromY(box.getUpperRight().getY());
+
+  double sub = _pgrid.getCellHeight() / 65536;
+
+  for (size_t x = swX; x <= neX && x < _pgrid.getXWidth(); x++) {
+    for (size_t y = swY; y <= neY && y < _pgrid.getYHeight(); y++) {
+      auto cell = _pgrid.getCell(x, y);
+      if (cell.size() <= SORTED_CELL_SIZE) {
+        ret->insert(ret->end(), cell.begin(), cell.end());
+        continue;
+      }
+
+      // the rows of the sorted cell intersected by box, padded by one row
+      // against rounding
+      double cellY = _pgrid.getBBox().getLowerLeft().getY() +
+                     y * _pgrid.getCellHeight();
+      double lo = floor((box.getLowerLeft().getY() - cellY) / sub) - 1;
+      double hi = floor((box.getUpperRight().getY() - cellY) / sub) + 1;
+      uint16_t sLo = std::min(65535.0, std::max(0.0, lo));
+      uint16_t sHi = std::min(65535.0, std::max(0.0, hi));
+
+      auto qcell = _pqgrid.getCell(x, y);
+      auto b = std::lower_bound(
+          qcell.begin(), qcell.end(), sLo,
+          [](const util::geo::Point<uint16_t>& p, uint16_t v) {
+            return p.getY() < v;
+          });
+      auto e = std::upper_bound(
+          qcell.begin(), qcell.end(), sHi,
+          [](uint16_t v, const util::geo::Point<uint16_t>& p) {
+            return v < p.getY();
+          });
+
+      ret->insert(ret->end(), cell.begin() + (b - qcell.begin()),
+                  cell.begin() + (e - qcell.begin()));
+    }
+  }
+}
+
+// _____________________________________________________________________________
+double Requestor::gridCellSize(const std::vector<util::geo::FPoint>& sample,
+                               size_t total, const util::geo::FBox& bbox) {
+  double size = MAX_GRID_SIZE;
+  if (sample.size() == 0) return size;
+
+  double w = bbox.getUpperRight().getX() - bbox.getLowerLeft().getX();
+  double h = bbox.getUpperRight().getY() - bbox.getLowerLeft().getY();
+
+  // halve the cell size as long as the occupied cells are too crowded
+  while (size / 2 >= MIN_GRID_SIZE) {
+    if (ceil(w / (size / 2)) * ceil(h / (size / 2)) > MAX_GRID_CELLS) break;
+
+    std::unordered_set<uint64_t> cells;
+    for (const auto& p : sample) {
+      uint64_t x = (p.getX() - bbox.getLowerLeft().getX()) / size;
+      uint64_t y = (p.getY() - bbox.getLowerLeft().getY()) / size;
+      cells.insert((x << 32) | y);
+    }
+
+    if (static_cast<double>(total) / cells.size() <= GRID_TARGET_OCCUPANCY)
+      break;
+
+    size /= 2;
+  }
+
+  return size;
+}
@@ -5,6 +5,7 @@
 #ifndef PETRIMAPS_SERVER_REQUESTOR_H_
 #define PETRIMAPS_SERVER_REQUESTOR_H_
 
+#include <atomic>
 #include <chrono>
 #include <functional>
 #include <map>
@@ -15,7 +16,10 @@
 
 #include "qlever-petrimaps/GeomCache.h"
 #include "qlever-petrimaps/Grid.h"
+#include "qlever-petrimaps/HierGrid.h"
 #include "qlever-petrimaps/Misc.h"
+#include "qlever-petrimaps/ObjectTable.h"
+#include "qlever-petrimaps/server/ClusterIndex.h"
 #include "util/geo/Geo.h"
 
 namespace petrimaps {
@@ -29,6 +33,12 @@ struct ResObj {
   // the geometry
   std::vector<util::geo::DLine> line;
   std::vector<util::geo::DPolygon> poly;
+
+  // number of objects aggregated into this result, 0 if it is no cluster
+  size_t clusterSize;
+
+  // distance of the result to the queried point, in web mercator units
+  double dist;
 };
 
 struct ReaderCbPair {
@@ -40,10 +50,19 @@ struct ReaderCbPair {
 
 class Requestor {
  public:
+  // phases of building a session in request()
+  enum BuildPhase { Idle = 0, FetchIds, JoinGeoms, BuildGrids, Done };
+
   Requestor() : _maxMemory(-1) {}
-  Requestor(std::shared_ptr<const GeomCache> cache, size_t maxMemory)
-      : _cache(cache),
+  // if spillDir is given, results which do not fit into maxMemory are built
+  // out of core, with the object table in temporary files in spillDir
+  Requestor(std::shared_ptr<const GeomCache> cache,
+            const std::string& backendUrl, size_t maxMemory,
+            const std::string& spillDir)
+      : _backendUrl(backendUrl),
+        _cache(cache),
         _maxMemory(maxMemory),
+        _spillDir(spillDir),
         _createdAt(std::chrono::system_clock::now()) {}
 
   void request(const std::string& query);
@@ -58,38 +77,49 @@ class Requestor {
 
   const petrimaps::Grid<ID_TYPE, float>& getPointGrid() const { return _pgrid; }
 
-  const petrimaps::Grid<ID_TYPE, float>& getLineGrid() const { return _lgrid; }
+  // the points of the point grid, as offsets inside their cell in 1/65536th
+  // of the cell size
+  const petrimaps::Grid<util::geo::Point<uint16_t>, float>& getPointOffsetGrid()
+      const {
+    return _pqgrid;
+  }
+
+  const petrimaps::HierGrid<ID_TYPE, float>& getLineGrid() const {
+    return _lgrid;
+  }
 
   const petrimaps::Grid<util::geo::Point<uint8_t>, float>& getLinePointGrid()
       const {
     return _lpgrid;
   }
 
-  const std::vector<std::pair<ID_TYPE, ID_TYPE>>& getObjects() const {
-    return _objects;
-  }
+  const ObjectTable& getObjects() const { return _objects; }
 
-  const std::vector<std::pair<ID_TYPE, std::pair<size_t, size_t>>>& getClusters() const {
+  const std::vector<ClusterObj>& getClusters() const {
     return _clusterObjects;
   }
 
+  const ClusterIndex& getClusterIndex() const { return _clusterIndex; }
+
+  // index hash of the backend, empty if it did not report one
+  const std::string& getIndexHash() const { return _cache->getIndexHash(); }
+
   const util::geo::FPoint& getPoint(ID_TYPE id) const {
     return _cache->getPoints()[id];
   }
 
-  size_t getLine(ID_TYPE id) const { return _cache->getLine(id); }
-
-  size_t getLineEnd(ID_TYPE id) const { return _cache->getLineEnd(id); }
-
-  const std::vector<util::geo::Point<int16_t>>& getLinePoints() const {
-    return _cache->getLinePoints();
+  LineReader getLineReader(ID_TYPE id) const {
+    return LineReader(*_cache, id);
   }
 
   util::geo::DBox getLineBBox(ID_TYPE id) const {
     return _cache->getLineBBox(id);
   }
 
-  const ResObj getNearest(util::geo::DPoint p, double rad, double res, util::geo::FBox box) const;
+  // nearest object to p. If clusterZoom is a level of the cluster index,
+  // points are looked up in this level
+  const ResObj getNearest(util::geo::DPoint p, double rad, double res,
+                          util::geo::FBox box, int clusterZoom) const;
 
   const ResObj getGeom(size_t id, double rad) const;
 
@@ -115,6 +145,9 @@ class Requestor {
     return ready;
   }
 
+  // may be called while request() is running
+  BuildPhase getBuildPhase() const { return _buildPhase; }
+
  private:
   std::string _backendUrl;
 
@@ -122,23 +155,62 @@ class Requestor {
 
   size_t _maxMemory;
 
+  std::string _spillDir;
+
+  // fetch the ids of query and join them with the geom cache into _objects.
+  // If _spillDir is set and the ids do not fit into memory, they are sorted
+  // externally in runs in _spillDir, and _objects is file-backed
+  void fetchObjects(const std::string& query);
+
+  // merge-join the id runs [begin, end) in the temporary file fd with the
+  // geom cache in batches, into a file-backed _objects
+  void joinRuns(int fd, std::vector<std::pair<size_t, size_t>> runs,
+                bool sorted);
+
+  // replace _objects by a file-backed copy
+  void moveObjectsOutOfCore();
+
+  // build the grids and the cluster index of _objects. If dir is set, the
+  // grids are compact and backed by files in dir
+  void buildGrids(const std::string& dir);
+
+  // unlinked temporary file in _spillDir
+  int openSpillFile() const;
+
+  static void writeIds(int fd, size_t pos, const std::vector<IdMapping>& ids);
+  static void readIds(int fd, size_t pos, size_t n,
+                      std::vector<IdMapping>* ids);
+
   std::string prepQuery(std::string query) const;
   std::string prepQueryRow(std::string query, uint64_t row) const;
 
+  // ids in the point grid cells intersecting box. Of sorted cells, only the
+  // rows intersecting box
+  void getPoints(const util::geo::FBox& box, std::vector<ID_TYPE>* ret) const;
+
+  // cell size for a grid over bbox, given a sample of the object positions
+  // and the (estimated) total number of objects
+  static double gridCellSize(const std::vector<util::geo::FPoint>& sample,
+                             size_t total, const util::geo::FBox& bbox);
+
   std::string _query;
 
   mutable std::mutex _m;
 
-  std::vector<std::pair<ID_TYPE, ID_TYPE>> _objects;
-  std::vector<std::pair<ID_TYPE, std::pair<size_t, size_t>>> _clusterObjects;
+  ObjectTable _objects;
+  std::vector<ClusterObj> _clusterObjects;
+  ClusterIndex _clusterIndex;
   size_t _numObjects = 0;
 
   petrimaps::Grid<ID_TYPE, float> _pgrid;
-  petrimaps::Grid<ID_TYPE, float> _lgrid;
+  petrimaps::Grid<util::geo::Point<uint16_t>, float> _pqgrid;
+  petrimaps::HierGrid<ID_TYPE, float> _lgrid;
   petrimaps::Grid<util::geo::Point<uint8_t>, float> _lpgrid;
 
   bool _ready = false;
 
+  std::atomic<BuildPhase> _buildPhase{Idle};
+
   std::chrono::time_point<std::chrono::system_clock> _createdAt;
 };
 }  // namespace petrimaps
@@ -2,24 +2,33 @@
 // Chair of Algorithms and Data Structures.
 // Authors: Patrick Brosi <brosi@informatik.uni-freiburg.de>
 
+#include <fcntl.h>
 #include <png.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include <algorithm>
 #include <chrono>
 #include <codecvt>
 #include <csignal>
+#include <cstring>
+#include <limits>
 #include <locale>
 #include <memory>
-#include <random>
 #include <set>
 #include <unordered_set>
 #include <vector>
 
 #include "3rdparty/heatmap.h"
 #include "3rdparty/colorschemes/Spectral.h"
+#include "qlever-petrimaps/Checksum.h"
+#include "qlever-petrimaps/Sha256.h"
+#include "qlever-petrimaps/TaskPool.h"
 #include "qlever-petrimaps/build.h"
 #include "qlever-petrimaps/index.h"
+#include "qlever-petrimaps/server/RenderCache.h"
+#include "qlever-petrimaps/server/RequestLog.h"
 #include "qlever-petrimaps/server/Requestor.h"
 #include "qlever-petrimaps/server/Server.h"
 #include "qlever-petrimaps/style.h"
@@ -29,13 +38,12 @@
 #include "util/geo/output/GeoJsonOutput.cpp"
 #include "util/http/Server.h"
 #include "util/log/Log.h"
-#ifdef _OPENMP
-#include <omp.h>
-#else
-#define omp_get_thread_num() 0
-#endif
 
+using petrimaps::Checksum;
+using petrimaps::Sha256;
+using petrimaps::GeomCache;
 using petrimaps::Params;
+using petrimaps::PointCluster;
 using petrimaps::Server;
 using util::geo::contains;
 using util::geo::densify;
@@ -48,15 +56,98 @@ using util::geo::LineSegment;
 using util::geo::webMercToLatLng;
 
 const static double THRESHOLD = 200;
+
+// zoom levels up to this are pre-rendered for new sessions
+const static int PRERENDER_MAX_ZOOM = 19;
+
+// max number of pixels of a single pre-rendered zoom raster
+const static size_t PRERENDER_MAX_PIXELS = 1 << 22;
+
+// max number of cells of a density grid
+const static size_t DENSITY_MAX_CELLS = 1 << 24;
+
+// seconds a coordinator waits for the density grids of its shards. Queries
+// have no such limit, as the shards may be filling their caches
+const static long SHARD_RENDER_TIMEOUT = 60;
+
+// max number of sessions rendered into a single heatmap
+const static size_t HEATMAP_MAX_LAYERS = 16;
+
+// default colors of layers rendered into a shared heatmap
+const static std::vector<uint32_t> LAYER_COLORS = {
+    0x3388ff, 0xe6930e, 0x2ca02c, 0xd62728,
+    0x9467bd, 0x8c564b, 0xe377c2, 0x17becf};
+
+// number of colors of the color scheme of a heatmap layer
+const static size_t LAYER_HEAT_STEPS = 64;
+
+// max radius in pixels of a cluster marker in object mode
+const static int CLUSTER_MARKER_MAX_RAD = 8;
+
+// load status streams check for changes in this interval
+const static std::chrono::milliseconds LOADSTATUS_STREAM_INTERVAL(250);
+
+// max time without any message on a load status stream
+const static std::chrono::seconds LOADSTATUS_STREAM_KEEPALIVE(15);
+
+// block size for reading cache files sent to peers
+const static size_t CACHE_FILE_BLOCK_SIZE = 1 << 20;
+
+// endpoints recorded in the request log
+const static std::set<std::string> LOGGED_ENDPOINTS = {
+    "/query", "/heatmap", "/density", "/pos", "/geojson", "/export"};
+
+// max age of static assets requested with their content hash
+const static std::string ASSET_CACHE_IMMUTABLE =
+    "public, max-age=31536000, immutable";
+
+// max age of heatmap tiles and density grids. Session ids are derived from
+// the index hash and the query, so their renderings can be shared by caches.
+// Without an index hash, the id is derived from the backend URL, whose index
+// may change, and renderings are always revalidated
+const static std::string SESSION_CACHE_CONTROL = "public, max-age=86400";
+const static std::string SESSION_NO_CACHE = "no-cache";
+
+// static assets embedded at build time. The url of index.html references
+// build.js and build.css with their content hash (?v=<hash>), these are
+// never revalidated. index.html itself is always revalidated, which is
+// cheap thanks to its ETag.
+const static petrimaps::StaticAsset STATIC_ASSETS[] = {
+    {"/", "text/html; charset=utf-8", index_html, index_html_len,
+     index_html_gz, index_html_gz_len, index_html_br, index_html_br_len,
+     index_html_hash},
+    {"/build.js", "application/javascript; charset=utf-8", build_js,
+     build_js_len, build_js_gz, build_js_gz_len, build_js_br, build_js_br_len,
+     build_js_hash},
+    {"/build.css", "text/css; charset=utf-8", build_css, build_css_len,
+     build_css_gz, build_css_gz_len, build_css_br, build_css_br_len,
+     build_css_hash}};
+
 static std::atomic<size_t> _curRow;
 
 // _____________________________________________________________________________
-Server::Server(size_t maxMemory, const std::string& cacheDir, int cacheLifetime)
+Server::Server(size_t maxMemory, const std::string& cacheDir, int cacheLifetime,
+               int indexHashInterval, bool packLines,
+               const std::string& requestLog)
     : _maxMemory(maxMemory),
       _cacheDir(cacheDir),
-      _cacheLifetime(cacheLifetime) {
+      _cacheLifetime(cacheLifetime),
+      _indexHashInterval(indexHashInterval),
+      _packLines(packLines) {
+  if (requestLog.size()) {
+    _requestLog = std::unique_ptr<RequestLog>(new RequestLog(requestLog));
+  }
+
   std::thread t(&Server::clearOldSessions, this);
   t.detach();
+
+  std::thread p(&Server::prerender, this);
+  p.detach();
+
+  if (_indexHashInterval > 0) {
+    std::thread w(&Server::watchIndexHashes, this);
+    w.detach();
+  }
 }
 
 // _____________________________________________________________________________
@@ -66,17 +157,18 @@ util::http::Answer Server::handle(const util::http::Req& req, int con) const {
   // ignore SIGPIPE
   signal(SIGPIPE, SIG_IGN);
 
+  auto start = std::chrono::steady_clock::now();
+
   util::http::Answer a;
+  std::string cmd;
   try {
     Params params;
-    auto cmd = parseUrl(req.url, req.payload, &params);
-
-    if (cmd == "/") {
-      a = util::http::Answer(
-          "200 OK",
-          std::string(index_html,
-                      index_html + sizeof index_html / sizeof index_html[0]));
-      a.params["Content-Type"] = "text/html; charset=utf-8";
+    cmd = parseUrl(req.url, req.payload, &params);
+
+    if (getStaticAsset(cmd)) {
+      a = handleStaticReq(req, *getStaticAsset(cmd), params, con);
+    } else if (_shardClient && cmd != "/heatmap" && cmd != "/density") {
+      a = handleCoordinatorReq(cmd, params);
     } else if (cmd == "/query") {
       a = handleQueryReq(params);
     } else if (cmd == "/geojson") {
@@ -91,23 +183,16 @@ util::http::Answer Server::handle(const util::http::Req& req, int con) const {
       a = handlePosReq(params);
     } else if (cmd == "/export") {
       a = handleExportReq(params, con);
+    } else if (cmd == "/cachefile") {
+      a = handleCacheFileReq(params, con);
     } else if (cmd == "/loadstatus") {
       a = handleLoadStatusReq(params);
-    } else if (cmd == "/build.js") {
-      a = util::http::Answer(
-          "200 OK", std::string(build_js, build_js + sizeof build_js /
-                                                         sizeof build_js[0]));
-      a.params["Content-Type"] = "application/javascript; charset=utf-8";
-      a.params["Cache-Control"] = "public, max-age=10000";
-    } else if (cmd == "/build.css") {
-      a = util::http::Answer(
-          "200 OK",
-          std::string(build_css,
-                      build_css + sizeof build_css / sizeof build_css[0]));
-      a.params["Content-Type"] = "text/css; charset=utf-8";
-      a.params["Cache-Control"] = "public, max-age=10000";
+    } else if (cmd == "/loadstatus/stream") {
+      a = handleLoadStatusStreamReq(params, con);
     } else if (cmd == "/heatmap") {
       a = handleHeatMapReq(params, con);
+    } else if (cmd == "/density") {
+      a = handleDensityReq(params);
     } else {
       a = util::http::Answer("404 Not Found", "dunno");
     }
@@ -129,9 +214,139 @@ util::http::Answer Server::handle(const util::http::Req& req, int con) const {
   a.params["Access-Control-Allow-Origin"] = "*";
   a.params["Server"] = "qlever-petrimaps";
 
+  if (_requestLog && LOGGED_ENDPOINTS.count(cmd)) {
+    std::string session;
+    if (cmd == "/query") {
+      // the answer of /query starts with the new session id
+      const std::string key = "{\"qid\" : \"";
+      if (a.pl.compare(0, key.size(), key) == 0) {
+        session = a.pl.substr(key.size(),
+                              a.pl.find('"', key.size()) - key.size());
+      }
+    }
+
+    _requestLog->log(start, cmd, atoi(a.status.c_str()), session, req.url,
+                     req.payload);
+  }
+
   return a;
 }
 
+// _____________________________________________________________________________
+const petrimaps::StaticAsset* Server::getStaticAsset(const std::string& path) {
+  for (const auto& asset : STATIC_ASSETS) {
+    if (path == asset.path) return &asset;
+  }
+  return 0;
+}
+
+// _____________________________________________________________________________
+util::http::Answer Server::handleStaticReq(const util::http::Req& req,
+                                           const StaticAsset& asset,
+                                           const Params& pars,
+                                           int sock) const {
+  std::string accept = getHeader(req, "Accept-Encoding");
+
+  // pick the smallest variant the client accepts
+  std::string encoding;
+  const unsigned char* data = asset.raw;
+  size_t len = asset.rawLen;
+
+  if (asset.brLen && acceptsEncoding(accept, "br")) {
+    encoding = "br";
+    data = asset.br;
+    len = asset.brLen;
+  } else if (asset.gzLen && acceptsEncoding(accept, "gzip")) {
+    encoding = "gzip";
+    data = asset.gz;
+    len = asset.gzLen;
+  }
+
+  // strong ETag, distinct for each encoding
+  std::string etag = "\"" + std::string(asset.hash);
+  if (encoding.size()) etag += "-" + encoding;
+  etag += "\"";
+
+  // the answer is written directly to the socket, the HTTP server would
+  // otherwise compress the precompressed variants again
+  bool notModified = etagMatches(getHeader(req, "If-None-Match"), etag);
+
+  std::stringstream ss;
+  if (notModified) {
+    ss << "HTTP/1.1 304 Not Modified\r\n";
+    len = 0;
+  } else {
+    ss << "HTTP/1.1 200 OK\r\n"
+       << "Content-Type: " << asset.type << "\r\n";
+    if (encoding.size()) ss << "Content-Encoding: " << encoding << "\r\n";
+  }
+
+  auto v = pars.find("v");
+  if (v != pars.end() && v->second == asset.hash) {
+    ss << "Cache-Control: " << ASSET_CACHE_IMMUTABLE << "\r\n";
+  } else {
+    ss << "Cache-Control: no-cache\r\n";
+  }
+
+  ss << "ETag: " << etag << "\r\n"
+     << "Vary: Accept-Encoding\r\n"
+     << "Content-Length: " << len << "\r\n"
+     << "Access-Control-Allow-Origin: *\r\n"
+     << "Server: qlever-petrimaps\r\n"
+     << "Connection: close\r\n\r\n";
+
+  if (sendAll(sock, ss.str())) {
+    sendAll(sock, std::string(reinterpret_cast<const char*>(data), len));
+  }
+
+  auto a = util::http::Answer("200 OK", "");
+  a.raw = true;
+  return a;
+}
+
+// _____________________________________________________________________________
+std::string Server::getHeader(const util::http::Req& req,
+                              const std::string& name) {
+  for (const auto& kv : req.params) {
+    if (kv.first.size() != name.size()) continue;
+    if (std::equal(name.begin(), name.end(), kv.first.begin(),
+                   [](char a, char b) { return tolower(a) == tolower(b); })) {
+      return kv.second;
+    }
+  }
+  return "";
+}
+
+// _____________________________________________________________________________
+bool Server::acceptsEncoding(const std::string& accept,
+                             const std::string& encoding) {
+  for (const auto& part : util::split(accept, ',')) {
+    auto params = util::split(part, ';');
+    if (params.empty() || util::trim(params[0]) != encoding) continue;
+
+    // explicitly refused via q=0
+    for (size_t i = 1; i < params.size(); i++) {
+      auto kv = util::split(util::trim(params[i]), '=', 2);
+      if (kv.size() == 2 && util::trim(kv[0]) == "q" &&
+          atof(kv[1].c_str()) == 0) {
+        return false;
+      }
+    }
+    return true;
+  }
+  return false;
+}
+
+// _____________________________________________________________________________
+bool Server::etagMatches(const std::string& ifNoneMatch,
+                         const std::string& etag) {
+  for (const auto& tag : util::split(ifNoneMatch, ',')) {
+    std::string t = util::trim(tag);
+    if (t == "*" || t == etag) return true;
+  }
+  return false;
+}
+
 // _____________________________________________________________________________
 util::http::Answer Server::handleHeatMapReq(const Params& pars,
                                             int sock) const {
@@ -149,7 +364,19 @@ util::http::Answer Server::handleHeatMapReq(const Params& pars,
 
   if (pars.count("layers") == 0 || pars.find("layers")->second.empty())
     throw std::invalid_argument("No bbox specified.");
-  std::string id = pars.find("layers")->second;
+  std::string layers = pars.find("layers")->second;
+  auto ids = util::split(layers, ',');
+  if (ids.size() > HEATMAP_MAX_LAYERS)
+    throw std::invalid_argument("Too many layers.");
+
+  // explicit layer colors, defaults are taken from LAYER_COLORS
+  std::vector<std::string> colors;
+  if (pars.count("colors") != 0 && !pars.find("colors")->second.empty())
+    colors = util::split(pars.find("colors")->second, ',');
+
+  // with more than one layer or explicit colors, each layer is rendered in
+  // its own color and blended onto the image
+  bool blend = ids.size() > 1 || colors.size();
 
   MapStyle style = HEATMAP;
   if (pars.count("styles") != 0 && !pars.find("styles")->second.empty()) {
@@ -158,58 +385,395 @@ util::http::Answer Server::handleHeatMapReq(const Params& pars,
 
   if (box.size() != 4) throw std::invalid_argument("Invalid request.");
 
-  std::shared_ptr<Requestor> r;
+  std::vector<std::shared_ptr<Requestor>> rs;
+  std::vector<std::shared_ptr<RenderCache>> renderCaches;
+  std::vector<std::vector<std::string>> shardIds;
+
+  // the coordinator does not know the index hashes of the shards
+  bool cacheable = !_shardClient;
   {
     std::lock_guard<std::mutex> guard(_m);
-    bool has = _rs.count(id);
-    if (!has) {
-      throw std::invalid_argument("Session not found");
+    for (const auto& id : ids) {
+      if (_shardClient) {
+        if (!_shardSessions.count(id)) {
+          throw std::invalid_argument("Session not found");
+        }
+        shardIds.push_back(_shardSessions[id].ids);
+        continue;
+      }
+
+      bool has = _rs.count(id);
+      if (!has) {
+        throw std::invalid_argument("Session not found");
+      }
+
+      // tiles are cacheable, never render an incomplete session
+      if (!_rs[id]->ready()) throw std::invalid_argument("Session not ready.");
+      rs.push_back(_rs[id]);
+      cacheable = cacheable && !_rs[id]->getIndexHash().empty();
+      renderCaches.push_back(_renderCaches.count(id) ? _renderCaches[id]
+                                                     : nullptr);
     }
-    r = _rs[id];
   }
 
-  LOG(INFO) << "[SERVER] Begin heat for session " << id;
+  LOG(INFO) << "[SERVER] Begin heat for session(s) " << layers;
 
   double x1 = std::atof(box[0].c_str());
   double y1 = std::atof(box[1].c_str());
   double x2 = std::atof(box[2].c_str());
   double y2 = std::atof(box[3].c_str());
 
-  double mercW = fabs(x2 - x1);
-  double mercH = fabs(y2 - y1);
-
   auto bbox = DBox({x1, y1}, {x2, y2});
-  auto fbbox = FBox({x1, y1}, {x2, y2});
 
   int w = atoi(pars.find("width")->second.c_str());
   int h = atoi(pars.find("height")->second.c_str());
 
-  double res = mercH / h;
-
   heatmap_t* hm = heatmap_new(w, h);
 
-  double realCellSize = r->getPointGrid().getCellWidth();
-  double virtCellSize = res * 2.5;
-
-  size_t NUM_THREADS = std::thread::hardware_concurrency();
-
-  size_t subCellSize = (size_t)ceil(realCellSize / virtCellSize);
-
-  LOG(INFO) << "[SERVER] Query resolution: " << res;
-  LOG(INFO) << "[SERVER] Virt cell size: " << virtCellSize;
-  LOG(INFO) << "[SERVER] Num virt cells: " << subCellSize * subCellSize;
+  auto& pool = TaskPool::global();
+  size_t NUM_THREADS = pool.numSlots();
 
   std::vector<unsigned char> image(w * h * 4);
 
+  // if blended, layers are rendered here first
+  std::vector<unsigned char> layerImage;
+  if (blend) layerImage.resize(w * h * 4);
+
   std::vector<std::vector<uint32_t>> points(NUM_THREADS);
   std::vector<std::vector<double>> points2(NUM_THREADS);
 
   // initialize vectors to 0
   for (size_t i = 0; i < NUM_THREADS; i++) points2[i].resize(w * h, 0);
 
+  // all layers share the buffers above
+  for (size_t l = 0; l < ids.size(); l++) {
+    if (l > 0) {
+      for (size_t i = 0; i < NUM_THREADS; i++) {
+        for (const auto& p : points[i]) points2[i][p] = 0;
+        points[i].clear();
+      }
+      std::fill(hm->buf, hm->buf + w * h, 0);
+      hm->max = 0;
+      std::fill(layerImage.begin(), layerImage.end(), 0);
+    }
+
+    unsigned char* target = blend ? layerImage.data() : image.data();
+
+    if (_shardClient) {
+      collectShardPoints(shardIds[l], pars.find("bbox")->second, w, h, points,
+                         points2);
+    } else {
+      collectCachedPoints(rs[l], renderCaches[l], bbox, w, h, style, pool,
+                          points, points2, target);
+    }
+
+    LOG(INFO) << "[SERVER] Adding points to heatmap...";
+
+    if (style == OBJECTS) {
+      auto stamp = heatmap_stamp_gen(3);
+      for (size_t i = 0; i < NUM_THREADS; i++) {
+        for (const auto& p : points[i]) {
+          size_t y = p / w;
+          size_t x = p - (y * w);
+          if (points2[i][p] > 0)
+            heatmap_add_weighted_point_with_stamp(hm, x, y, 1, stamp);
+        }
+      }
+      heatmap_stamp_free(stamp);
+    } else {
+      for (size_t i = 0; i < NUM_THREADS; i++) {
+        for (const auto& p : points[i]) {
+          size_t y = p / w;
+          size_t x = p - (y * w);
+          if (points2[i][p] > 0)
+            heatmap_add_weighted_point(hm, x, y, points2[i][p]);
+        }
+      }
+    }
+
+    LOG(INFO) << "[SERVER] ...done";
+    LOG(INFO) << "[SERVER] Rendering heatmap...";
+
+    if (blend) {
+      uint32_t rgb = LAYER_COLORS[l % LAYER_COLORS.size()];
+      if (l < colors.size() && colors[l].size()) rgb = parseColor(colors[l]);
+
+      auto colorData = layerColorScheme(rgb, style);
+      heatmap_colorscheme_t scheme = {colorData.data(), colorData.size() / 4};
+
+      if (style == OBJECTS) {
+        heatmap_render_saturated_to(hm, &scheme, 1, target);
+      } else {
+        heatmap_render_to(hm, &scheme, target);
+      }
+
+      blendOver(target, image.data(), w * h);
+    } else if (style == OBJECTS) {
+      static const unsigned char discrete_data[] = {
+          0,   0,   0,   0,   0,   0,   0,   0,   51,  136,
+          255, 16,  51,  136, 255, 32,  51,  136, 255, 64,
+          51,  136, 255, 128, 51,  136, 255, 160, 51,  136,
+          255, 192, 51,  136, 255, 224, 51,  136, 255, 255};
+      static const heatmap_colorscheme_t discrete = {
+          discrete_data, sizeof(discrete_data) / sizeof(discrete_data[0] / 4)};
+
+      heatmap_render_saturated_to(hm, &discrete, 1, target);
+    } else {
+      heatmap_render_to(hm, heatmap_cs_Spectral_mixed_exp, target);
+    }
+  }
+
+  heatmap_free(hm);
+
+  LOG(INFO) << "[SERVER] ...done";
+  LOG(INFO) << "[SERVER] Generating PNG...";
+
+  auto aw = util::http::Answer("200 OK", "");
+  aw.params["Content-Type"] = "image/png";
+  aw.params["Content-Encoding"] = "identity";
+  aw.params["Cache-Control"] =
+      cacheable ? SESSION_CACHE_CONTROL : SESSION_NO_CACHE;
+  aw.params["Server"] = "qlever-petrimaps";
+  aw.raw = true;
+
+  // we do not set the Content-Length header here, but serve until
+  // we are done. In particular, we do not need to send our data in chunks, as
+  // specified by https://www.rfc-editor.org/rfc/rfc7230#section-3.3.3
+  // point 7
+
+  std::stringstream ss;
+  ss << "HTTP/1.1 200 OK" << aw.status << "\r\n";
+  for (const auto& kv : aw.params)
+    ss << kv.first << ": " << kv.second << "\r\n";
+
+  ss << "\r\n";
+
+  std::string buff = ss.str();
+
+  size_t writes = 0;
+
+  while (writes != buff.size()) {
+    int64_t out =
+        send(sock, buff.c_str() + writes, buff.size() - writes, MSG_NOSIGNAL);
+    if (out < 0) {
+      if (errno == EWOULDBLOCK || errno == EAGAIN || errno == EINTR) continue;
+      throw std::runtime_error("Failed to write to socket");
+    }
+    writes += out;
+  }
+
+  writePNG(&image[0], w, h, sock);
+
+  LOG(INFO) << "[SERVER] ...done";
+
+  return aw;
+}
+
+// _____________________________________________________________________________
+void Server::collectCachedPoints(
+    std::shared_ptr<const Requestor> r,
+    std::shared_ptr<const RenderCache> renderCache, const DBox& bbox, int w,
+    int h, MapStyle style, TaskPool& pool,
+    std::vector<std::vector<uint32_t>>& points,
+    std::vector<std::vector<double>>& points2, unsigned char* image) const {
+  double res = fabs(bbox.getUpperRight().getY() - bbox.getLowerLeft().getY()) /
+               h;
+
+  // low zoom levels may have been pre-rendered in the background
+  std::shared_ptr<const ZoomRaster> raster;
+  if (style == HEATMAP && renderCache) {
+    int z = RenderCache::zoomLevel(res);
+    if (z >= 0) raster = renderCache->get(z);
+  }
+
+  if (raster) {
+    LOG(INFO) << "[SERVER] Using pre-rendered raster of zoom level "
+              << raster->zoom;
+    RenderCache::draw(*raster, bbox, w, h, points[0], points2[0]);
+  } else {
+    collectPoints(r, bbox, w, h, style, pool, points, points2, image);
+  }
+}
+
+// _____________________________________________________________________________
+util::http::Answer Server::handleDensityReq(const Params& pars) const {
+  if (pars.count("id") == 0 || pars.find("id")->second.empty())
+    throw std::invalid_argument("No session id (?id=) specified.");
+  auto id = pars.find("id")->second;
+
+  if (pars.count("width") == 0 || pars.find("width")->second.empty())
+    throw std::invalid_argument("No width (?width=) specified.");
+  if (pars.count("height") == 0 || pars.find("height")->second.empty())
+    throw std::invalid_argument("No height (?height=) specified.");
+
+  if (pars.count("bbox") == 0 || pars.find("bbox")->second.empty())
+    throw std::invalid_argument("No bbox specified.");
+  auto box = util::split(pars.find("bbox")->second, ',');
+  if (box.size() != 4) throw std::invalid_argument("Invalid request.");
+
+  int bits = 8;
+  if (pars.count("bits") != 0 && !pars.find("bits")->second.empty()) {
+    bits = atoi(pars.find("bits")->second.c_str());
+    if (bits != 8 && bits != 16 && bits != 32) {
+      throw std::invalid_argument(
+          "Invalid bits (?bits=), must be 8, 16 or 32.");
+    }
+  }
+
+  int w = atoi(pars.find("width")->second.c_str());
+  int h = atoi(pars.find("height")->second.c_str());
+
+  if (w <= 0 || h <= 0 || static_cast<size_t>(w) * h > DENSITY_MAX_CELLS)
+    throw std::invalid_argument("Invalid width or height.");
+
+  std::shared_ptr<Requestor> r;
+  std::shared_ptr<RenderCache> renderCache;
+  std::vector<std::string> shardIds;
+  {
+    std::lock_guard<std::mutex> guard(_m);
+    if (_shardClient) {
+      if (!_shardSessions.count(id)) {
+        throw std::invalid_argument("Session not found");
+      }
+      shardIds = _shardSessions[id].ids;
+    } else {
+      if (!_rs.count(id)) throw std::invalid_argument("Session not found");
+      r = _rs[id];
+      if (_renderCaches.count(id)) renderCache = _renderCaches[id];
+    }
+  }
+
+  if (r && !r->ready()) throw std::invalid_argument("Session not ready.");
+
+  auto bbox = DBox(
+      {std::atof(box[0].c_str()), std::atof(box[1].c_str())},
+      {std::atof(box[2].c_str()), std::atof(box[3].c_str())});
+
+  LOG(INFO) << "[SERVER] Density grid of " << w << "x" << h
+            << " cells for session " << id;
+
+  auto& pool = TaskPool::global();
+  size_t NUM_THREADS = pool.numSlots();
+
+  checkMem(NUM_THREADS * w * h * sizeof(double), _maxMemory);
+
+  std::vector<std::vector<uint32_t>> points(NUM_THREADS);
+  std::vector<std::vector<double>> points2(NUM_THREADS);
+  for (size_t i = 0; i < NUM_THREADS; i++) points2[i].resize(w * h, 0);
+
+  if (_shardClient) {
+    collectShardPoints(shardIds, pars.find("bbox")->second, w, h, points,
+                       points2);
+  } else {
+    collectCachedPoints(r, renderCache, bbox, w, h, HEATMAP, pool, points,
+                        points2, 0);
+  }
+
+  // merge the per-thread counts into the first vector
+  auto& counts = points2[0];
+  for (size_t i = 1; i < NUM_THREADS; i++) {
+    for (auto p : points[i]) counts[p] += points2[i][p];
+    std::vector<double>().swap(points2[i]);
+  }
+
+  double max = 0;
+  for (auto c : counts) max = std::max(max, c);
+
+  // header: magic, version, bits per cell, 2 bytes padding, width, height,
+  // max count, all little-endian
+  std::string pl = "PMDG";
+  pl += static_cast<char>(1);
+  pl += static_cast<char>(bits);
+  pl += std::string(2, 0);
+
+  auto putLE = [&pl](uint32_t v) {
+    for (int i = 0; i < 4; i++) pl += static_cast<char>((v >> (8 * i)) & 0xFF);
+  };
+
+  float maxF = max;
+  uint32_t maxBits;
+  memcpy(&maxBits, &maxF, sizeof(maxBits));
+
+  putLE(w);
+  putLE(h);
+  putLE(maxBits);
+
+  // with 8 or 16 bits, counts are quantized on a log scale, a cell with value
+  // v has about exp(v / (2^bits - 1) * log(1 + max)) - 1 points, 0 means no
+  // points. With 32 bits, cells hold the exact counts as float32
+  double top = (1ull << bits) - 1;
+  double logMax = std::log1p(max);
+
+  pl.reserve(pl.size() + static_cast<size_t>(w) * h * (bits / 8));
+
+  for (auto c : counts) {
+    uint32_t v = 0;
+    if (bits == 32) {
+      float f = c;
+      memcpy(&v, &f, sizeof(v));
+    } else if (c > 0) {
+      v = std::max<double>(1, std::round(std::log1p(c) / logMax * top));
+    }
+    for (int i = 0; i < bits / 8; i++) {
+      pl += static_cast<char>((v >> (8 * i)) & 0xFF);
+    }
+  }
+
+  // the HTTP server compresses this if the client accepts gzip
+  auto answ = util::http::Answer("200 OK", pl);
+  answ.params["Content-Type"] = "application/octet-stream";
+  answ.params["Cache-Control"] = r && !r->getIndexHash().empty()
+                                     ? SESSION_CACHE_CONTROL
+                                     : SESSION_NO_CACHE;
+
+  return answ;
+}
+
+// _____________________________________________________________________________
+void Server::collectPoints(std::shared_ptr<const Requestor> r,
+                           const DBox& bbox, int w, int h, MapStyle style,
+                           TaskPool& pool,
+                           std::vector<std::vector<uint32_t>>& points,
+                           std::vector<std::vector<double>>& points2,
+                           unsigned char* image) const {
+  double mercW = fabs(bbox.getUpperRight().getX() - bbox.getLowerLeft().getX());
+  double mercH = fabs(bbox.getUpperRight().getY() - bbox.getLowerLeft().getY());
+
+  auto fbbox = FBox({bbox.getLowerLeft().getX(), bbox.getLowerLeft().getY()},
+                    {bbox.getUpperRight().getX(), bbox.getUpperRight().getY()});
+
+  double res = mercH / h;
+
+  double virtCellSize = res * 2.5;
+
+  // the grid cell sizes depend on the density of the result
+  size_t subCellSize =
+      (size_t)ceil(r->getPointGrid().getCellWidth() / virtCellSize);
+  size_t lSubCellSize =
+      (size_t)ceil(r->getLinePointGrid().getCellWidth() / virtCellSize);
+
+  LOG(INFO) << "[SERVER] Query resolution: " << res;
+  LOG(INFO) << "[SERVER] Virt cell size: " << virtCellSize;
+  LOG(INFO) << "[SERVER] Num virt cells: " << subCellSize * subCellSize;
+
+  // object mode views covered by the cluster index show cluster markers
+  int clusterZoom = -1;
+  if (style == OBJECTS) clusterZoom = r->getClusterIndex().zoomLevel(res);
+
   if (intersects(r->getPointGrid().getBBox(), fbbox)) {
     LOG(INFO) << "[SERVER] Looking up display points...";
-    if (res < THRESHOLD) {
+    if (clusterZoom >= 0) {
+      LOG(INFO) << "[SERVER] Using clusters of zoom level " << clusterZoom;
+      std::vector<const PointCluster*> clusters;
+      r->getClusterIndex().get(clusterZoom, fbbox, &clusters);
+
+      for (const auto* c : clusters) {
+        int px = ((c->pos.getX() - bbox.getLowerLeft().getX()) / mercW) * w;
+        int py =
+            h - ((c->pos.getY() - bbox.getLowerLeft().getY()) / mercH) * h;
+        drawCluster(points[0], points2[0], px, py, w, h, c->num);
+      }
+    } else if (res < THRESHOLD) {
       std::vector<ID_TYPE> ret;
 
       // duplicates are not possible with points
@@ -222,7 +786,7 @@ util::http::Answer Server::handleHeatMapReq(const Params& pars,
 
         if (i >= objs.size() && style == OBJECTS) {
           size_t cid = i - objs.size();
-          const auto& p = r->getPoint(objs[r->getClusters()[cid].first].first);
+          const auto& p = r->getPoint(objs.geom(r->getClusters()[cid].oid));
 
           if (!contains(p, fbbox)) continue;
 
@@ -235,10 +799,10 @@ util::http::Answer Server::handleHeatMapReq(const Params& pars,
           int ppy = h - ((p.getY() - bbox.getLowerLeft().getY()) / mercH) * h;
 
           drawPoint(points[0], points2[0], px, py, w, h, style, 1);
-          drawLine(image.data(), ppx, ppy, px, py, w, h);
+          drawLine(image, ppx, ppy, px, py, w, h);
         } else {
-          if (i >= objs.size()) i = r->getClusters()[i - objs.size()].first;
-          const auto& p = r->getPoint(objs[i].first);
+          if (i >= objs.size()) i = r->getClusters()[i - objs.size()].oid;
+          const auto& p = r->getPoint(objs.geom(i));
           if (!contains(p, fbbox)) continue;
 
           int px = ((p.getX() - bbox.getLowerLeft().getX()) / mercW) * w;
@@ -252,51 +816,58 @@ util::http::Answer Server::handleHeatMapReq(const Params& pars,
       auto iBox = intersection(r->getPointGrid().getBBox(), fbbox);
       const auto& grid = r->getPointGrid();
 
-#pragma omp parallel for num_threads(NUM_THREADS) schedule(static)
-      for (size_t x = grid.getCellXFromX(iBox.getLowerLeft().getX());
-           x <= grid.getCellXFromX(iBox.getUpperRight().getX()); x++) {
-        for (size_t y = grid.getCellYFromY(iBox.getLowerLeft().getY());
-             y <= grid.getCellYFromY(iBox.getUpperRight().getY()); y++) {
-          if (x >= grid.getXWidth() || y >= grid.getYHeight()) {
-            continue;
-          }
+      size_t xStart = grid.getCellXFromX(iBox.getLowerLeft().getX());
+      size_t xEnd = grid.getCellXFromX(iBox.getUpperRight().getX()) + 1;
 
-          auto cell = grid.getCell(x, y);
-          if (!cell || cell->size() == 0) continue;
-          const auto& cellBox = grid.getBox(x, y);
-
-          if (subCellSize == 1) {
-            int px =
-                ((cellBox.getLowerLeft().getX() - bbox.getLowerLeft().getX()) /
-                 mercW) *
-                w;
-            int py =
-                h -
-                ((cellBox.getLowerLeft().getY() - bbox.getLowerLeft().getY()) /
-                 mercH) *
-                    h;
-
-            drawPoint(points[omp_get_thread_num()],
-                      points2[omp_get_thread_num()], px, py, w, h, style,
-                      cell->size());
-          } else {
-            for (auto i : *cell) {
-              if (i >= r->getObjects().size()) {
-                assert(i - r->getObjects().size() < r->getClusters().size());
-                i = r->getClusters()[i - r->getObjects().size()].first;
+      pool.parallelFor(xEnd - xStart, 0, [&](size_t b, size_t e, size_t t) {
+        for (size_t x = xStart + b; x < xStart + e; x++) {
+          for (size_t y = grid.getCellYFromY(iBox.getLowerLeft().getY());
+               y <= grid.getCellYFromY(iBox.getUpperRight().getY()); y++) {
+            if (x >= grid.getXWidth() || y >= grid.getYHeight()) {
+              continue;
+            }
+
+            auto cell = grid.getCell(x, y);
+            if (cell.size() == 0) continue;
+            const auto& cellBox = grid.getBox(x, y);
+
+            if (subCellSize == 1) {
+              int px = ((cellBox.getLowerLeft().getX() -
+                         bbox.getLowerLeft().getX()) /
+                        mercW) *
+                       w;
+              int py = h - ((cellBox.getLowerLeft().getY() -
+                             bbox.getLowerLeft().getY()) /
+                            mercH) *
+                               h;
+
+              drawPoint(points[t], points2[t], px, py, w, h, style,
+                        cell.size());
+            } else {
+              // the offsets inside the cell are an affine transform away
+              // from the pixel coordinates, no need to look up the points
+              auto qcell = r->getPointOffsetGrid().getCell(x, y);
+
+              double ax = grid.getCellWidth() / 65536 / mercW * w;
+              double ay = grid.getCellHeight() / 65536 / mercH * h;
+              double bx = (grid.getBBox().getLowerLeft().getX() +
+                           x * grid.getCellWidth() -
+                           bbox.getLowerLeft().getX()) /
+                          mercW * w;
+              double by = h - (grid.getBBox().getLowerLeft().getY() +
+                               y * grid.getCellHeight() -
+                               bbox.getLowerLeft().getY()) /
+                                  mercH * h;
+
+              for (const auto& p : qcell) {
+                int px = bx + p.getX() * ax;
+                int py = by - p.getY() * ay;
+                drawPoint(points[t], points2[t], px, py, w, h, style, 1);
               }
-              assert(i < r->getObjects().size());
-              const auto& p = r->getPoint(r->getObjects()[i].first);
-
-              int px = ((p.getX() - bbox.getLowerLeft().getX()) / mercW) * w;
-              int py =
-                  h - ((p.getY() - bbox.getLowerLeft().getY()) / mercH) * h;
-              drawPoint(points[omp_get_thread_num()],
-                        points2[omp_get_thread_num()], px, py, w, h, style, 1);
             }
           }
         }
-      }
+      });
     }
   }
 
@@ -308,47 +879,24 @@ util::http::Answer Server::handleHeatMapReq(const Params& pars,
     if (res < THRESHOLD) {
       std::vector<ID_TYPE> ret;
 
+      // the hierarchical grid does not return duplicates
       lgrid.get(fbbox, &ret);
 
-      // sort to avoid duplicates
-      std::sort(ret.begin(), ret.end());
-
       for (size_t idx = 0; idx < ret.size(); idx++) {
-        if (idx > 0 && ret[idx] == ret[idx - 1]) continue;
-        auto lid = r->getObjects()[ret[idx]].first;
+        auto lid = r->getObjects().geom(ret[idx]);
         const auto& lbox = r->getLineBBox(lid - I_OFFSET);
         if (!intersects(lbox, bbox)) continue;
 
-        size_t gi = 0;
-
-        size_t start = r->getLine(lid - I_OFFSET);
-        size_t end = r->getLineEnd(lid - I_OFFSET);
-
         // ___________________________________
         bool isects = false;
 
         DPoint curPa, curPb;
         int s = 0;
 
-        double mainX = 0;
-        double mainY = 0;
-        for (size_t i = start; i < end; i++) {
-          // extract real geom
-          const auto& cur = r->getLinePoints()[i];
-
-          if (isMCoord(cur.getX())) {
-            mainX = rmCoord(cur.getX());
-            mainY = rmCoord(cur.getY());
-            continue;
-          }
+        auto reader = r->getLineReader(lid - I_OFFSET);
+        DPoint curP;
 
-          // skip bounding box at beginning
-          gi++;
-          if (gi < 3) continue;
-
-          // extract real geometry
-          const DPoint curP((mainX * M_COORD_GRANULARITY + cur.getX()) / 10.0,
-                            (mainY * M_COORD_GRANULARITY + cur.getY()) / 10.0);
+        while (reader.next(&curP)) {
           if (s == 0) {
             curPa = curP;
             s++;
@@ -389,136 +937,58 @@ util::http::Answer Server::handleHeatMapReq(const Params& pars,
       const auto& lpgrid = r->getLinePointGrid();
       auto iBox = intersection(lpgrid.getBBox(), fbbox);
 
-#pragma omp parallel for num_threads(NUM_THREADS) schedule(static)
-      for (size_t x = lpgrid.getCellXFromX(iBox.getLowerLeft().getX());
-           x <= lpgrid.getCellXFromX(iBox.getUpperRight().getX()); x++) {
-        for (size_t y = lpgrid.getCellYFromY(iBox.getLowerLeft().getY());
-             y <= lpgrid.getCellYFromY(iBox.getUpperRight().getY()); y++) {
-          if (x >= lpgrid.getXWidth() || y >= lpgrid.getYHeight()) continue;
-
-          auto cell = lpgrid.getCell(x, y);
-          if (!cell || cell->size() == 0) continue;
-          const auto& cellBox = lpgrid.getBox(x, y);
-
-          if (subCellSize == 1) {
-            int px =
-                ((cellBox.getLowerLeft().getX() - bbox.getLowerLeft().getX()) /
-                 mercW) *
-                w;
-            int py =
-                h -
-                ((cellBox.getLowerLeft().getY() - bbox.getLowerLeft().getY()) /
-                 mercH) *
-                    h;
-            if (px >= 0 && py >= 0 && px < w && py < h) {
-              if (points2[omp_get_thread_num()][w * py + px] == 0)
-                points[omp_get_thread_num()].push_back(w * py + px);
-              points2[omp_get_thread_num()][py * w + px] += cell->size();
-            }
-          } else {
-            for (const auto& p : *cell) {
-              int px = ((cellBox.getLowerLeft().getX() + p.getX() * 256 -
+      size_t xStart = lpgrid.getCellXFromX(iBox.getLowerLeft().getX());
+      size_t xEnd = lpgrid.getCellXFromX(iBox.getUpperRight().getX()) + 1;
+
+      pool.parallelFor(xEnd - xStart, 0, [&](size_t b, size_t e, size_t t) {
+        for (size_t x = xStart + b; x < xStart + e; x++) {
+          for (size_t y = lpgrid.getCellYFromY(iBox.getLowerLeft().getY());
+               y <= lpgrid.getCellYFromY(iBox.getUpperRight().getY()); y++) {
+            if (x >= lpgrid.getXWidth() || y >= lpgrid.getYHeight()) continue;
+
+            auto cell = lpgrid.getCell(x, y);
+            if (cell.size() == 0) continue;
+            const auto& cellBox = lpgrid.getBox(x, y);
+
+            if (lSubCellSize == 1) {
+              int px = ((cellBox.getLowerLeft().getX() -
                          bbox.getLowerLeft().getX()) /
                         mercW) *
                        w;
-              int py = h - ((cellBox.getLowerLeft().getY() + p.getY() * 256 -
+              int py = h - ((cellBox.getLowerLeft().getY() -
                              bbox.getLowerLeft().getY()) /
                             mercH) *
                                h;
               if (px >= 0 && py >= 0 && px < w && py < h) {
-                if (points2[omp_get_thread_num()][w * py + px] == 0)
-                  points[omp_get_thread_num()].push_back(w * py + px);
-                points2[omp_get_thread_num()][py * w + px] += 1;
+                if (points2[t][w * py + px] == 0)
+                  points[t].push_back(w * py + px);
+                points2[t][py * w + px] += cell.size();
+              }
+            } else {
+              // sub cell coordinates are in 1/256th of the cell size
+              double subW = lpgrid.getCellWidth() / 256;
+              double subH = lpgrid.getCellHeight() / 256;
+              for (const auto& p : cell) {
+                int px = ((cellBox.getLowerLeft().getX() + p.getX() * subW -
+                           bbox.getLowerLeft().getX()) /
+                          mercW) *
+                         w;
+                int py = h - ((cellBox.getLowerLeft().getY() + p.getY() * subH -
+                               bbox.getLowerLeft().getY()) /
+                              mercH) *
+                                 h;
+                if (px >= 0 && py >= 0 && px < w && py < h) {
+                  if (points2[t][w * py + px] == 0)
+                    points[t].push_back(w * py + px);
+                  points2[t][py * w + px] += 1;
+                }
               }
             }
           }
         }
-      }
-    }
-  }
-
-  LOG(INFO) << "[SERVER] Adding points to heatmap...";
-
-  if (style == OBJECTS) {
-    auto stamp = heatmap_stamp_gen(3);
-    for (size_t i = 0; i < NUM_THREADS; i++) {
-      for (const auto& p : points[i]) {
-        size_t y = p / w;
-        size_t x = p - (y * w);
-        if (points2[i][p] > 0)
-          heatmap_add_weighted_point_with_stamp(hm, x, y, 1, stamp);
-      }
-    }
-    heatmap_stamp_free(stamp);
-  } else {
-    for (size_t i = 0; i < NUM_THREADS; i++) {
-      for (const auto& p : points[i]) {
-        size_t y = p / w;
-        size_t x = p - (y * w);
-        if (points2[i][p] > 0)
-          heatmap_add_weighted_point(hm, x, y, points2[i][p]);
-      }
-    }
-  }
-
-  LOG(INFO) << "[SERVER] ...done";
-  LOG(INFO) << "[SERVER] Rendering heatmap...";
-
-  if (style == OBJECTS) {
-    static const unsigned char discrete_data[] = {
-        0,   0,   0,   0,   0,   0,   0,   0,   51,  136, 255, 16,  51,  136,
-        255, 32,  51,  136, 255, 64,  51,  136, 255, 128, 51,  136, 255, 160,
-        51,  136, 255, 192, 51,  136, 255, 224, 51,  136, 255, 255};
-    static const heatmap_colorscheme_t discrete = {
-        discrete_data, sizeof(discrete_data) / sizeof(discrete_data[0] / 4)};
-
-    heatmap_render_saturated_to(hm, &discrete, 1, &image[0]);
-  } else {
-    heatmap_render_to(hm, heatmap_cs_Spectral_mixed_exp, &image[0]);
-  }
-
-  heatmap_free(hm);
-
-  LOG(INFO) << "[SERVER] ...done";
-  LOG(INFO) << "[SERVER] Generating PNG...";
-
-  auto aw = util::http::Answer("200 OK", "");
-  aw.params["Content-Type"] = "image/png";
-  aw.params["Content-Encoding"] = "identity";
-  aw.params["Server"] = "qlever-petrimaps";
-  aw.raw = true;
-
-  // we do not set the Content-Length header here, but serve until
-  // we are done. In particular, we do not need to send our data in chunks, as
-  // specified by https://www.rfc-editor.org/rfc/rfc7230#section-3.3.3
-  // point 7
-
-  std::stringstream ss;
-  ss << "HTTP/1.1 200 OK" << aw.status << "\r\n";
-  for (const auto& kv : aw.params)
-    ss << kv.first << ": " << kv.second << "\r\n";
-
-  ss << "\r\n";
-
-  std::string buff = ss.str();
-
-  size_t writes = 0;
-
-  while (writes != buff.size()) {
-    int64_t out =
-        send(sock, buff.c_str() + writes, buff.size() - writes, MSG_NOSIGNAL);
-    if (out < 0) {
-      if (errno == EWOULDBLOCK || errno == EAGAIN || errno == EINTR) continue;
-      throw std::runtime_error("Failed to write to socket");
+      });
     }
-    writes += out;
   }
-
-  writePNG(&image[0], w, h, sock);
-
-  LOG(INFO) << "[SERVER] ...done";
-
-  return aw;
 }
 
 // _____________________________________________________________________________
@@ -562,7 +1032,7 @@ util::http::Answer Server::handleGeoJSONReq(const Params& pars) const {
   util::json::Val dict;
 
   if (!noExport) {
-    for (auto col : reqor->requestRow(reqor->getObjects()[gid].second)) {
+    for (auto col : reqor->requestRow(reqor->getObjects().row(gid))) {
       dict.dict[col.first] = col.second;
     }
   }
@@ -656,7 +1126,13 @@ util::http::Answer Server::handlePosReq(const Params& pars) const {
   }
   // as soon as we are ready, the reqor can be read concurrently
 
-  auto res = reqor->getNearest({x, y}, rad, reso, fbbox);
+  // object mode views covered by the cluster index show cluster markers
+  int clusterZoom = -1;
+  if (style == OBJECTS) {
+    clusterZoom = reqor->getClusterIndex().zoomLevel(mercH / h);
+  }
+
+  auto res = reqor->getNearest({x, y}, rad, reso, fbbox, clusterZoom);
 
   std::stringstream json;
 
@@ -664,6 +1140,7 @@ util::http::Answer Server::handlePosReq(const Params& pars) const {
 
   if (res.has) {
     json << "{\"id\" :" << res.id;
+    json << ",\"dist\" : " << res.dist;
     json << ",\"attrs\" : [";
 
     bool first = true;
@@ -682,6 +1159,7 @@ util::http::Answer Server::handlePosReq(const Params& pars) const {
         webMercToLatLng<float>(res.pos.front().getX(), res.pos.front().getY());
 
     json << "]";
+    if (res.clusterSize > 1) json << ",\"clustered\" : " << res.clusterSize;
     json << std::setprecision(10) << ",\"ll\":{\"lat\" : " << ll.getY()
          << ",\"lng\":" << ll.getX() << "}";
 
@@ -738,8 +1216,9 @@ util::http::Answer Server::handleLoadReq(const Params& pars) const {
 
   LOG(INFO) << "[SERVER] Queried backend is " << backend;
 
-  createCache(backend);
-  loadCache(backend);
+  std::string indexHash;
+  auto cache = createCache(backend, &indexHash);
+  loadCache(cache, indexHash);
 
   auto answ = util::http::Answer("200 OK", "{}");
   answ.params["Content-Type"] = "application/json; charset=utf-8";
@@ -758,27 +1237,32 @@ util::http::Answer Server::handleQueryReq(const Params& pars) const {
   LOG(INFO) << "[SERVER] Queried backend is " << backend;
   LOG(INFO) << "[SERVER] Query is:\n" << query;
 
-  createCache(backend);
-  std::string indexHash = loadCache(backend);
+  std::string indexHash;
+  auto cache = createCache(backend, &indexHash);
+  indexHash = loadCache(cache, indexHash);
 
-  std::string queryId = backend + "$" + indexHash + "$" + query;
+  std::string key = cacheKey(backend, indexHash);
+  std::string sessionId = getSessionId(key, query);
 
   std::shared_ptr<Requestor> reqor;
-  std::string sessionId;
+  bool newSession = false;
 
   {
     std::lock_guard<std::mutex> guard(_m);
-    if (_queryCache.count(queryId)) {
-      sessionId = _queryCache[queryId];
+    if (_rs.count(sessionId)) {
+      if (_sessionQueries[sessionId] != sessionQuery(key, query)) {
+        throw std::runtime_error("Session id collision.");
+      }
       reqor = _rs[sessionId];
     } else {
       reqor = std::shared_ptr<Requestor>(
-          new Requestor(_caches[backend], _maxMemory));
-
-      sessionId = getSessionId();
+          new Requestor(cache, backend, _maxMemory, _cacheDir));
 
       _rs[sessionId] = reqor;
-      _queryCache[queryId] = sessionId;
+      _sessionQueries[sessionId] = sessionQuery(key, query);
+      _renderCaches[sessionId] =
+          std::shared_ptr<RenderCache>(new RenderCache());
+      newSession = true;
     }
   }
 
@@ -798,6 +1282,12 @@ util::http::Answer Server::handleQueryReq(const Params& pars) const {
     return answ;
   }
 
+  if (newSession) {
+    std::lock_guard<std::mutex> guard(_m);
+    _prerenderQueue.push_back(sessionId);
+    _prerenderCv.notify_one();
+  }
+
   auto bbox = reqor->getPointGrid().getBBox();
   bbox = extendBox(reqor->getLineGrid().getBBox(), bbox);
 
@@ -813,7 +1303,309 @@ util::http::Answer Server::handleQueryReq(const Params& pars) const {
 
   std::stringstream json;
   json << std::fixed << "{\"qid\" : \"" << sessionId << "\",\"bounds\":[["
-       << llX << "," << llY << "],[" << urX << "," << urY << "]]"
+       << llX << "," << llY << "],[" << urX << "," << urY << "]]"
+       << ",\"numobjects\":" << numObjs << "}";
+
+  auto answ = util::http::Answer("200 OK", json.str());
+  answ.params["Content-Type"] = "application/json; charset=utf-8";
+
+  return answ;
+}
+
+// _____________________________________________________________________________
+void Server::setShard(size_t shard, size_t numShards) {
+  _shard = shard;
+  _numShards = numShards;
+}
+
+// _____________________________________________________________________________
+void Server::setShards(const std::vector<std::string>& shardUrls) {
+  _shardClient.reset(new ShardClient(shardUrls));
+}
+
+// _____________________________________________________________________________
+void Server::setPeers(const std::vector<std::string>& peerUrls) {
+  _peers = peerUrls;
+}
+
+// _____________________________________________________________________________
+util::http::Answer Server::handleCoordinatorReq(const std::string& cmd,
+                                                const Params& pars) const {
+  if (cmd == "/query") return handleShardedQueryReq(pars);
+
+  if (cmd == "/load") {
+    _shardClient->get(cmd, pars);
+    auto answ = util::http::Answer("200 OK", "{}");
+    answ.params["Content-Type"] = "application/json; charset=utf-8";
+    return answ;
+  }
+
+  if (cmd == "/loadstatus") {
+    // the slowest shard determines the progress
+    const std::string key = "\"percent\": ";
+    std::string ret;
+    double min = std::numeric_limits<double>::infinity();
+    for (const auto& status : _shardClient->get(cmd, pars)) {
+      size_t pos = status.find(key);
+      if (pos == std::string::npos) continue;
+      double percent = atof(status.c_str() + pos + key.size());
+      if (percent < min) {
+        min = percent;
+        ret = status;
+      }
+    }
+
+    if (ret.empty()) throw std::runtime_error("Invalid load status of shard.");
+    return util::http::Answer("200 OK", ret);
+  }
+
+  if (cmd == "/loadstatus/stream") {
+    // clients fall back to polling /loadstatus
+    return util::http::Answer("503 Service Unavailable",
+                              "No load status streams on coordinator.");
+  }
+
+  if (cmd == "/clearsession" || cmd == "/clearsessions") {
+    std::string id;
+    if (pars.count("id") != 0) id = pars.find("id")->second;
+
+    std::vector<std::map<std::string, std::string>> shardPars(
+        _shardClient->size());
+    {
+      std::lock_guard<std::mutex> guard(_m);
+      if (id.size() && _shardSessions.count(id)) {
+        for (size_t i = 0; i < shardPars.size(); i++) {
+          shardPars[i]["id"] = _shardSessions[id].ids[i];
+        }
+      }
+    }
+
+    if (id.empty() || shardPars[0].size()) {
+      try {
+        _shardClient->get(cmd, shardPars);
+      } catch (const std::exception& e) {
+        // shards expire their sessions on their own
+        LOG(WARN) << "[SERVER] " << e.what();
+      }
+    }
+
+    return handleClearSessReq(pars);
+  }
+
+  if (cmd == "/pos") return handleShardedPosReq(shardParams(pars));
+  if (cmd == "/geojson") return handleShardedGeoJSONReq(shardParams(pars));
+  if (cmd == "/export") return handleShardedExportReq(shardParams(pars));
+
+  return util::http::Answer("501 Not Implemented",
+                            "Not supported by the coordinator.");
+}
+
+// _____________________________________________________________________________
+std::vector<Params> Server::shardParams(const Params& pars) const {
+  if (pars.count("id") == 0 || pars.find("id")->second.empty())
+    throw std::invalid_argument("No session id (?id=) specified.");
+  auto id = pars.find("id")->second;
+
+  std::vector<Params> ret(_shardClient->size(), pars);
+
+  std::lock_guard<std::mutex> guard(_m);
+  if (!_shardSessions.count(id)) {
+    throw std::invalid_argument("Session not found");
+  }
+  for (size_t i = 0; i < ret.size(); i++) {
+    ret[i]["id"] = _shardSessions[id].ids[i];
+  }
+
+  return ret;
+}
+
+// _____________________________________________________________________________
+util::http::Answer Server::handleShardedPosReq(
+    const std::vector<Params>& pars) const {
+  auto answers = _shardClient->get("/pos", pars);
+
+  // the shards answer in the fixed format written by handlePosReq(), with
+  // at most one object each
+  const std::string idKey = "{\"id\" :";
+  const std::string distKey = ",\"dist\" : ";
+
+  size_t best = answers.size();
+  double dBest = std::numeric_limits<double>::infinity();
+
+  for (size_t i = 0; i < answers.size(); i++) {
+    size_t pos = answers[i].find(distKey);
+    if (pos == std::string::npos) continue;
+    double d = atof(answers[i].c_str() + pos + distKey.size());
+    if (d < dBest) {
+      dBest = d;
+      best = i;
+    }
+  }
+
+  std::string json = "[]";
+
+  if (best < answers.size()) {
+    json = answers[best];
+    size_t idPos = json.find(idKey);
+    size_t distPos = json.find(distKey);
+    if (idPos == std::string::npos || distPos < idPos) {
+      throw std::runtime_error("Invalid position answer of shard: " + json);
+    }
+
+    // object ids are local to their shard, the shard is encoded into the
+    // id for subsequent /geojson requests
+    idPos += idKey.size();
+    size_t oid = strtoull(json.c_str() + idPos, 0, 10);
+    json.replace(idPos, distPos - idPos,
+                 std::to_string(oid * answers.size() + best));
+  }
+
+  auto answ = util::http::Answer("200 OK", json);
+  answ.params["Content-Type"] = "application/json; charset=utf-8";
+
+  return answ;
+}
+
+// _____________________________________________________________________________
+util::http::Answer Server::handleShardedGeoJSONReq(
+    std::vector<Params> pars) const {
+  const auto& p = pars.front();
+  if (p.count("gid") == 0 || p.find("gid")->second.empty())
+    throw std::invalid_argument("No geom id (?gid=) specified.");
+  size_t gid = strtoull(p.find("gid")->second.c_str(), 0, 10);
+
+  bool noExport = p.count("export") == 0 || p.find("export")->second.empty() ||
+                  !std::atoi(p.find("export")->second.c_str());
+
+  // see handleShardedPosReq()
+  size_t shard = gid % pars.size();
+  pars[shard]["gid"] = std::to_string(gid / pars.size());
+
+  auto answ = util::http::Answer(
+      "200 OK", _shardClient->get(shard, "/geojson", pars[shard]));
+  answ.params["Content-Type"] = "application/json; charset=utf-8";
+
+  if (!noExport) {
+    answ.params["Content-Disposition"] = "attachment;filename:\"export.json\"";
+  }
+
+  return answ;
+}
+
+// _____________________________________________________________________________
+util::http::Answer Server::handleShardedExportReq(
+    const std::vector<Params>& pars) const {
+  LOG(INFO) << "[SERVER] Collecting export from " << pars.size() << " shards";
+
+  // the shards answer with one feature collection each, which are merged
+  // in memory
+  auto answers = _shardClient->get("/export", pars);
+
+  const std::string head = "{\"type\":\"FeatureCollection\",\"features\":[";
+  const std::string tail = "]}";
+
+  std::string json = head;
+  bool first = true;
+
+  for (const auto& a : answers) {
+    size_t begin = a.find(head);
+    size_t end = a.rfind(tail);
+    if (begin == std::string::npos || end == std::string::npos ||
+        end < begin + head.size()) {
+      throw std::runtime_error("Invalid export of shard.");
+    }
+    begin += head.size();
+
+    // shards without results
+    if (a.find_first_not_of(" \r\n", begin) >= end) continue;
+
+    if (!first) json += ",";
+    json.append(a, begin, end - begin);
+    first = false;
+  }
+
+  json += tail;
+
+  auto answ = util::http::Answer("200 OK", json);
+  answ.params["Content-Type"] = "application/json";
+  answ.params["Content-Disposition"] = "attachment;filename:\"export.json\"";
+
+  return answ;
+}
+
+// _____________________________________________________________________________
+util::http::Answer Server::handleShardedQueryReq(const Params& pars) const {
+  if (pars.count("query") == 0 || pars.find("query")->second.empty())
+    throw std::invalid_argument("No query (?q=) specified.");
+  if (pars.count("backend") == 0 || pars.find("backend")->second.empty())
+    throw std::invalid_argument("No backend (?backend=) specified.");
+
+  LOG(INFO) << "[SERVER] Forwarding query to " << _shardClient->size()
+            << " shards";
+
+  auto answers = _shardClient->get("/query", pars);
+
+  // the shards answer in the fixed format written by handleQueryReq()
+  const std::string qidKey = "{\"qid\" : \"";
+  const std::string boundsKey = "\"bounds\":[[";
+  const std::string numKey = "\"numobjects\":";
+
+  std::vector<std::string> ids;
+  DBox bbox;
+  size_t numObjs = 0;
+
+  for (const auto& a : answers) {
+    size_t qidPos = a.find(qidKey);
+    size_t boundsPos = a.find(boundsKey);
+    size_t numPos = a.find(numKey);
+    if (qidPos == std::string::npos || boundsPos == std::string::npos ||
+        numPos == std::string::npos) {
+      throw std::runtime_error("Invalid query answer of shard: " + a);
+    }
+
+    qidPos += qidKey.size();
+    ids.push_back(a.substr(qidPos, a.find('"', qidPos) - qidPos));
+
+    double c[4];
+    const char* cur = a.c_str() + boundsPos + boundsKey.size();
+    for (size_t i = 0; i < 4; i++) {
+      char* end;
+      c[i] = strtod(cur, &end);
+      cur = end;
+      while (*cur == ',' || *cur == '[' || *cur == ']') cur++;
+    }
+
+    size_t num = strtoull(a.c_str() + numPos + numKey.size(), 0, 10);
+
+    // shards without results report an empty box
+    if (num > 0 || ids.size() == 1) {
+      DBox shardBox({c[0], c[1]}, {c[2], c[3]});
+      bbox = num > 0 && numObjs == 0 ? shardBox : extendBox(shardBox, bbox);
+    }
+    numObjs += num;
+  }
+
+  // the shard session ids are deterministic, and so is the id derived
+  // from them
+  std::string joined;
+  for (const auto& id : ids) joined += id + ",";
+  std::string sessionId = getSessionId("$shards", joined);
+  {
+    std::lock_guard<std::mutex> guard(_m);
+    if (_shardSessions.count(sessionId) &&
+        _shardSessions[sessionId].ids != ids) {
+      throw std::runtime_error("Session id collision.");
+    }
+    _shardSessions[sessionId] = {ids, std::chrono::system_clock::now()};
+  }
+
+  auto ll = bbox.getLowerLeft();
+  auto ur = bbox.getUpperRight();
+
+  std::stringstream json;
+  json << std::fixed << "{\"qid\" : \"" << sessionId << "\",\"bounds\":[["
+       << ll.getX() << "," << ll.getY() << "],[" << ur.getX() << ","
+       << ur.getY() << "]]"
        << ",\"numobjects\":" << numObjs << "}";
 
   auto answ = util::http::Answer("200 OK", json.str());
@@ -822,6 +1614,52 @@ util::http::Answer Server::handleQueryReq(const Params& pars) const {
   return answ;
 }
 
+// _____________________________________________________________________________
+void Server::collectShardPoints(
+    const std::vector<std::string>& ids, const std::string& bbox, int w, int h,
+    std::vector<std::vector<uint32_t>>& points,
+    std::vector<std::vector<double>>& points2) const {
+  std::vector<std::map<std::string, std::string>> pars(ids.size());
+  for (size_t i = 0; i < ids.size(); i++) {
+    pars[i]["id"] = ids[i];
+    pars[i]["bbox"] = bbox;
+    pars[i]["width"] = std::to_string(w);
+    pars[i]["height"] = std::to_string(h);
+    pars[i]["bits"] = "32";
+  }
+
+  auto grids = _shardClient->get("/density", pars, SHARD_RENDER_TIMEOUT);
+
+  size_t cells = static_cast<size_t>(w) * h;
+
+  for (const auto& g : grids) {
+    if (g.size() != 20 + 4 * cells || g.compare(0, 4, "PMDG") != 0 ||
+        g[4] != 1 || g[5] != 32) {
+      throw std::runtime_error("Invalid density grid of shard.");
+    }
+
+    const unsigned char* d = reinterpret_cast<const unsigned char*>(g.data());
+    auto getLE = [d](size_t pos) {
+      return static_cast<uint32_t>(d[pos]) | (d[pos + 1] << 8) |
+             (d[pos + 2] << 16) | (static_cast<uint32_t>(d[pos + 3]) << 24);
+    };
+
+    if (getLE(8) != static_cast<uint32_t>(w) ||
+        getLE(12) != static_cast<uint32_t>(h)) {
+      throw std::runtime_error("Invalid density grid size of shard.");
+    }
+
+    for (size_t i = 0; i < cells; i++) {
+      uint32_t v = getLE(20 + 4 * i);
+      float c;
+      memcpy(&c, &v, sizeof(c));
+      if (c <= 0) continue;
+      if (points2[0][i] == 0) points[0].push_back(i);
+      points2[0][i] += c;
+    }
+  }
+}
+
 // _____________________________________________________________________________
 std::string Server::parseUrl(std::string u, std::string pl,
                              std::map<std::string, std::string>* params) {
@@ -930,17 +1768,13 @@ void Server::writePNG(const unsigned char* data, size_t w, size_t h,
 
 // _____________________________________________________________________________
 void Server::clearSession(const std::string& id) const {
+  _shardSessions.erase(id);
+
   if (_rs.count(id)) {
     LOG(INFO) << "[SERVER] Clearing session " << id;
     _rs.erase(id);
-
-    for (auto it = _queryCache.cbegin(); it != _queryCache.cend();) {
-      if (it->second == id) {
-        it = _queryCache.erase(it);
-      } else {
-        ++it;
-      }
-    }
+    _sessionQueries.erase(id);
+    _renderCaches.erase(id);
   }
 }
 
@@ -948,7 +1782,9 @@ void Server::clearSession(const std::string& id) const {
 void Server::clearSessions() const {
   LOG(INFO) << "[SERVER] Clearing all sessions...";
   _rs.clear();
-  _queryCache.clear();
+  _sessionQueries.clear();
+  _renderCaches.clear();
+  _shardSessions.clear();
 }
 
 // _____________________________________________________________________________
@@ -967,6 +1803,15 @@ void Server::clearOldSessions() const {
     }
 
     std::lock_guard<std::mutex> guard(_m);
+
+    for (const auto& i : _shardSessions) {
+      if (std::chrono::duration_cast<std::chrono::minutes>(
+              std::chrono::system_clock::now() - i.second.createdAt)
+              .count() >= 1) {
+        toDel.push_back(i.first);
+      }
+    }
+
     for (const auto& id : toDel) {
       clearSession(id);
     }
@@ -1131,14 +1976,210 @@ util::http::Answer Server::handleExportReq(const Params& pars, int sock) const {
   return aw;
 }
 
+// _____________________________________________________________________________
+util::http::Answer Server::handleCacheFileReq(const Params& pars,
+                                              int sock) const {
+  // ignore SIGPIPE
+  signal(SIGPIPE, SIG_IGN);
+
+  if (pars.count("hash") == 0 || pars.find("hash")->second.empty())
+    throw std::invalid_argument("No index hash (?hash=) specified.");
+  auto hash = pars.find("hash")->second;
+
+  size_t shard = 0;
+  size_t numShards = 1;
+  if (pars.count("numshards") && !pars.find("numshards")->second.empty()) {
+    numShards = atoi(pars.find("numshards")->second.c_str());
+    if (pars.count("shard")) shard = atoi(pars.find("shard")->second.c_str());
+    if (numShards < 1 || shard >= numShards)
+      throw std::invalid_argument("Invalid shard.");
+  }
+
+  if (_cacheDir.empty()) {
+    return util::http::Answer("404 Not Found", "No cache dir.");
+  }
+
+  // the hash is sanitized by cacheFilePath(), so this stays in the cache dir
+  std::string fname = GeomCache::cacheFilePath(_cacheDir, "", hash) +
+                      GeomCache::shardName(shard, numShards);
+
+  // keep reading the opened file even if it is replaced meanwhile
+  int fd = open(fname.c_str(), O_RDONLY);
+  if (fd < 0) return util::http::Answer("404 Not Found", "No cache file.");
+
+  auto aw = util::http::Answer("200 OK", "");
+  aw.raw = true;
+
+  try {
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+      throw std::runtime_error("Could not stat " + fname);
+    }
+
+    std::string sum = cacheFileChecksum(fname, fd);
+
+    LOG(INFO) << "[SERVER] Sending cache file " << fname << " ("
+              << st.st_size << " bytes) to peer";
+
+    std::stringstream ss;
+    ss << "HTTP/1.1 200 OK\r\n"
+       << "Content-Type: application/octet-stream\r\n"
+       << "Content-Length: " << st.st_size << "\r\n"
+       << "X-Petrimaps-Checksum: " << sum << "\r\n"
+       << "Server: qlever-petrimaps\r\n\r\n";
+
+    bool connected = sendAll(sock, ss.str());
+
+    std::string buf(CACHE_FILE_BLOCK_SIZE, 0);
+    off_t pos = 0;
+    while (connected && pos < st.st_size) {
+      ssize_t n = pread(fd, &buf[0], buf.size(), pos);
+      if (n < 0 && errno == EINTR) continue;
+      if (n <= 0) throw std::runtime_error("Could not read " + fname);
+      connected = sendAll(
+          sock, static_cast<size_t>(n) == buf.size() ? buf : buf.substr(0, n));
+      pos += n;
+    }
+
+    if (!connected) LOG(WARN) << "[SERVER] Peer closed cache file transfer.";
+  } catch (...) {
+    close(fd);
+    throw;
+  }
+
+  close(fd);
+
+  return aw;
+}
+
+// _____________________________________________________________________________
+std::string Server::cacheFileChecksum(const std::string& fname, int fd) const {
+  struct stat st;
+  if (fstat(fd, &st) != 0) throw std::runtime_error("Could not stat " + fname);
+
+  {
+    std::lock_guard<std::mutex> guard(_m);
+    auto it = _cacheFileChecksums.find(fname);
+    if (it != _cacheFileChecksums.end() &&
+        it->second.size == static_cast<size_t>(st.st_size) &&
+        it->second.mtime == st.st_mtime) {
+      return it->second.sum;
+    }
+  }
+
+  LOG(INFO) << "[SERVER] Computing checksum of cache file " << fname << "...";
+
+  Checksum sum;
+  std::string buf(CACHE_FILE_BLOCK_SIZE, 0);
+  off_t pos = 0;
+  while (pos < st.st_size) {
+    ssize_t n = pread(fd, &buf[0], buf.size(), pos);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) throw std::runtime_error("Could not read " + fname);
+    sum.update(buf.data(), n);
+    pos += n;
+  }
+
+  std::lock_guard<std::mutex> guard(_m);
+  _cacheFileChecksums[fname] = {static_cast<size_t>(st.st_size), st.st_mtime,
+                                sum.hex()};
+  return sum.hex();
+}
+
 // _____________________________________________________________________________
 util::http::Answer Server::handleLoadStatusReq(const Params& pars) const {
   if (pars.count("backend") == 0 || pars.find("backend")->second.empty())
     throw std::invalid_argument("No backend (?backend=) specified.");
   auto backend = pars.find("backend")->second;
-  createCache(backend);
-  std::shared_ptr<GeomCache> cache = _caches[backend];
+  std::string query;
+  if (pars.count("query")) query = pars.find("query")->second;
 
+  auto cache = createCache(backend, 0);
+
+  util::http::Answer ans =
+      util::http::Answer("200 OK", loadStatusJson(cache, backend, query));
+
+  return ans;
+}
+
+// _____________________________________________________________________________
+util::http::Answer Server::handleLoadStatusStreamReq(const Params& pars,
+                                                     int sock) const {
+  // ignore SIGPIPE
+  signal(SIGPIPE, SIG_IGN);
+
+  if (pars.count("backend") == 0 || pars.find("backend")->second.empty())
+    throw std::invalid_argument("No backend (?backend=) specified.");
+  auto backend = pars.find("backend")->second;
+  std::string query;
+  if (pars.count("query")) query = pars.find("query")->second;
+
+  // every stream blocks one thread of the HTTP server, so only allow half
+  // of them to be used for streams. Clients fall back to polling otherwise
+  size_t maxStreams = std::max(1u, std::thread::hardware_concurrency() / 2);
+
+  if (++_numLoadStreams > maxStreams) {
+    _numLoadStreams--;
+    return util::http::Answer("503 Service Unavailable",
+                              "Too many load status streams.");
+  }
+
+  auto aw = util::http::Answer("200 OK", "");
+  aw.raw = true;
+
+  try {
+    // if the cache is dropped because loading failed, the client will
+    // close the stream after its query failed
+    auto cache = createCache(backend, 0);
+
+    std::stringstream ss;
+    ss << "HTTP/1.1 200 OK\r\n"
+       << "Content-Type: text/event-stream\r\n"
+       << "Cache-Control: no-cache\r\n"
+       << "Access-Control-Allow-Origin: *\r\n"
+       << "Server: qlever-petrimaps\r\n\r\n";
+
+    std::string last;
+    auto lastSent = std::chrono::steady_clock::now();
+    bool open = sendAll(sock, ss.str());
+
+    while (open) {
+      std::string status = loadStatusJson(cache, backend, query);
+      bool done = isLoadDone(cache, backend, query);
+
+      auto now = std::chrono::steady_clock::now();
+
+      if (status != last) {
+        open = sendAll(sock, "data: " + status + "\n\n");
+        last = status;
+        lastSent = now;
+      } else if (now - lastSent >= LOADSTATUS_STREAM_KEEPALIVE) {
+        // detects clients which have gone away
+        open = sendAll(sock, ": keepalive\n\n");
+        lastSent = now;
+      }
+
+      if (done) {
+        if (open) sendAll(sock, "event: done\ndata: {}\n\n");
+        break;
+      }
+
+      std::this_thread::sleep_for(LOADSTATUS_STREAM_INTERVAL);
+    }
+  } catch (...) {
+    _numLoadStreams--;
+    throw;
+  }
+
+  _numLoadStreams--;
+
+  return aw;
+}
+
+// _____________________________________________________________________________
+std::string Server::loadStatusJson(std::shared_ptr<GeomCache> cache,
+                                   const std::string& backend,
+                                   const std::string& query) const {
   // We have 3 loading stages:
   // 1) Filling geometry cache / reading cache from disk
   // 2) Fetching geometries
@@ -1151,20 +2192,176 @@ util::http::Answer Server::handleLoadStatusReq(const Params& pars) const {
   double serverPercent = 0.05;
   double geomCacheLoadStatusPercent = cache->getLoadStatusPercent(true);
   double serverLoadStatusPercent = getLoadStatusPercent();
-  double totalPercent = geomCachePercent * geomCacheLoadStatusPercent +
-                        serverPercent * serverLoadStatusPercent;
 
   int loadStatusStage = cache->getLoadStatusStage();
   size_t totalProgress = cache->getTotalProgress();
   size_t currentProgress = cache->getCurrentProgress();
+  int phase = 0;
+
+  // once the cache is ready, report the phase of building the session
+  auto reqor = getSession(cache, backend, query);
+  if (reqor) {
+    phase = reqor->getBuildPhase();
+    geomCacheLoadStatusPercent = 100;
+    serverLoadStatusPercent = 100.0 * phase / Requestor::Done;
+    loadStatusStage = 4;
+    totalProgress = Requestor::Done;
+    currentProgress = phase;
+  }
+
+  double totalPercent = geomCachePercent * geomCacheLoadStatusPercent +
+                        serverPercent * serverLoadStatusPercent;
 
   std::stringstream json;
   json << "{\"percent\": " << totalPercent << ", \"stage\": " << loadStatusStage
-       << ", \"totalProgress\": " << totalProgress
+       << ", \"phase\": " << phase << ", \"totalProgress\": " << totalProgress
        << ", \"currentProgress\": " << currentProgress << "}";
-  util::http::Answer ans = util::http::Answer("200 OK", json.str());
 
-  return ans;
+  return json.str();
+}
+
+// _____________________________________________________________________________
+bool Server::isLoadDone(std::shared_ptr<const GeomCache> cache,
+                        const std::string& backend,
+                        const std::string& query) const {
+  if (!cache->ready()) return false;
+  if (query.empty()) return true;
+
+  auto reqor = getSession(cache, backend, query);
+  return reqor && reqor->getBuildPhase() == Requestor::Done;
+}
+
+// _____________________________________________________________________________
+std::shared_ptr<petrimaps::Requestor> Server::getSession(
+    std::shared_ptr<const GeomCache> cache, const std::string& backend,
+    const std::string& query) const {
+  if (query.empty() || !cache->ready()) return nullptr;
+
+  std::lock_guard<std::mutex> guard(_m);
+
+  std::string key = cacheKey(backend, cache->getIndexHash());
+  auto it = _rs.find(getSessionId(key, query));
+  if (it == _rs.end()) return nullptr;
+  if (_sessionQueries[it->first] != sessionQuery(key, query)) return nullptr;
+
+  return it->second;
+}
+
+// _____________________________________________________________________________
+bool Server::sendAll(int sock, const std::string& data) {
+  size_t writes = 0;
+
+  while (writes != data.size()) {
+    int64_t out =
+        send(sock, data.c_str() + writes, data.size() - writes, MSG_NOSIGNAL);
+    if (out < 0) {
+      if (errno == EWOULDBLOCK || errno == EAGAIN || errno == EINTR) continue;
+      return false;
+    }
+    writes += out;
+  }
+
+  return true;
+}
+
+// _____________________________________________________________________________
+void Server::prerender() const {
+  // pre-rendering has its own pool without workers, so it never takes
+  // threads away from interactive requests
+  TaskPool pool(0);
+
+  while (true) {
+    std::string id;
+    {
+      std::unique_lock<std::mutex> lock(_m);
+      _prerenderCv.wait(lock, [this] { return !_prerenderQueue.empty(); });
+      id = _prerenderQueue.front();
+      _prerenderQueue.pop_front();
+    }
+
+    try {
+      prerenderSession(id, pool);
+    } catch (const OutOfMemoryError& ex) {
+      LOG(INFO) << "[SERVER] Stopped pre-rendering session " << id << ": "
+                << ex.what();
+    } catch (const std::exception& ex) {
+      LOG(ERROR) << ex.what();
+    }
+  }
+}
+
+// _____________________________________________________________________________
+void Server::prerenderSession(const std::string& id, TaskPool& pool) const {
+  std::shared_ptr<Requestor> r;
+  std::shared_ptr<RenderCache> cache;
+
+  {
+    std::lock_guard<std::mutex> guard(_m);
+    if (!_rs.count(id) || !_renderCaches.count(id)) return;
+    r = _rs[id];
+    cache = _renderCaches[id];
+  }
+
+  auto bbox = r->getPointGrid().getBBox();
+  bbox = extendBox(r->getLineGrid().getBBox(), bbox);
+
+  if (bbox.getLowerLeft().getX() > bbox.getUpperRight().getX()) return;
+
+  LOG(INFO) << "[SERVER] Pre-rendering session " << id << "...";
+
+  // the highest zoom levels come first, as the initial view of the client
+  // fits the bounding box of the result
+  for (int z = PRERENDER_MAX_ZOOM; z >= 0; z--) {
+    double res = RenderCache::zoomRes(z);
+
+    int64_t x0 = floor((bbox.getLowerLeft().getX() + WEB_MERC_EXT) / res) - 2;
+    int64_t y0 = floor((WEB_MERC_EXT - bbox.getUpperRight().getY()) / res) - 2;
+    int64_t x1 = ceil((bbox.getUpperRight().getX() + WEB_MERC_EXT) / res) + 2;
+    int64_t y1 = ceil((WEB_MERC_EXT - bbox.getLowerLeft().getY()) / res) + 2;
+
+    size_t w = x1 - x0;
+    size_t h = y1 - y0;
+
+    if (w * h > PRERENDER_MAX_PIXELS) continue;
+
+    {
+      // stop if the session was cleared in the meantime
+      std::lock_guard<std::mutex> guard(_m);
+      if (!_renderCaches.count(id)) return;
+    }
+
+    checkMem(w * h * sizeof(double), _maxMemory);
+
+    DBox rbox({x0 * res - WEB_MERC_EXT, WEB_MERC_EXT - y1 * res},
+              {x1 * res - WEB_MERC_EXT, WEB_MERC_EXT - y0 * res});
+
+    std::vector<std::vector<uint32_t>> points(pool.numSlots());
+    std::vector<std::vector<double>> points2(pool.numSlots());
+    for (auto& p2 : points2) p2.resize(w * h, 0);
+
+    collectPoints(r, rbox, w, h, HEATMAP, pool, points, points2, 0);
+
+    std::shared_ptr<ZoomRaster> raster(new ZoomRaster());
+    raster->zoom = z;
+    raster->x0 = x0;
+    raster->y0 = y0;
+    raster->w = w;
+    raster->h = h;
+
+    std::sort(points[0].begin(), points[0].end());
+    raster->pixels.reserve(points[0].size());
+    raster->weights.reserve(points[0].size());
+
+    for (auto p : points[0]) {
+      raster->pixels.push_back(p);
+      raster->weights.push_back(points2[0][p]);
+    }
+
+    cache->put(raster);
+  }
+
+  LOG(INFO) << "[SERVER] ... done pre-rendering session " << id << " ("
+            << cache->memUsage() << " bytes)";
 }
 
 // _____________________________________________________________________________
@@ -1190,13 +2387,80 @@ void Server::drawPoint(std::vector<uint32_t>& points,
 }
 
 // _____________________________________________________________________________
-std::string Server::getSessionId() const {
-  std::random_device dev;
-  std::mt19937 rng(dev());
-  std::uniform_int_distribution<std::mt19937::result_type> d(
-      1, std::numeric_limits<int>::max());
+void Server::drawCluster(std::vector<uint32_t>& points,
+                         std::vector<double>& points2, int px, int py, int w,
+                         int h, size_t num) const {
+  if (num == 1) {
+    drawPoint(points, points2, px, py, w, h, OBJECTS, 1);
+    return;
+  }
+
+  // the marker grows with the log of the number of members
+  int rad = std::min<double>(CLUSTER_MARKER_MAX_RAD, 2 + std::log2(num));
+
+  for (int x = px - rad; x <= px + rad; x++) {
+    for (int y = py - rad; y <= py + rad; y++) {
+      if ((x - px) * (x - px) + (y - py) * (y - py) > rad * rad) continue;
+      if (x >= 0 && y >= 0 && x < w && y < h) {
+        if (points2[w * y + x] == 0) points.push_back(w * y + x);
+        points2[w * y + x] += 1;
+      }
+    }
+  }
+}
+
+// _____________________________________________________________________________
+std::string Server::getSessionId(const std::string& key,
+                                 const std::string& query) {
+  std::string sq = sessionQuery(key, query);
+
+  // a collision resistant hash, so no query can be crafted to get the id
+  // (and the publicly cacheable tiles) of another one
+  Sha256 sum;
+  sum.update(sq.c_str(), sq.size());
+  return sum.hex(16);
+}
+
+// _____________________________________________________________________________
+std::string Server::sessionQuery(const std::string& key,
+                                 const std::string& query) {
+  return key + '\0' + normalizeQuery(query);
+}
+
+// _____________________________________________________________________________
+std::string Server::normalizeQuery(const std::string& query) {
+  std::string ret;
+  ret.reserve(query.size());
+
+  char quote = 0;
+  bool space = false;
+
+  for (size_t i = 0; i < query.size(); i++) {
+    char c = query[i];
+
+    if (quote) {
+      ret += c;
+      if (c == '\\' && i + 1 < query.size()) {
+        ret += query[++i];
+      } else if (c == quote) {
+        quote = 0;
+      }
+      continue;
+    }
+
+    if (std::isspace(static_cast<unsigned char>(c))) {
+      space = true;
+      continue;
+    }
+
+    if (space && ret.size()) ret += ' ';
+    space = false;
 
-  return std::to_string(d(rng));
+    if (c == '"' || c == '\'') quote = c;
+    ret += c;
+  }
+
+  return ret;
 }
 
 // _____________________________________________________________________________
@@ -1212,36 +2476,200 @@ double Server::getLoadStatusPercent() const {
 }
 
 // _____________________________________________________________________________
-void Server::createCache(const std::string& backend) const {
-  std::shared_ptr<GeomCache> cache;
-
+std::shared_ptr<GeomCache> Server::createCache(const std::string& backend,
+                                               std::string* indexHash) const {
   {
     std::lock_guard<std::mutex> guard(_m);
-    if (_caches.count(backend)) {
-      cache = _caches[backend];
-    } else {
-      cache = std::shared_ptr<GeomCache>(new GeomCache(backend));
-      _caches[backend] = cache;
+    auto it = _indexHashes.find(backend);
+    if (it != _indexHashes.end()) {
+      auto cache = _caches.find(cacheKey(backend, it->second));
+      if (cache != _caches.end()) {
+        if (indexHash) *indexHash = it->second;
+        return cache->second;
+      }
     }
   }
+
+  // first request for this backend, later changes of its index hash are
+  // picked up by watchIndexHashes()
+  std::string hash = util::trim(GeomCache::requestIndexHash(backend));
+
+  std::lock_guard<std::mutex> guard(_m);
+  if (indexHash) *indexHash = hash;
+  return mapCache(backend, hash);
 }
 
 // _____________________________________________________________________________
-std::string Server::loadCache(const std::string& backend) const {
-  std::shared_ptr<GeomCache> cache = _caches[backend];
+std::shared_ptr<GeomCache> Server::mapCache(
+    const std::string& backend, const std::string& indexHash) const {
+  auto prev = _indexHashes.find(backend);
+  if (prev != _indexHashes.end() && prev->second != indexHash) {
+    LOG(INFO) << "[SERVER] Index hash of backend " << backend
+              << " changed to '" << indexHash << "'";
+    std::string prevKey = cacheKey(backend, prev->second);
+    _indexHashes.erase(prev);
+    dropUnusedCache(prevKey);
+  }
+
+  _indexHashes[backend] = indexHash;
+
+  auto& cache = _caches[cacheKey(backend, indexHash)];
+  if (!cache) {
+    cache = std::shared_ptr<GeomCache>(
+        new GeomCache(backend, _maxMemory, _packLines));
+    cache->setShard(_shard, _numShards);
+    cache->setPeers(_peers);
+  } else if (cache->getBackendURL() != backend) {
+    LOG(INFO) << "[SERVER] Backend " << backend
+              << " shares the geometry cache of " << cache->getBackendURL();
+  }
+
+  return cache;
+}
 
+// _____________________________________________________________________________
+std::string Server::loadCache(std::shared_ptr<GeomCache> cache,
+                              const std::string& indexHash) const {
   try {
-    return cache->load(_cacheDir);
+    return cache->load(_cacheDir, indexHash);
   } catch (...) {
     std::lock_guard<std::mutex> guard(_m);
 
-    auto it = _caches.find(backend);
-    if (it != _caches.end()) _caches.erase(it);
+    // drop the cache for all backends sharing it
+    for (auto it = _caches.begin(); it != _caches.end();) {
+      if (it->second == cache) {
+        it = _caches.erase(it);
+      } else {
+        it++;
+      }
+    }
+
+    for (auto it = _indexHashes.begin(); it != _indexHashes.end();) {
+      if (!_caches.count(cacheKey(it->first, it->second))) {
+        it = _indexHashes.erase(it);
+      } else {
+        it++;
+      }
+    }
 
     throw;
   }
 }
 
+// _____________________________________________________________________________
+void Server::dropUnusedCache(const std::string& key) const {
+  for (const auto& b : _indexHashes) {
+    if (cacheKey(b.first, b.second) == key) return;
+  }
+
+  // running sessions keep their own reference
+  _caches.erase(key);
+}
+
+// _____________________________________________________________________________
+std::string Server::cacheKey(const std::string& backend,
+                             const std::string& indexHash) {
+  // backends serving the same index share one cache, backends without an
+  // index hash get their own
+  if (indexHash.empty()) return "$" + backend;
+  return indexHash;
+}
+
+// _____________________________________________________________________________
+void Server::watchIndexHashes() const {
+  while (true) {
+    std::this_thread::sleep_for(std::chrono::seconds(_indexHashInterval));
+
+    std::vector<std::pair<std::string, std::string>> backends;
+    {
+      std::lock_guard<std::mutex> guard(_m);
+      backends.assign(_indexHashes.begin(), _indexHashes.end());
+    }
+
+    for (const auto& b : backends) {
+      std::string hash = util::trim(GeomCache::requestIndexHash(b.first));
+
+      // keep the current hash while the backend is unreachable
+      if (hash.empty() || hash == b.second) continue;
+
+      std::shared_ptr<GeomCache> cache;
+      {
+        std::lock_guard<std::mutex> guard(_m);
+
+        // the cache of the backend may have been dropped meanwhile
+        if (!_indexHashes.count(b.first)) continue;
+        cache = mapCache(b.first, hash);
+      }
+
+      // fill the cache of the new index right away, not on the next query
+      std::thread([this, cache, hash]() {
+        try {
+          loadCache(cache, hash);
+        } catch (const std::exception& e) {
+          LOG(ERROR) << "[SERVER] Loading the cache of index '" << hash
+                     << "' failed: " << e.what();
+        }
+      }).detach();
+    }
+  }
+}
+
+// _____________________________________________________________________________
+uint32_t Server::parseColor(const std::string& color) {
+  std::string hex = color;
+  if (hex.size() && hex[0] == '#') hex = hex.substr(1);
+
+  if (hex.size() != 6 ||
+      hex.find_first_not_of("0123456789abcdefABCDEF") != std::string::npos) {
+    throw std::invalid_argument("Invalid color " + color + ", expected RRGGBB");
+  }
+
+  return std::strtoul(hex.c_str(), 0, 16);
+}
+
+// _____________________________________________________________________________
+std::vector<unsigned char> Server::layerColorScheme(uint32_t rgb,
+                                                    MapStyle style) {
+  unsigned char r = (rgb >> 16) & 0xFF;
+  unsigned char g = (rgb >> 8) & 0xFF;
+  unsigned char b = rgb & 0xFF;
+
+  std::vector<unsigned char> ret;
+
+  if (style == OBJECTS) {
+    // the same opacity steps as the default object colors
+    static const unsigned char alphas[] = {0,   0,   16,  32,  64,
+                                           128, 160, 192, 224, 255};
+    for (auto a : alphas) ret.insert(ret.end(), {r, g, b, a});
+  } else {
+    // opacity grows with the square root of the heat, to keep sparse
+    // areas visible
+    for (size_t i = 0; i < LAYER_HEAT_STEPS; i++) {
+      unsigned char a = 255 * sqrt(i / (LAYER_HEAT_STEPS - 1.0));
+      ret.insert(ret.end(), {r, g, b, a});
+    }
+  }
+
+  return ret;
+}
+
+// _____________________________________________________________________________
+void Server::blendOver(const unsigned char* src, unsigned char* dst,
+                       size_t n) {
+  for (size_t i = 0; i < n * 4; i += 4) {
+    double sa = src[i + 3] / 255.0;
+    if (sa == 0) continue;
+
+    double da = dst[i + 3] / 255.0;
+    double oa = sa + da * (1 - sa);
+
+    for (size_t c = 0; c < 3; c++) {
+      dst[i + c] = (src[i + c] * sa + dst[i + c] * da * (1 - sa)) / oa + 0.5;
+    }
+    dst[i + 3] = oa * 255 + 0.5;
+  }
+}
+
 // _____________________________________________________________________________
 void Server::drawLine(unsigned char* image, int x0, int y0, int x1, int y1,
                       int w, int h) const {
@@ -5,15 +5,24 @@
 #ifndef PETRIMAPS_SERVER_SERVER_H_
 #define PETRIMAPS_SERVER_SERVER_H_
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <map>
 #include <memory>
 #include <mutex>
 #include <string>
 #include <thread>
+#include <vector>
 
 #include <png.h>
 #include "qlever-petrimaps/GeomCache.h"
+#include "qlever-petrimaps/TaskPool.h"
+#include "qlever-petrimaps/server/RenderCache.h"
+#include "qlever-petrimaps/server/RequestLog.h"
 #include "qlever-petrimaps/server/Requestor.h"
+#include "qlever-petrimaps/server/ShardClient.h"
 #include "util/http/Server.h"
 
 namespace petrimaps {
@@ -22,44 +31,194 @@ typedef std::map<std::string, std::string> Params;
 
 enum MapStyle { HEATMAP, OBJECTS };
 
+// A static asset embedded at build time, with optional precompressed
+// variants (length 0 if not available) and a hex hash of its content.
+struct StaticAsset {
+  const char* path;
+  const char* type;
+  const unsigned char* raw;
+  size_t rawLen;
+  const unsigned char* gz;
+  size_t gzLen;
+  const unsigned char* br;
+  size_t brLen;
+  const char* hash;
+};
+
 class Server : public util::http::Handler {
  public:
-  explicit Server(size_t maxMemory, const std::string& cacheDir,
-                  int cacheLifetime);
+  Server(size_t maxMemory, const std::string& cacheDir, int cacheLifetime,
+         int indexHashInterval, bool packLines,
+         const std::string& requestLog);
 
   virtual util::http::Answer handle(const util::http::Req& request,
                                     int connection) const;
 
+  // only hold shard of numShards shards of each geometry cache
+  void setShard(size_t shard, size_t numShards);
+
+  // act as the coordinator of the petrimaps processes at shardUrls, which
+  // hold one shard of the geometry caches each
+  void setShards(const std::vector<std::string>& shardUrls);
+
+  // petrimaps instances to fetch missing cache files from
+  void setPeers(const std::vector<std::string>& peerUrls);
+
  private:
   static std::string parseUrl(std::string u, std::string pl, Params* params);
 
+  static const StaticAsset* getStaticAsset(const std::string& path);
+  util::http::Answer handleStaticReq(const util::http::Req& req,
+                                     const StaticAsset& asset,
+                                     const Params& pars, int sock) const;
+
+  // value of the request header name (case-insensitive), or empty
+  static std::string getHeader(const util::http::Req& req,
+                               const std::string& name);
+
+  // true if the Accept-Encoding header accept allows encoding
+  static bool acceptsEncoding(const std::string& accept,
+                              const std::string& encoding);
+
+  // true if the If-None-Match header ifNoneMatch matches etag
+  static bool etagMatches(const std::string& ifNoneMatch,
+                          const std::string& etag);
+
   util::http::Answer handleHeatMapReq(const Params& pars, int sock) const;
   util::http::Answer handleQueryReq(const Params& pars) const;
+  util::http::Answer handleDensityReq(const Params& pars) const;
   util::http::Answer handleGeoJSONReq(const Params& pars) const;
   util::http::Answer handleClearSessReq(const Params& pars) const;
   util::http::Answer handlePosReq(const Params& pars) const;
   util::http::Answer handleLoadReq(const Params& pars) const;
 
   util::http::Answer handleExportReq(const Params& pars, int sock) const;
+  util::http::Answer handleCacheFileReq(const Params& pars, int sock) const;
   util::http::Answer handleLoadStatusReq(const Params& pars) const;
+  util::http::Answer handleLoadStatusStreamReq(const Params& pars,
+                                               int sock) const;
+
+  // requests to a coordinator, except /heatmap and /density
+  util::http::Answer handleCoordinatorReq(const std::string& cmd,
+                                          const Params& pars) const;
+  util::http::Answer handleShardedQueryReq(const Params& pars) const;
+  util::http::Answer handleShardedPosReq(const std::vector<Params>& pars) const;
+  util::http::Answer handleShardedGeoJSONReq(std::vector<Params> pars) const;
+  util::http::Answer handleShardedExportReq(
+      const std::vector<Params>& pars) const;
+
+  // the parameters pars for each shard, with the coordinator session id
+  // replaced by the id of the shard session
+  std::vector<Params> shardParams(const Params& pars) const;
+
+  // add the counts of the density grids of the shard sessions ids to
+  // points and points2
+  void collectShardPoints(const std::vector<std::string>& ids,
+                          const std::string& bbox, int w, int h,
+                          std::vector<std::vector<uint32_t>>& points,
+                          std::vector<std::vector<double>>& points2) const;
+
+  std::string loadStatusJson(std::shared_ptr<GeomCache> cache,
+                             const std::string& backend,
+                             const std::string& query) const;
+  bool isLoadDone(std::shared_ptr<const GeomCache> cache,
+                  const std::string& backend, const std::string& query) const;
+
+  // the session of query on backend, if its geom cache is ready
+  std::shared_ptr<Requestor> getSession(std::shared_ptr<const GeomCache> cache,
+                                        const std::string& backend,
+                                        const std::string& query) const;
+
+  // write all of data to sock, false if the socket was closed
+  static bool sendAll(int sock, const std::string& data);
+
+  // checksum of the open cache file fd, as sent to peers
+  std::string cacheFileChecksum(const std::string& fname, int fd) const;
+
+  // the geometry cache for backend, created if necessary. If indexHash is
+  // given, it is set to the current index hash of the backend
+  std::shared_ptr<GeomCache> createCache(const std::string& backend,
+                                         std::string* indexHash) const;
+  std::string loadCache(std::shared_ptr<GeomCache> cache,
+                        const std::string& indexHash) const;
+
+  // map backend to the cache of indexHash, expects _m to be locked
+  std::shared_ptr<GeomCache> mapCache(const std::string& backend,
+                                      const std::string& indexHash) const;
+
+  // drop the cache stored under key if no backend maps to it anymore,
+  // expects _m to be locked
+  void dropUnusedCache(const std::string& key) const;
 
-  void createCache(const std::string& backend) const;
-  std::string loadCache(const std::string& backend) const;
+  static std::string cacheKey(const std::string& backend,
+                              const std::string& indexHash);
+
+  // poll the index hashes of all known backends every _indexHashInterval
+  // seconds, and switch backends whose index changed to a new cache
+  void watchIndexHashes() const;
 
   void clearSession(const std::string& id) const;
   void clearSessions() const;
   void clearOldSessions() const;
 
-  std::string getSessionId() const;
+  // the id of the session of query on the geometry cache key (see
+  // cacheKey()). Ids only depend on the index and the query, so every node
+  // and every restart assigns the same id to the same session
+  static std::string getSessionId(const std::string& key,
+                                  const std::string& query);
+
+  // key and normalized query a session id is derived from
+  static std::string sessionQuery(const std::string& key,
+                                  const std::string& query);
+
+  // query with whitespace outside of string literals collapsed
+  static std::string normalizeQuery(const std::string& query);
 
   double getLoadStatusPercent() const;
 
+  void prerender() const;
+  void prerenderSession(const std::string& id, TaskPool& pool) const;
+
+  // accumulate the points of the w x h image of bbox in points / points2,
+  // with one vector per slot of pool. image is only drawn on for the
+  // OBJECTS style
+  void collectPoints(std::shared_ptr<const Requestor> r,
+                     const util::geo::DBox& bbox, int w, int h,
+                     MapStyle style, TaskPool& pool,
+                     std::vector<std::vector<uint32_t>>& points,
+                     std::vector<std::vector<double>>& points2,
+                     unsigned char* image) const;
+
+  // collectPoints(), using the pre-rendered raster of renderCache for the
+  // resolution of the image, if there is one
+  void collectCachedPoints(std::shared_ptr<const Requestor> r,
+                           std::shared_ptr<const RenderCache> renderCache,
+                           const util::geo::DBox& bbox, int w, int h,
+                           MapStyle style, TaskPool& pool,
+                           std::vector<std::vector<uint32_t>>& points,
+                           std::vector<std::vector<double>>& points2,
+                           unsigned char* image) const;
+
   static void pngWriteRowCb(png_structp png_ptr, png_uint_32 row, int pass);
   void writePNG(const unsigned char* data, size_t w, size_t h, int sock) const;
 
   void drawPoint(std::vector<uint32_t>& points, std::vector<double>& points2,
                  int px, int py, int w, int h, MapStyle style,
                  size_t num) const;
+  // draw a cluster of num points of the cluster index in object mode
+  void drawCluster(std::vector<uint32_t>& points, std::vector<double>& points2,
+                   int px, int py, int w, int h, size_t num) const;
+  // RRGGBB hex color, optionally prefixed by #
+  static uint32_t parseColor(const std::string& color);
+
+  // heatmap color scheme for a layer of color rgb
+  static std::vector<unsigned char> layerColorScheme(uint32_t rgb,
+                                                     MapStyle style);
+
+  // blend the n RGBA pixels of src over dst
+  static void blendOver(const unsigned char* src, unsigned char* dst,
+                        size_t n);
+
   void drawLine(unsigned char* image, int x0, int y0, int x1, int y1, int w,
                 int h) const;
 
@@ -69,14 +228,58 @@ class Server : public util::http::Handler {
 
   int _cacheLifetime;
 
+  int _indexHashInterval;
+
+  bool _packLines;
+
+  // if set, requests are recorded here
+  std::unique_ptr<RequestLog> _requestLog;
+
   // Load Status
   mutable size_t _totalSize = 0;
 
   mutable std::mutex _m;
 
+  mutable std::atomic<size_t> _numLoadStreams{0};
+
+  // geometry caches keyed by index hash, backends serving the same index
+  // share one cache
   mutable std::map<std::string, std::shared_ptr<GeomCache>> _caches;
+  // backend URL to its current index hash
+  mutable std::map<std::string, std::string> _indexHashes;
   mutable std::map<std::string, std::shared_ptr<Requestor>> _rs;
-  mutable std::map<std::string, std::string> _queryCache;
+  // sessionQuery() of each session in _rs, to never hand out the session of
+  // another query with the same id
+  mutable std::map<std::string, std::string> _sessionQueries;
+  mutable std::map<std::string, std::shared_ptr<RenderCache>> _renderCaches;
+
+  size_t _shard = 0;
+  size_t _numShards = 1;
+
+  // set if this is a coordinator
+  std::unique_ptr<ShardClient> _shardClient;
+
+  // sessions of a coordinator, the ids of the corresponding shard sessions
+  struct ShardSession {
+    std::vector<std::string> ids;
+    std::chrono::system_clock::time_point createdAt;
+  };
+  mutable std::map<std::string, ShardSession> _shardSessions;
+
+  std::vector<std::string> _peers;
+
+  // checksums of served cache files, with the size and modification time
+  // they were computed for
+  struct FileChecksum {
+    size_t size;
+    time_t mtime;
+    std::string sum;
+  };
+  mutable std::map<std::string, FileChecksum> _cacheFileChecksums;
+
+  // sessions waiting to be pre-rendered
+  mutable std::deque<std::string> _prerenderQueue;
+  mutable std::condition_variable _prerenderCv;
 };
 }  // namespace petrimaps
 
@@ -0,0 +1,146 @@
+// Copyright 2026, agent <agent@local>
+
+#include <curl/curl.h>
+
+#include <cstring>
+#include <exception>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include "qlever-petrimaps/server/ShardClient.h"
+#include "util/Misc.h"
+#include "util/log/Log.h"
+
+using petrimaps::ShardClient;
+
+// a dead shard must not block the requests of the coordinator
+const static long SHARD_CONNECT_TIMEOUT = 10;
+
+// _____________________________________________________________________________
+std::vector<std::string> ShardClient::get(
+    const std::string& path, const std::map<std::string, std::string>& params,
+    long timeout) const {
+  return get(path,
+             std::vector<std::map<std::string, std::string>>(_urls.size(),
+                                                             params),
+             timeout);
+}
+
+// _____________________________________________________________________________
+std::vector<std::string> ShardClient::get(
+    const std::string& path,
+    const std::vector<std::map<std::string, std::string>>& params,
+    long timeout) const {
+  std::vector<std::string> ret(_urls.size());
+  std::vector<std::exception_ptr> errors(_urls.size());
+
+  // the shards mostly wait for each other, so each one gets its own thread
+  // instead of a slot of the task pool
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < _urls.size(); i++) {
+    threads.push_back(std::thread([&, i]() {
+      try {
+        ret[i] = get(i, path, params[i], timeout);
+      } catch (...) {
+        errors[i] = std::current_exception();
+      }
+    }));
+  }
+
+  for (auto& t : threads) t.join();
+
+  for (const auto& e : errors) {
+    if (e) std::rethrow_exception(e);
+  }
+
+  return ret;
+}
+
+// _____________________________________________________________________________
+std::string ShardClient::get(
+    size_t shard, const std::string& path,
+    const std::map<std::string, std::string>& params, long timeout) const {
+  long status = 0;
+  std::string ret = get(url(shard, path, params), timeout, &status);
+
+  if (status != 200) {
+    std::stringstream ss;
+    ss << "Shard " << _urls[shard] << " returned status code " << status
+       << " for " << path << ": " << ret;
+    throw std::runtime_error(ss.str());
+  }
+
+  return ret;
+}
+
+// _____________________________________________________________________________
+std::string ShardClient::url(
+    size_t shard, const std::string& path,
+    const std::map<std::string, std::string>& params) const {
+  CURL* curl = curl_easy_init();
+  std::string url = _urls[shard] + path + "?";
+  for (const auto& kv : params) {
+    if (url.back() != '?') url += "&";
+    char* esc = curl_easy_escape(curl, kv.second.c_str(), kv.second.size());
+    url += kv.first + "=" + esc;
+    curl_free(esc);
+  }
+  curl_easy_cleanup(curl);
+  return url;
+}
+
+// _____________________________________________________________________________
+std::string ShardClient::get(const std::string& url, long timeout,
+                             long* status) {
+  std::string ret;
+  char errbuf[CURL_ERROR_SIZE];
+  errbuf[0] = 0;
+
+  CURL* curl = curl_easy_init();
+  if (!curl) throw std::runtime_error("Failed to perform curl request.");
+
+  curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, ShardClient::writeCb);
+  curl_easy_setopt(curl, CURLOPT_WRITEDATA, &ret);
+  curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, errbuf);
+  curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+  curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, SHARD_CONNECT_TIMEOUT);
+  if (timeout > 0) curl_easy_setopt(curl, CURLOPT_TIMEOUT, timeout);
+
+  // accept any compression supported
+  curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");
+  CURLcode res = curl_easy_perform(curl);
+
+  *status = 0;
+  curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, status);
+  curl_easy_cleanup(curl);
+
+  if (res != CURLE_OK) {
+    std::string err = strlen(errbuf) ? errbuf : curl_easy_strerror(res);
+    throw std::runtime_error("Request to shard failed: " + err);
+  }
+
+  return ret;
+}
+
+// _____________________________________________________________________________
+size_t ShardClient::writeCb(void* contents, size_t size, size_t nmemb,
+                            void* userp) {
+  static_cast<std::string*>(userp)->append(static_cast<char*>(contents),
+                                           size * nmemb);
+  return size * nmemb;
+}
+
+// _____________________________________________________________________________
+std::vector<std::string> ShardClient::parseUrls(const std::string& list) {
+  std::vector<std::string> ret;
+  for (auto url : util::split(list, ',')) {
+    url = util::trim(url);
+    if (url.empty()) continue;
+    if (url.find("://") == std::string::npos) url = "http://" + url;
+    while (url.size() && url.back() == '/') url.pop_back();
+    ret.push_back(url);
+  }
+  return ret;
+}
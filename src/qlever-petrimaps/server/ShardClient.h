@@ -0,0 +1,59 @@
+// Copyright 2026, agent <agent@local>
+
+#ifndef PETRIMAPS_SERVER_SHARDCLIENT_H_
+#define PETRIMAPS_SERVER_SHARDCLIENT_H_
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace petrimaps {
+
+// HTTP client used by a coordinator to fan out requests to the petrimaps
+// processes holding the shards of the geometry cache.
+class ShardClient {
+ public:
+  explicit ShardClient(const std::vector<std::string>& urls) : _urls(urls) {}
+
+  size_t size() const { return _urls.size(); }
+
+  const std::string& getUrl(size_t shard) const { return _urls[shard]; }
+
+  // request path with the parameters params[i] from shard i, all shards in
+  // parallel. Returns the response bodies, throws std::runtime_error if any
+  // shard did not answer with 200 OK, or, if timeout is not 0, did not
+  // answer within timeout seconds
+  std::vector<std::string> get(
+      const std::string& path,
+      const std::vector<std::map<std::string, std::string>>& params,
+      long timeout = 0) const;
+
+  // as above, but with the same parameters for all shards
+  std::vector<std::string> get(
+      const std::string& path,
+      const std::map<std::string, std::string>& params,
+      long timeout = 0) const;
+
+  // request path with the parameters params from shard shard only
+  std::string get(size_t shard, const std::string& path,
+                  const std::map<std::string, std::string>& params,
+                  long timeout = 0) const;
+
+  // parse a comma-separated list of shard URLs
+  static std::vector<std::string> parseUrls(const std::string& list);
+
+ private:
+  std::vector<std::string> _urls;
+
+  std::string url(size_t shard, const std::string& path,
+                  const std::map<std::string, std::string>& params) const;
+
+  static std::string get(const std::string& url, long timeout, long* status);
+
+  static size_t writeCb(void* contents, size_t size, size_t nmemb,
+                        void* userp);
+};
+
+}  // namespace petrimaps
+
+#endif  // PETRIMAPS_SERVER_SHARDCLIENT_H_
@@ -10,6 +10,9 @@ let mode = urlParams.get("mode");
 // id of SetInterval to stop loadStatus requests on error or load finish
 let loadStatusIntervalId = -1;
 
+// load status event stream, if supported
+let loadStatusSource = null;
+
 let map = L.map('m', {
     renderer: L.canvas(),
     preferCanvas: true
@@ -88,6 +91,7 @@ function openPopup(data) {
             "<td>" + value + "</td></tr>");
         })
         let popup_html = "<table class=\"popup\">" + popup_content_strings.join("\n") + "</table>";
+        if (data[0]["clustered"] > 1) popup_html = '<div class="cluster-info">' + (data[0]["clustered"] - 1) + ' more objects here, zoom in to see them</div>' + popup_html;
         popup_html += '<a class="export-link" href="geojson?gid=' + data[0].id + "&id=" + sessionId + '&rad=0&export=1">Export as GeoJSON</a>';
 
         if (curGeojson) curGeojson.remove();
@@ -260,6 +264,19 @@ function updateLoad(stage, percent, totalProgress, currentProgress) {
             infoDescElem.innerHTML = "This needs to be done only once after the server has been started and does not have to be repeated for subsequent queries.";
             stageElem.innerHTML = `Reading ${currentProgress}/${totalProgress} geometries from disk... (1/1)`;
             break;
+        case 5:
+            infoHeadingElem.innerHTML = "Fetching the geometry cache from a peer";
+            infoDescElem.innerHTML = "This needs to be done only once for each new version of the dataset and does not have to be repeated for subsequent queries.";
+            stageElem.innerHTML = `Fetching ${Math.round(currentProgress / 1000000)}/${Math.round(totalProgress / 1000000)} MB...`;
+            break;
+        case 4: {
+            infoHeadingElem.innerHTML = "Building the result";
+            infoDescElem.innerHTML = "";
+            const phases = ["Fetching the query result", "Matching geometries", "Building the map index"];
+            const phase = Math.max(0, Math.min(currentProgress - 1, 2));
+            stageElem.innerHTML = `${phases[phase]}... (${phase + 1}/3)`;
+            break;
+        }
     }
     barElem.style.width = percent + "%";
     percentElem.innerHTML = percent.toString() + "%";
@@ -278,7 +295,10 @@ function fetchResults() {
     .then(data => {
         loadMap(data["qid"], data["bounds"], data["numobjects"]);
     })
-    .catch(error => showError(error));
+    .catch(error => {
+        showError(error);
+        stopLoadStatus();
+    });
 }
 
 function fetchLoadStatusInterval(interval) {
@@ -289,31 +309,73 @@ function fetchLoadStatusInterval(interval) {
 async function fetchLoadStatus() {
     console.log("Fetching load status...");
 
-    fetch('loadstatus?backend=' + qleverBackend)
+    fetch(loadStatusParams('loadstatus'))
     .then(response => {
         if (!response.ok) return response.text().then(text => {throw new Error(text)});
         return response;
     })
     .then(response => response.json())
-    .then(data => {
-        var stage = data["stage"];
-        var percent = parseFloat(data["percent"]).toFixed(2);
-        var totalProgress = data["totalProgress"].toLocaleString('en');
-        var currentProgress = data["currentProgress"].toLocaleString('en');
-        updateLoad(stage, percent, totalProgress, currentProgress);
-    })
+    .then(data => handleLoadStatus(data))
     .catch(error => {
         showError(error);
-        clearInterval(loadStatusIntervalId);
+        stopLoadStatus();
+    });
+}
+
+function loadStatusParams(endpoint) {
+    return endpoint + '?backend=' + encodeURIComponent(qleverBackend) + '&query=' + encodeURIComponent(query);
+}
+
+function handleLoadStatus(data) {
+    var stage = data["stage"];
+    var percent = parseFloat(data["percent"]).toFixed(2);
+    var totalProgress = data["totalProgress"];
+    var currentProgress = data["currentProgress"];
+    if (stage != 4) {
+        totalProgress = totalProgress.toLocaleString('en');
+        currentProgress = currentProgress.toLocaleString('en');
+    }
+    updateLoad(stage, percent, totalProgress, currentProgress);
+}
+
+function streamLoadStatus() {
+    if (!window.EventSource) {
+        fetchLoadStatusInterval(333);
+        return;
+    }
+
+    console.log("Streaming load status...");
+
+    loadStatusSource = new EventSource(loadStatusParams('loadstatus/stream'));
+    loadStatusSource.onmessage = function(e) {
+        handleLoadStatus(JSON.parse(e.data));
+    };
+    loadStatusSource.addEventListener('done', function() {
+        loadStatusSource.close();
+        loadStatusSource = null;
     });
+    loadStatusSource.onerror = function() {
+        // too many streams on the server, or the connection was lost
+        loadStatusSource.close();
+        loadStatusSource = null;
+        if (!sessionId && loadStatusIntervalId == -1) fetchLoadStatusInterval(333);
+    };
+}
+
+function stopLoadStatus() {
+    if (loadStatusSource) {
+        loadStatusSource.close();
+        loadStatusSource = null;
+    }
+    clearInterval(loadStatusIntervalId);
 }
 
 fetchResults();
-fetchLoadStatusInterval(333);
+streamLoadStatus();
 
 function _onLayerLoad(e) {
     console.log("Map finished loading.");
-    clearInterval(loadStatusIntervalId);
+    stopLoadStatus();
     
     document.getElementById("msg").style.display = "none";
 }